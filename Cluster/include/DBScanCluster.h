@@ -21,14 +21,24 @@ http://www.cnblogs.com/chaosimple/p/3164775.html
 #ifndef  MPCDPS_DBSCANCLUSTER_H
 #define MPCDPS_DBSCANCLUSTER_H
 
+#include <cfloat>
 #include "PointCloudCluster.h"
 #include "KDTree.h"
-#include <stack>
+#include "ConcurrentUnionFind.h"
 
 namespace mpcdps {
 
 	/*
-	   0 for outliers points.
+	   0 for outliers points, the classes are 1, 2, ...; -1 for the points not reached from the seeds.
+	   A point is a core point if its neighbors within the max distance, including itself, are more than
+	   the min neighbor; a border point if they are equal to the min neighbor and it is a neighbor of a core point;
+	   otherwise it is an outlier.
+
+	   The neighbors are counted in parallel, the neighboring core points are merged by a concurrent union-find,
+	   then each border point takes the class of its nearest core point. A class is a connected component of
+	   core points, numbered in the order of the seeds. The neighbors of the points which are not core points,
+	   at most min neighbor of them, are kept from the counting, and only the core points are searched again,
+	   so the memory is min neighbor and a few integers for each point.
 	*/
 	template <typename T, int K>
 	class DBScanCluster : public PointCloudCluster<T, K>
@@ -47,6 +57,10 @@ namespace mpcdps {
 		/*Run the cluster. */
 		virtual void run();
 
+	protected:
+		/*Squared distance of two points, the same as the searches of KDTree. */
+		static double squareDistance(const T* pt1, const T* pt2);
+
 	protected:
 		float _max_dist;
 		int   _min_neighbor;
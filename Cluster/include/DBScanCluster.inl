@@ -24,6 +24,17 @@ DBScanCluster<T, K>::~DBScanCluster()
 
 }
 
+template <typename T, int K>
+double DBScanCluster<T, K>::squareDistance(const T* pt1, const T* pt2)
+{
+    double d = 0;
+    for (int i = 0; i < K; ++i) {
+        const double d1 = pt1[i] - pt2[i];
+        d += d1 * d1;
+    }
+    return d;
+}
+
 template <typename T, int K>
 void DBScanCluster<T, K>::run()
 {
@@ -36,75 +47,203 @@ void DBScanCluster<T, K>::run()
     }
 
     KDTree<T, K> kdtree;
-    double nodesize = 2.0;
+    /*leaves of about the search radius, the tree stops splitting at 200 points anyway. */
+    double nodesize = MAXV(double(this->_max_dist), 1e-6);
     std::vector<T> ns(K, 0);
     for (int i = 0; i < K; ++i) {
         ns[i] = nodesize;
     }
 
-    kdtree.setElements(_vtx_array);
-    kdtree.build(_target_points, _vmin, _vmax, &ns[0]);
+    kdtree.setElements(this->_vtx_array);
+    kdtree.build(this->_target_points, this->_vmin, this->_vmax, &ns[0]);
 
-    std::stack<int> stk;
-    std::vector<bool> tag(_vtx_array.size(), false);  //process
+    const int n = this->_vtx_array.size();
+    const int min_neighbor = this->_min_neighbor;
+    const std::vector<int>& seeds = this->_seeds;
 
-    std::vector<int> cls_ids(_vtx_array.size(), -1);
-    int next_cls_id = 1;  //0 is for outliers
-
-    for (size_t i = 0; i < _seeds.size(); ++i) {
-        int pt_id = _seeds[i];
-        if (tag[pt_id]) {
-            continue;
+    /*the targets and the seeds that are not targets, which are searched but can not be found by others. */
+    std::vector<char> is_target(n, 0), is_seed(n, 0);
+    std::vector<int> query_pts = this->_target_points;
+    for (size_t i = 0; i < query_pts.size(); ++i) {
+        is_target[query_pts[i]] = 1;
+    }
+    this->sortMorton(query_pts);
+    std::vector<int> free_seeds;
+    for (size_t i = 0; i < seeds.size(); ++i) {
+        if (!is_target[seeds[i]] && !is_seed[seeds[i]]) {
+            free_seeds.push_back(seeds[i]);
+            query_pts.push_back(seeds[i]);
+        }
+        is_seed[seeds[i]] = 1;
+    }
+    const int m = query_pts.size();
+
+    /*neighbor counts, -1 for the points not searched. A target which is not a core point has at most
+     * min neighbor neighbors, they are kept in its slot of small_neigbs, so it is not searched again.
+     * The neighbors of the core seeds that are not targets are kept too.
+     */
+    std::vector<int> counts(n, -1);
+    const int target_count = this->_target_points.size();
+    const int stride = MAXV(min_neighbor, 0);
+    std::vector<int> small_neigbs(size_t(target_count) * stride);
+    const int free_count = free_seeds.size();
+    std::vector<std::vector<int> > free_neigbs(free_count);
+#pragma omp parallel
+    {
+        std::vector<int> neigbs;
+        std::vector<double> dist2s;
+#pragma omp for schedule(dynamic, 256)
+        for (int i = 0; i < m; ++i) {
+            neigbs = kdtree.searchRadius(this->_vtx_array[query_pts[i]], this->_max_dist, dist2s);
+            const int count = neigbs.size();
+            counts[query_pts[i]] = count;
+            if (i < target_count && count <= min_neighbor) {
+                std::copy(neigbs.begin(), neigbs.end(), small_neigbs.begin() + size_t(i) * stride);
+            } else if (i >= target_count && count > min_neighbor) {
+                free_neigbs[i - target_count].swap(neigbs);
+            }
         }
+    }
 
-        {
-            std::vector<double> dist2s;
-            std::vector<int> neigbs = kdtree.searchRadius(this->_vtx_array[pt_id], this->_max_dist, dist2s);
-            if (neigbs.size() < this->_min_neighbor) {
-                cls_ids[pt_id] = 0;
-                tag[pt_id] = true;
+    /*merge the neighboring core points, the neighborhoods are symmetric, so each pair is merged once.
+     * Only the core points are searched again. The other points keep their nearest core neighbors,
+     * ties to the smaller id, for the border points.
+     */
+    ConcurrentUnionFind sets(n);
+    std::vector<int> near_core(n, -1);
+#pragma omp parallel
+    {
+        std::vector<int> neigbs;
+        std::vector<double> dist2s;
+#pragma omp for schedule(dynamic, 256)
+        for (int i = 0; i < target_count; ++i) {
+            const int pt_id = query_pts[i];
+            const int count = counts[pt_id];
+            if (count > min_neighbor) {
+                neigbs = kdtree.searchRadius(this->_vtx_array[pt_id], this->_max_dist, dist2s);
+                for (size_t j = 0; j < neigbs.size(); ++j) {
+                    const int q = neigbs[j];
+                    if (q < pt_id && counts[q] > min_neighbor) {
+                        sets.unite(pt_id, q);
+                    }
+                }
                 continue;
-            } else if (neigbs.size() == this->_min_neighbor) {
-                cls_ids[pt_id] = 0;
+            }
+            if (is_seed[pt_id] && count < min_neighbor) {
                 continue;
             }
+            const int* small = small_neigbs.data() + size_t(i) * stride;
+            double best_d2 = DBL_MAX;
+            for (int j = 0; j < count; ++j) {
+                const int q = small[j];
+                if (counts[q] <= min_neighbor) {
+                    continue;
+                }
+                const double d2 = squareDistance(this->_vtx_array[pt_id], this->_vtx_array[q]);
+                if (d2 < best_d2 || (d2 == best_d2 && q < near_core[pt_id])) {
+                    best_d2 = d2;
+                    near_core[pt_id] = q;
+                }
+            }
         }
+    }
+    sets.flatten();
 
-        int cls_id = next_cls_id++;
-        stk.push(pt_id);
-
-        std::vector<bool> instk(_vtx_array.size(), false);
-        instk[pt_id] = true;
-
-        while (!stk.empty()) {
-            pt_id = stk.top();
-            stk.pop();
-
-            std::vector<double> dist2s;
-            std::vector<int> neigbs = kdtree.searchRadius(this->_vtx_array[pt_id], this->_max_dist, dist2s);
-            
-            if (neigbs.size() < this->_min_neighbor) {  //outliers
-                cls_ids[pt_id] = 0;
-                tag[pt_id] = true;
-            } else if(neigbs.size() == this->_min_neighbor) {  //boundaries
-                cls_ids[pt_id] = cls_id;
-                tag[pt_id] = true;
-            } else {  //kernels
-                cls_ids[pt_id] = cls_id;
-                tag[pt_id] = true;
-                for (size_t j = 0; j < neigbs.size(); ++j) {
-                    pt_id = neigbs[j];
-                    if (!tag[pt_id]) {
-                        if (!instk[pt_id]) {
-                            stk.push(pt_id);
-                            instk[pt_id] = true;
-                        }
-                    }
+    /*number the classes in the order of the seeds. A core seed that is not a target starts a class,
+     * which takes the components of its core neighbors that have no class yet.
+     */
+    std::vector<int> root_cls(n, -1);
+    int next_cls_id = 1;  //0 is for outliers
+    for (size_t i = 0, k = 0; i < seeds.size(); ++i) {
+        const int pt_id = seeds[i];
+        if (counts[pt_id] <= min_neighbor) {
+            continue;
+        }
+        const int root = sets.find(pt_id);
+        if (root_cls[root] >= 0) {
+            continue;
+        }
+        const int cls_id = next_cls_id++;
+        root_cls[root] = cls_id;
+        if (is_target[pt_id]) {
+            continue;
+        }
+        while (free_seeds[k] != pt_id) {
+            ++k;
+        }
+        const std::vector<int>& neigbs = free_neigbs[k];
+        for (size_t j = 0; j < neigbs.size(); ++j) {
+            if (counts[neigbs[j]] > min_neighbor) {
+                const int r = sets.find(neigbs[j]);
+                if (root_cls[r] < 0) {
+                    root_cls[r] = cls_id;
                 }
             }
         }
     }
 
-    _cls_count = next_cls_id;
-    _cls_ids = cls_ids;
-}
\ No newline at end of file
+    /*core points take the classes of their components. A border point takes the class of its nearest core
+     * point, and an outlier is 0 if it is a seed or a neighbor of a core point in a class. A seed that is
+     * not a target can not be reached, it is 0 if it is not a core point.
+     * The nearest core point may be in a component without class if the seeds are not all of the targets,
+     * then the kept neighbors are scanned for the nearest core point in a class.
+     */
+    std::vector<int> cls_ids(n, -1);
+#pragma omp parallel for schedule(dynamic, 256)
+    for (int i = 0; i < m; ++i) {
+        const int pt_id = query_pts[i];
+        const int count = counts[pt_id];
+        if (count > min_neighbor) {
+            cls_ids[pt_id] = root_cls[sets.find(pt_id)];
+            continue;
+        }
+        if (!is_target[pt_id] || near_core[pt_id] < 0) {
+            cls_ids[pt_id] = is_seed[pt_id] ? 0 : -1;
+            continue;
+        }
+        int cls_id = root_cls[sets.find(near_core[pt_id])];
+        if (cls_id < 0) {
+            const int* small = small_neigbs.data() + size_t(i) * stride;
+            double best_d2 = DBL_MAX;
+            int best_q = -1;
+            for (int j = 0; j < count; ++j) {
+                const int q = small[j];
+                if (counts[q] <= min_neighbor || root_cls[sets.find(q)] < 0) {
+                    continue;
+                }
+                const double d2 = squareDistance(this->_vtx_array[pt_id], this->_vtx_array[q]);
+                if (d2 < best_d2 || (d2 == best_d2 && q < best_q)) {
+                    best_d2 = d2;
+                    best_q = q;
+                    cls_id = root_cls[sets.find(q)];
+                }
+            }
+        }
+        if (cls_id < 0) {
+            cls_ids[pt_id] = is_seed[pt_id] ? 0 : -1;
+        } else {
+            cls_ids[pt_id] = (count == min_neighbor) ? cls_id : 0;
+        }
+    }
+
+    /*the border points and outliers which are only reached from the seeds that are not targets. */
+    for (size_t i = 0, k = 0; i < seeds.size() && k < free_seeds.size(); ++i) {
+        const int pt_id = seeds[i];
+        if (pt_id != free_seeds[k]) {
+            continue;
+        }
+        const int cls_id = cls_ids[pt_id];
+        const std::vector<int>& neigbs = free_neigbs[k++];
+        for (size_t j = 0; cls_id > 0 && j < neigbs.size(); ++j) {
+            const int q = neigbs[j];
+            if (counts[q] == min_neighbor && cls_ids[q] <= 0) {
+                cls_ids[q] = cls_id;
+            } else if (counts[q] < min_neighbor && cls_ids[q] < 0) {
+                cls_ids[q] = 0;
+            }
+        }
+    }
+
+    this->_cls_count = next_cls_id;
+    this->_cls_ids.swap(cls_ids);
+}
@@ -0,0 +1,73 @@
+/*
+**********************************************************************
+*
+* This file is a part of library MPCDPS(Massive Point Cloud Data Processing System).
+* It is a free program and it is protected by the license GPL-v3.0, you may not use the
+* file except in compliance with the License.
+*
+* Copyright(c) 2013 - 2020 Xu Shengpan, all rights reserved.
+*
+* Email: jack_1227x@163.com
+*
+**********************************************************************
+*/
+
+/*
+Reference paper:
+A. Gunawan, A faster algorithm for DBSCAN, Master's thesis, Technische Universiteit Eindhoven, 2013.
+M. de Berg, A. Gunawan, M. Roeloffzen, Faster DB-scan and HDB-scan in low-dimensional Euclidean spaces, ISAAC 2017.
+*/
+
+#ifndef  MPCDPS_GRIDDBSCANCLUSTER_H
+#define MPCDPS_GRIDDBSCANCLUSTER_H
+
+#include <algorithm>
+#include "DBScanCluster.h"
+#include "Grid3D.h"
+
+namespace mpcdps {
+
+	/*
+	   DBSCAN on a uniform grid of cell size max_dist / sqrt(K), K = 2 or 3, with the same classes as DBScanCluster.
+	   Any two points of a cell are neighbors, so all of the points of a cell with more than min neighbor points
+	   are core points without distance tests, and the neighbors of the other points are counted in the cells
+	   within the max distance, stopping at min neighbor + 1. Two cells with core points are in the same class
+	   if a core point of one is a neighbor of a core point of the other, tested only for the neighboring cells,
+	   and the cells are merged by a concurrent union-find.
+
+	   The cells are keyed by Grid3D and the points are sorted by the keys, so each cell is a range of the points,
+	   and the neighbor cells in a row of the grid are a range of the cells, found by a sweep of the sorted keys.
+	   If a seed is not a target, or the targets span more than 2^20 cells on an axis, it runs DBScanCluster instead.
+	*/
+	template <typename T, int K>
+	class GridDBScanCluster : public DBScanCluster<T, K>
+	{
+	public:
+		GridDBScanCluster();
+		~GridDBScanCluster();
+
+		/*Run the cluster. */
+		virtual void run();
+
+	protected:
+		/*Rows of the cells that may have points within the max distance of cell (0, 0, 0), including itself.
+		  Row (rx, dy, dz) is the cells (dx, dy, dz), -rx <= dx <= rx, which are a range of the keys.
+		*/
+		static std::vector<Vector3<int> > neighborRows();
+
+		static double squareDistance(const T* p, const T* q)
+		{
+			double d = 0, d1;
+			for (int i = 0; i < K; ++i) {
+				d1 = p[i] - q[i];
+				d += d1 * d1;
+			}
+			return d;
+		}
+	};
+
+#include "GridDBScanCluster.inl"
+
+}
+
+#endif
@@ -0,0 +1,339 @@
+/*
+**********************************************************************
+*
+* This file is a part of library MPCDPS(Massive Point Cloud Data Processing System).
+* It is a free program and it is protected by the license GPL-v3.0, you may not use the
+* file except in compliance with the License.
+*
+* Copyright(c) 2013 - 2020 Xu Shengpan, all rights reserved.
+*
+* Email: jack_1227x@163.com
+*
+**********************************************************************
+*/
+
+template <typename T, int K>
+GridDBScanCluster<T, K>::GridDBScanCluster()
+{
+
+}
+
+template <typename T, int K>
+GridDBScanCluster<T, K>::~GridDBScanCluster()
+{
+
+}
+
+/*The cell side is max_dist / sqrt(K), so the gap between the cells of offset d is
+ * sqrt(sum(max(|d_i| - 1, 0)^2)) * side, and the cells with a gap of at least max_dist are left out.
+ */
+template <typename T, int K>
+std::vector<Vector3<int> > GridDBScanCluster<T, K>::neighborRows()
+{
+    const int r = 1 + int(sqrt(double(K)));
+    std::vector<Vector3<int> > rows;
+    for (int dz = (K == 3 ? -r : 0); dz <= (K == 3 ? r : 0); ++dz) {
+        for (int dy = -r; dy <= r; ++dy) {
+            int rx = -1;
+            for (int dx = 0; dx <= r; ++dx) {
+                const int d[3] = { dx, dy, dz };
+                int gap2 = 0;
+                for (int i = 0; i < 3; ++i) {
+                    const int g = MAXV((d[i] < 0 ? -d[i] : d[i]) - 1, 0);
+                    gap2 += g * g;
+                }
+                if (gap2 <= K) {
+                    rx = dx;
+                }
+            }
+            if (rx >= 0) {
+                rows.push_back(Vector3<int>(rx, dy, dz));
+            }
+        }
+    }
+    return rows;
+}
+
+template <typename T, int K>
+void GridDBScanCluster<T, K>::run()
+{
+    static_assert(K == 2 || K == 3, "GridDBScanCluster is for 2D and 3D points");
+
+    if (this->_target_points.empty()) {
+        this->_target_points = make_vector<int>(this->_vtx_array.size());
+    }
+
+    if (this->_seeds.empty()) {
+        this->_seeds = this->_target_points;
+    }
+
+    const int n = this->_vtx_array.size();
+    const int m = this->_target_points.size();
+    const int min_neighbor = this->_min_neighbor;
+    const std::vector<int>& seeds = this->_seeds;
+
+    std::vector<char> is_target(n, 0), is_seed(n, 0);
+    for (int i = 0; i < m; ++i) {
+        is_target[this->_target_points[i]] = 1;
+    }
+    bool free_seed = false;
+    for (size_t i = 0; i < seeds.size(); ++i) {
+        is_seed[seeds[i]] = 1;
+        free_seed = free_seed || !is_target[seeds[i]];
+    }
+
+    /*slightly smaller than max_dist / sqrt(K), so the rounding of the distances can not put
+     * two points of a cell out of max_dist.
+     */
+    const float side = float(this->_max_dist / sqrt(double(K)) * (1 - 1e-6));
+    double vmin[3] = { 0, 0, 0 }, vmax[3] = { 0, 0, 0 };
+    for (int d = 0; d < K && m > 0; ++d) {
+        vmin[d] = vmax[d] = this->_vtx_array[this->_target_points[0]][d];
+    }
+    for (int i = 1; i < m; ++i) {
+        const T* pt = this->_vtx_array[this->_target_points[i]];
+        for (int d = 0; d < K; ++d) {
+            vmin[d] = MINV(vmin[d], double(pt[d]));
+            vmax[d] = MAXV(vmax[d], double(pt[d]));
+        }
+    }
+    bool in_range = side > 0;
+    for (int d = 0; d < K && in_range; ++d) {
+        in_range = (vmax[d] - vmin[d]) / side + 8 < double(1 << 20);
+    }
+    if (free_seed || !in_range) {
+        DBScanCluster<T, K>::run();
+        return;
+    }
+
+    /*sort the targets by their cells, so each cell is a range of the sorted points. */
+    Grid3D<int> grid;
+    grid.setResolution(side);
+    grid.setOrigin(vmin[0], vmin[1], vmin[2]);
+    std::vector<int> order = this->_target_points;
+    std::vector<uint64> keys(m);
+#pragma omp parallel for
+    for (int i = 0; i < m; ++i) {
+        const T* pt = this->_vtx_array[order[i]];
+        keys[i] = grid.getIndexKey(pt[0], pt[1], K == 3 ? pt[K - 1] : 0);
+    }
+    sort_radix_syn(keys, order);
+
+    std::vector<int> cell_start;
+    for (int i = 0; i < m; ++i) {
+        if (i == 0 || keys[i] != keys[i - 1]) {
+            cell_start.push_back(i);
+        }
+    }
+    const int nc = cell_start.size();
+    cell_start.push_back(m);
+
+    std::vector<T> coords(size_t(m) * K);
+    std::vector<int> pos(n, -1);
+#pragma omp parallel for
+    for (int i = 0; i < m; ++i) {
+        const T* pt = this->_vtx_array[order[i]];
+        for (int d = 0; d < K; ++d) {
+            coords[size_t(i) * K + d] = pt[d];
+        }
+        pos[order[i]] = i;
+    }
+
+    /*the neighbor cells of each cell are ranges of the cells, one for each row that has cells, in CSR layout.
+     * The first and last keys of a row are the key of the cell plus fixed deltas, so the ranges of the rows
+     * move forward with the cells, and each block of cells sweeps the keys from a binary search.
+     */
+    std::vector<uint64> cell_keys(nc);
+    for (int c = 0; c < nc; ++c) {
+        cell_keys[c] = keys[cell_start[c]];
+    }
+    const std::vector<Vector3<int> > rows = neighborRows();
+    const int n_row = rows.size();
+    const uint64 key0 = grid.getIndexKey(Vector3<int>(0, 0, 0));
+    std::vector<uint64> row_lo(n_row), row_hi(n_row);
+    for (int j = 0; j < n_row; ++j) {
+        row_lo[j] = grid.getIndexKey(Vector3<int>(-rows[j][0], rows[j][1], rows[j][2])) - key0;
+        row_hi[j] = grid.getIndexKey(Vector3<int>(rows[j][0], rows[j][1], rows[j][2])) - key0;
+    }
+    const int block_size = 1024;
+    const int n_block = (nc + block_size - 1) / block_size;
+    std::vector<int> nb_start(nc + 1, 0), nb_ranges;
+    for (int pass = 0; pass < 2; ++pass) {
+        if (pass == 1) {
+            for (int c = 0; c < nc; ++c) {
+                nb_start[c + 1] += nb_start[c];
+            }
+            nb_ranges.resize(2 * size_t(nb_start[nc]));
+        }
+#pragma omp parallel
+        {
+            std::vector<int> first(n_row);
+#pragma omp for schedule(dynamic, 1)
+            for (int b = 0; b < n_block; ++b) {
+                const int end = MINV(nc, (b + 1) * block_size);
+                for (int j = 0; j < n_row; ++j) {
+                    first[j] = std::lower_bound(cell_keys.begin(), cell_keys.end(),
+                        cell_keys[b * block_size] + row_lo[j]) - cell_keys.begin();
+                }
+                for (int c = b * block_size; c < end; ++c) {
+                    int count = 0;
+                    for (int j = 0; j < n_row; ++j) {
+                        const uint64 lo = cell_keys[c] + row_lo[j], hi = cell_keys[c] + row_hi[j];
+                        int c1 = first[j];
+                        while (c1 < nc && cell_keys[c1] < lo) {
+                            ++c1;
+                        }
+                        first[j] = c1;
+                        int c2 = c1;
+                        while (c2 < nc && cell_keys[c2] <= hi) {
+                            ++c2;
+                        }
+                        if (c2 > c1) {
+                            if (pass == 1) {
+                                nb_ranges[2 * size_t(nb_start[c] + count)] = c1;
+                                nb_ranges[2 * size_t(nb_start[c] + count) + 1] = c2;
+                            }
+                            ++count;
+                        }
+                    }
+                    if (pass == 0) {
+                        nb_start[c + 1] = count;
+                    }
+                }
+            }
+        }
+    }
+
+    /*neighbor counts, including the point itself, are counted until they are more than the min neighbor.
+     * The points of a cell are neighbors of each other, so a cell of more points has only core points.
+     */
+    const double eps2 = double(this->_max_dist) * double(this->_max_dist);
+    std::vector<int> counts(m);
+#pragma omp parallel for schedule(dynamic, 64)
+    for (int c = 0; c < nc; ++c) {
+        const int size = cell_start[c + 1] - cell_start[c];
+        for (int i = cell_start[c]; i < cell_start[c + 1]; ++i) {
+            int count = size;
+            const T* p = &coords[size_t(i) * K];
+            for (int j = nb_start[c]; j < nb_start[c + 1] && count <= min_neighbor; ++j) {
+                const int end = cell_start[nb_ranges[2 * size_t(j) + 1]];
+                for (int q = cell_start[nb_ranges[2 * size_t(j)]]; q < end && count <= min_neighbor; ++q) {
+                    if ((q < cell_start[c] || q >= cell_start[c + 1]) && squareDistance(p, &coords[size_t(q) * K]) <= eps2) {
+                        ++count;
+                    }
+                }
+            }
+            counts[i] = count;
+        }
+    }
+
+    /*the core points of a cell are in a class, and two cells are merged if a core point of one is
+     * a neighbor of a core point of the other, each pair of cells is tested once.
+     */
+    std::vector<char> has_core(nc, 0);
+#pragma omp parallel for
+    for (int c = 0; c < nc; ++c) {
+        for (int i = cell_start[c]; i < cell_start[c + 1] && !has_core[c]; ++i) {
+            has_core[c] = counts[i] > min_neighbor;
+        }
+    }
+
+    ConcurrentUnionFind sets(nc);
+#pragma omp parallel for schedule(dynamic, 64)
+    for (int c = 0; c < nc; ++c) {
+        if (!has_core[c]) {
+            continue;
+        }
+        for (int j = nb_start[c]; j < nb_start[c + 1]; ++j) {
+            const int end = MINV(nb_ranges[2 * size_t(j) + 1], c);
+            for (int c2 = nb_ranges[2 * size_t(j)]; c2 < end; ++c2) {
+                if (!has_core[c2] || sets.same(c, c2)) {
+                    continue;
+                }
+                bool linked = false;
+                for (int i = cell_start[c]; i < cell_start[c + 1] && !linked; ++i) {
+                    if (counts[i] <= min_neighbor) {
+                        continue;
+                    }
+                    const T* p = &coords[size_t(i) * K];
+                    for (int q = cell_start[c2]; q < cell_start[c2 + 1] && !linked; ++q) {
+                        linked = counts[q] > min_neighbor && squareDistance(p, &coords[size_t(q) * K]) <= eps2;
+                    }
+                }
+                if (linked) {
+                    sets.unite(c, c2);
+                }
+            }
+        }
+    }
+    sets.flatten();
+
+    /*number the classes in the order of the seeds. */
+    std::vector<int> cell_of(m);
+    for (int c = 0; c < nc; ++c) {
+        std::fill(cell_of.begin() + cell_start[c], cell_of.begin() + cell_start[c + 1], c);
+    }
+    std::vector<int> root_cls(nc, -1);
+    int next_cls_id = 1;  //0 is for outliers
+    for (size_t i = 0; i < seeds.size(); ++i) {
+        const int p = pos[seeds[i]];
+        if (counts[p] <= min_neighbor) {
+            continue;
+        }
+        const int root = sets.find(cell_of[p]);
+        if (root_cls[root] < 0) {
+            root_cls[root] = next_cls_id++;
+        }
+    }
+
+    /*core points take the classes of their cells. A border point takes the class of its nearest core
+     * point in a class, ties to the smaller id, and an outlier is 0 if it is a seed or a neighbor of such a point.
+     */
+    std::vector<int> cls_ids(n, -1);
+#pragma omp parallel for schedule(dynamic, 64)
+    for (int c = 0; c < nc; ++c) {
+        const int cell_cls = root_cls[sets.find(c)];
+        for (int i = cell_start[c]; i < cell_start[c + 1]; ++i) {
+            const int pt_id = order[i];
+            const int count = counts[i];
+            if (count > min_neighbor) {
+                cls_ids[pt_id] = cell_cls;
+                continue;
+            }
+            if (is_seed[pt_id] && count < min_neighbor) {
+                cls_ids[pt_id] = 0;
+                continue;
+            }
+            const T* p = &coords[size_t(i) * K];
+            double best_d2 = DBL_MAX;
+            int best_id = -1, cls_id = -1;
+            for (int j = nb_start[c]; j < nb_start[c + 1]; ++j) {
+                for (int c2 = nb_ranges[2 * size_t(j)]; c2 < nb_ranges[2 * size_t(j) + 1]; ++c2) {
+                    const int cls2 = root_cls[sets.find(c2)];
+                    if (!has_core[c2] || cls2 < 0) {
+                        continue;
+                    }
+                    for (int q = cell_start[c2]; q < cell_start[c2 + 1]; ++q) {
+                        if (counts[q] <= min_neighbor) {
+                            continue;
+                        }
+                        const double d2 = squareDistance(p, &coords[size_t(q) * K]);
+                        if (d2 <= eps2 && (d2 < best_d2 || (d2 == best_d2 && order[q] < best_id))) {
+                            best_d2 = d2;
+                            best_id = order[q];
+                            cls_id = cls2;
+                        }
+                    }
+                }
+            }
+            if (cls_id < 0) {
+                cls_ids[pt_id] = is_seed[pt_id] ? 0 : -1;
+            } else {
+                cls_ids[pt_id] = (count == min_neighbor) ? cls_id : 0;
+            }
+        }
+    }
+
+    this->_cls_count = next_cls_id;
+    this->_cls_ids.swap(cls_ids);
+}
@@ -0,0 +1,112 @@
+/*
+**********************************************************************
+*
+* This file is a part of library MPCDPS(Massive Point Cloud Data Processing System).
+* It is a free program and it is protected by the license GPL-v3.0, you may not use the
+* file except in compliance with the License.
+*
+* Copyright(c) 2013 - 2020 Xu Shengpan, all rights reserved.
+*
+* Email: jack_1227x@163.com
+*
+**********************************************************************
+*/
+
+/*
+Reference paper:
+M. Ankerst, M. M. Breunig, H.-P. Kriegel, J. Sander, OPTICS: ordering points to identify the clustering structure, SIGMOD 1999.
+R. J. G. B. Campello, D. Moulavi, J. Sander, Density-based clustering based on hierarchical density estimates, PAKDD 2013.
+*/
+
+#ifndef  MPCDPS_OPTICSCLUSTER_H
+#define MPCDPS_OPTICSCLUSTER_H
+
+#include <queue>
+#include <algorithm>
+#include <functional>
+#include "DBScanCluster.h"
+
+namespace mpcdps {
+
+	/*
+	   OPTICS ordering of the targets for the max distance and the min neighbor, from which the DBSCAN classes of
+	   any distance up to the max distance are extracted in linear time, without searching the neighbors again.
+
+	   The core distance of a point is the distance within which it is a core point, i.e. to its (min neighbor + 1)th
+	   nearest point including itself. The points are ordered by the expansion from the core points, and the
+	   reachability distance of a point is max(core distance, distance) from the core point that reached it first
+	   in the order. The core distances are computed in parallel, and only the core points are searched again
+	   for the ordering.
+
+	   The classes of extractDBSCAN are those of DBScanCluster with the same distance, except that a border point
+	   takes the class of the core neighbor of the smallest reachability distance to it, instead of the nearest one.
+	   The seeds which are not targets are searched too, as in DBScanCluster, and their neighbors within the max distance
+	   are kept. A core seed which is not a target starts a class, which takes the classes of its core neighbors that have
+	   no class yet, and its border neighbors without class take its class. If the seeds are not all of the targets,
+	   a border point or an outlier next to a class of a seed is -1, or 0 for a seed, if that core neighbor is in a class
+	   without a seed.
+	*/
+	template <typename T, int K>
+	class OPTICSCluster : public DBScanCluster<T, K>
+	{
+	public:
+		/*An edge of the condensed tree, the clusters are n, n + 1, ..., n is the root, n = count of the points.
+		  child < n: the point child falls out of the cluster parent at lambda;
+		  otherwise the cluster child of child_size points splits from parent at lambda.
+		  lambda = 1 / distance, the parents are before their children.
+		*/
+		struct CondensedEdge
+		{
+			int parent;
+			int child;
+			double lambda;
+			int child_size;
+		};
+
+		OPTICSCluster();
+		~OPTICSCluster();
+
+		/*Compute the ordering, and extract the classes of the max distance. */
+		virtual void run();
+
+		/*Extract the classes of distance eps from the ordering, eps is limited to the max distance of run(). */
+		void extractDBSCAN(float eps);
+
+		/*Target points in the OPTICS order. */
+		const std::vector<int>& getOrder() const { return _order; }
+
+		/*Reachability and core distances of the points, DBL_MAX if undefined or more than the max distance. */
+		std::vector<double> getReachDistances() const { return sqrtDistances(_reach2); }
+		std::vector<double> getCoreDistances() const { return sqrtDistances(_core2); }
+
+		/*
+		  Condensed tree of the hierarchy of the classes of all distances up to the max distance, as in HDBSCAN,
+		  where a cluster of less than min_cluster_size points is points falling out of its parent.
+		  The points of the classes of a distance eps are the core targets of extractDBSCAN(eps).
+		*/
+		void getCondensedTree(int min_cluster_size, std::vector<CondensedEdge>& tree) const;
+
+		virtual void clear();
+
+	protected:
+		static std::vector<double> sqrtDistances(const std::vector<double>& dist2s);
+
+	protected:
+		/*squared distances of the points. border distance: to the (min neighbor)th nearest point. */
+		std::vector<double> _core2;
+		std::vector<double> _border2;
+		std::vector<double> _reach2;
+		std::vector<double> _link2;  /*smallest reachability distance from any core point. */
+		std::vector<int> _pred;   /*core point that reached the point, -1 for none. */
+		std::vector<int> _link;   /*core point of the link, -1 for none. */
+		std::vector<int> _order;
+		std::vector<int> _free_seeds;  /*seeds which are not targets, in the order of the seeds. */
+		std::vector<std::vector<std::pair<double, int> > > _free_neigbs;  /*squared distances and neighbors of the core free seeds. */
+		float _order_dist;        /*max distance of the ordering. */
+	};
+
+#include "OPTICSCluster.inl"
+
+}
+
+#endif
@@ -0,0 +1,394 @@
+/*
+**********************************************************************
+*
+* This file is a part of library MPCDPS(Massive Point Cloud Data Processing System).
+* It is a free program and it is protected by the license GPL-v3.0, you may not use the
+* file except in compliance with the License.
+*
+* Copyright(c) 2013 - 2020 Xu Shengpan, all rights reserved.
+*
+* Email: jack_1227x@163.com
+*
+**********************************************************************
+*/
+
+template <typename T, int K>
+OPTICSCluster<T, K>::OPTICSCluster() :_order_dist(0)
+{
+
+}
+
+template <typename T, int K>
+OPTICSCluster<T, K>::~OPTICSCluster()
+{
+
+}
+
+template <typename T, int K>
+void OPTICSCluster<T, K>::run()
+{
+    if (this->_target_points.empty()) {
+        this->_target_points = make_vector<int>(this->_vtx_array.size());
+    }
+
+    if (this->_seeds.empty()) {
+        this->_seeds = this->_target_points;
+    }
+
+    KDTree<T, K> kdtree;
+    double nodesize = MAXV(double(this->_max_dist), 1e-6);
+    std::vector<T> ns(K, 0);
+    for (int i = 0; i < K; ++i) {
+        ns[i] = nodesize;
+    }
+
+    kdtree.setElements(this->_vtx_array);
+    kdtree.build(this->_target_points, this->_vmin, this->_vmax, &ns[0]);
+
+    const int n = this->_vtx_array.size();
+    const int min_neighbor = this->_min_neighbor;
+
+    /*the targets and the seeds that are not targets, which are searched but can not be found by others. */
+    std::vector<char> is_target(n, 0), is_free(n, 0);
+    std::vector<int> query_pts = this->_target_points;
+    for (size_t i = 0; i < query_pts.size(); ++i) {
+        is_target[query_pts[i]] = 1;
+    }
+    this->sortMorton(query_pts);
+    const int m = query_pts.size();
+    _free_seeds.clear();
+    for (size_t i = 0; i < this->_seeds.size(); ++i) {
+        const int pt_id = this->_seeds[i];
+        if (!is_target[pt_id] && !is_free[pt_id]) {
+            is_free[pt_id] = 1;
+            _free_seeds.push_back(pt_id);
+            query_pts.push_back(pt_id);
+        }
+    }
+    const int query_count = query_pts.size();
+    _free_neigbs.assign(_free_seeds.size(), std::vector<std::pair<double, int> >());
+
+    /*core and border distances, the (min neighbor + 1)th and (min neighbor)th smallest distances
+     * of the neighbors including the point itself. The neighbors of the core free seeds are kept.
+     */
+    _core2.assign(n, DBL_MAX);
+    _border2.assign(n, DBL_MAX);
+#pragma omp parallel
+    {
+        std::vector<int> neigbs;
+        std::vector<double> dist2s;
+#pragma omp for schedule(dynamic, 256)
+        for (int i = 0; i < query_count; ++i) {
+            const int pt_id = query_pts[i];
+            neigbs = kdtree.searchRadius(this->_vtx_array[pt_id], this->_max_dist, dist2s);
+            const int count = dist2s.size();
+            if (i >= m && count > min_neighbor) {
+                std::vector<std::pair<double, int> >& free_neigbs = _free_neigbs[i - m];
+                free_neigbs.resize(count);
+                for (int j = 0; j < count; ++j) {
+                    free_neigbs[j] = std::make_pair(dist2s[j], neigbs[j]);
+                }
+            }
+            if (min_neighbor <= 0) {
+                _border2[pt_id] = 0;
+            } else if (count >= min_neighbor) {
+                std::nth_element(dist2s.begin(), dist2s.begin() + min_neighbor - 1, dist2s.begin() + count);
+                _border2[pt_id] = dist2s[min_neighbor - 1];
+            }
+            if (count > min_neighbor) {
+                _core2[pt_id] = *std::min_element(dist2s.begin() + MAXV(min_neighbor, 0), dist2s.end());
+            }
+        }
+    }
+
+    /*expand from each target not ordered yet, the nearest reachable point is the next, ties to the smaller id.
+     * The heap may keep old entries of a point, which are skipped. The links are the smallest reachability
+     * distances from all of the core neighbors, not only those before the point in the order.
+     */
+    typedef std::pair<double, int> HeapItem;
+    std::priority_queue<HeapItem, std::vector<HeapItem>, std::greater<HeapItem> > heap;
+    std::vector<char> ordered(n, 0);
+    std::vector<int> neigbs;
+    std::vector<double> dist2s;
+    _reach2.assign(n, DBL_MAX);
+    _link2.assign(n, DBL_MAX);
+    _pred.assign(n, -1);
+    _link.assign(n, -1);
+    _order.clear();
+    _order.reserve(m);
+    for (int i = 0; i < m; ++i) {
+        const int start = this->_target_points[i];
+        if (ordered[start]) {
+            continue;
+        }
+        heap.push(HeapItem(DBL_MAX, start));
+        while (!heap.empty()) {
+            const HeapItem item = heap.top();
+            heap.pop();
+            const int pt_id = item.second;
+            if (ordered[pt_id] || item.first != _reach2[pt_id]) {
+                continue;
+            }
+            ordered[pt_id] = 1;
+            _order.push_back(pt_id);
+            if (_core2[pt_id] == DBL_MAX) {
+                continue;
+            }
+            neigbs = kdtree.searchRadius(this->_vtx_array[pt_id], this->_max_dist, dist2s);
+            for (size_t j = 0; j < neigbs.size(); ++j) {
+                const int q = neigbs[j];
+                const double reach2 = MAXV(_core2[pt_id], dist2s[j]);
+                if (reach2 < _link2[q] || (reach2 == _link2[q] && pt_id < _link[q])) {
+                    _link2[q] = reach2;
+                    _link[q] = pt_id;
+                }
+                if (!ordered[q] && reach2 < _reach2[q]) {
+                    _reach2[q] = reach2;
+                    _pred[q] = pt_id;
+                    heap.push(HeapItem(reach2, q));
+                }
+            }
+        }
+    }
+    _order_dist = this->_max_dist;
+
+    extractDBSCAN(_order_dist);
+}
+
+/*A run of the order that starts at a core point and continues by the reachability distances within eps
+ * is a class of core points: the core point that reached a point is before it in the order, and the points
+ * between them are reachable within eps too. Then the classes are renumbered in the order of the seeds.
+ * A border point may be before its core neighbors in the order, so it takes the class of its link.
+ */
+template <typename T, int K>
+void OPTICSCluster<T, K>::extractDBSCAN(float eps)
+{
+    const int n = this->_vtx_array.size();
+    if (int(_core2.size()) != n) {
+        return;
+    }
+    const double eps2 = double(MINV(eps, _order_dist)) * double(MINV(eps, _order_dist));
+
+    std::vector<int> runs(n, -1);
+    int run_count = 0, cur = -1;
+    for (size_t i = 0; i < _order.size(); ++i) {
+        const int pt_id = _order[i];
+        if (_reach2[pt_id] > eps2) {
+            cur = (_core2[pt_id] <= eps2) ? run_count++ : -1;
+        }
+        runs[pt_id] = cur;
+    }
+
+    /*a core seed that is not a target starts a class, which takes the runs of its core neighbors that have no class yet. */
+    const int free_count = _free_seeds.size();
+    std::vector<char> is_seed(n, 0);
+    std::vector<int> free_index(n, -1), free_cls(free_count, -1);
+    for (int k = 0; k < free_count; ++k) {
+        free_index[_free_seeds[k]] = k;
+    }
+    std::vector<int> run_cls(run_count, -1);
+    int next_cls_id = 1;  //0 is for outliers
+    for (size_t i = 0; i < this->_seeds.size(); ++i) {
+        const int pt_id = this->_seeds[i];
+        is_seed[pt_id] = 1;
+        if (_core2[pt_id] > eps2) {
+            continue;
+        }
+        const int k = free_index[pt_id];
+        if (k < 0) {
+            if (run_cls[runs[pt_id]] < 0) {
+                run_cls[runs[pt_id]] = next_cls_id++;
+            }
+            continue;
+        }
+        if (free_cls[k] >= 0) {
+            continue;
+        }
+        free_cls[k] = next_cls_id++;
+        const std::vector<std::pair<double, int> >& neigbs = _free_neigbs[k];
+        for (size_t j = 0; j < neigbs.size(); ++j) {
+            const int q = neigbs[j].second;
+            if (neigbs[j].first <= eps2 && _core2[q] <= eps2 && run_cls[runs[q]] < 0) {
+                run_cls[runs[q]] = free_cls[k];
+            }
+        }
+    }
+
+    /*a point that is not a core point is a border point if its border distance is within eps,
+     * and it is next to a class if its link is within eps.
+     */
+    std::vector<int> cls_ids(n, -1);
+    for (size_t i = 0; i < _order.size(); ++i) {
+        const int pt_id = _order[i];
+        if (_core2[pt_id] <= eps2) {
+            cls_ids[pt_id] = run_cls[runs[pt_id]];
+            continue;
+        }
+        const int cls_id = (_link2[pt_id] <= eps2) ? run_cls[runs[_link[pt_id]]] : -1;
+        if (is_seed[pt_id] && _border2[pt_id] > eps2) {
+            cls_ids[pt_id] = 0;
+        } else if (cls_id < 0) {
+            cls_ids[pt_id] = is_seed[pt_id] ? 0 : -1;
+        } else {
+            cls_ids[pt_id] = (_border2[pt_id] <= eps2) ? cls_id : 0;
+        }
+    }
+
+    /*the seeds that are not targets, and the border points and outliers which are only reached from them. */
+    for (int k = 0; k < free_count; ++k) {
+        const int cls_id = free_cls[k];
+        cls_ids[_free_seeds[k]] = MAXV(cls_id, 0);
+        const std::vector<std::pair<double, int> >& neigbs = _free_neigbs[k];
+        for (size_t j = 0; cls_id > 0 && j < neigbs.size(); ++j) {
+            const int q = neigbs[j].second;
+            if (neigbs[j].first > eps2 || _core2[q] <= eps2) {
+                continue;
+            }
+            if (_border2[q] <= eps2 && cls_ids[q] <= 0) {
+                cls_ids[q] = cls_id;
+            } else if (_border2[q] > eps2 && cls_ids[q] < 0) {
+                cls_ids[q] = 0;
+            }
+        }
+    }
+
+    this->_cls_count = next_cls_id;
+    this->_cls_ids.swap(cls_ids);
+}
+
+/*The core point that reached a point and the point are joined at max(reachability distance, core distance),
+ * which is their mutual reachability distance. These edges join the core points of each class of a distance,
+ * as the core points of a run are reached from the core points of the run, so their single linkage hierarchy
+ * is that of the classes of all distances, which is condensed top down.
+ */
+template <typename T, int K>
+void OPTICSCluster<T, K>::getCondensedTree(int min_cluster_size, std::vector<CondensedEdge>& tree) const
+{
+    tree.clear();
+    const int n = this->_vtx_array.size();
+    const int m = _order.size();
+    if (m == 0) {
+        return;
+    }
+    min_cluster_size = MAXV(min_cluster_size, 2);
+
+    std::vector<int> pos(n, -1);
+    for (int i = 0; i < m; ++i) {
+        pos[_order[i]] = i;
+    }
+    std::vector<std::pair<double, int> > edges;
+    for (int i = 0; i < m; ++i) {
+        const int pt_id = _order[i];
+        if (_pred[pt_id] >= 0 && _core2[pt_id] != DBL_MAX) {
+            edges.push_back(std::make_pair(MAXV(_reach2[pt_id], _core2[pt_id]), i));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+
+    /*the leaves 0 ... m-1 are the points in the order, and the nodes after them are the merges. */
+    const int node_count = 2 * m - 1;
+    std::vector<int> left(node_count, -1), right(node_count, -1), sizes(node_count, 1);
+    std::vector<double> dist2s(node_count, 0);
+    std::vector<int> parents = make_vector<int>(m), comp_node = make_vector<int>(m);
+    int next_node = m;
+    auto find_root = [&parents](int x) {
+        while (parents[x] != x) {
+            parents[x] = parents[parents[x]];
+            x = parents[x];
+        }
+        return x;
+    };
+    auto merge = [&](int a, int b, double dist2) {
+        a = find_root(a);
+        b = find_root(b);
+        const int node = next_node++;
+        left[node] = comp_node[a];
+        right[node] = comp_node[b];
+        sizes[node] = sizes[left[node]] + sizes[right[node]];
+        dist2s[node] = dist2;
+        parents[b] = a;
+        comp_node[a] = node;
+    };
+    for (size_t i = 0; i < edges.size(); ++i) {
+        const int j = edges[i].second;
+        merge(pos[_pred[_order[j]]], j, edges[i].first);
+    }
+    /*the components which are not joined within the max distance are joined at infinity. */
+    for (int i = 1; i < m; ++i) {
+        if (find_root(i) != find_root(0)) {
+            merge(0, i, DBL_MAX);
+        }
+    }
+
+    std::vector<int> relabel(node_count, -1), nodes(1, node_count - 1), stk;
+    relabel[node_count - 1] = n;
+    int next_cluster = n + 1;
+    auto fall_out = [&](int node, int parent, double lambda) {
+        stk.assign(1, node);
+        while (!stk.empty()) {
+            const int sub = stk.back();
+            stk.pop_back();
+            if (sub < m) {
+                CondensedEdge e = { parent, _order[sub], lambda, 1 };
+                tree.push_back(e);
+            } else {
+                stk.push_back(right[sub]);
+                stk.push_back(left[sub]);
+            }
+        }
+    };
+    if (m == 1) {
+        fall_out(0, n, 0);
+        return;
+    }
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        const int node = nodes[i];
+        const int l = left[node], r = right[node];
+        const double d2 = dist2s[node];
+        const double lambda = (d2 == DBL_MAX) ? 0 : (d2 > 0 ? 1.0 / sqrt(d2) : DBL_MAX);
+        const bool big_l = sizes[l] >= min_cluster_size, big_r = sizes[r] >= min_cluster_size;
+        if (big_l && big_r) {
+            const int children[2] = { l, r };
+            for (int k = 0; k < 2; ++k) {
+                relabel[children[k]] = next_cluster++;
+                CondensedEdge e = { relabel[node], relabel[children[k]], lambda, sizes[children[k]] };
+                tree.push_back(e);
+                nodes.push_back(children[k]);
+            }
+        } else if (big_l || big_r) {
+            const int big = big_l ? l : r;
+            relabel[big] = relabel[node];
+            fall_out(big_l ? r : l, relabel[node], lambda);
+            nodes.push_back(big);
+        } else {
+            fall_out(l, relabel[node], lambda);
+            fall_out(r, relabel[node], lambda);
+        }
+    }
+}
+
+template <typename T, int K>
+void OPTICSCluster<T, K>::clear()
+{
+    PointCloudCluster<T, K>::clear();
+    _core2.clear();
+    _border2.clear();
+    _reach2.clear();
+    _link2.clear();
+    _pred.clear();
+    _link.clear();
+    _order.clear();
+    _free_seeds.clear();
+    _free_neigbs.clear();
+    _order_dist = 0;
+}
+
+template <typename T, int K>
+std::vector<double> OPTICSCluster<T, K>::sqrtDistances(const std::vector<double>& dist2s)
+{
+    std::vector<double> dists(dist2s.size());
+    for (size_t i = 0; i < dist2s.size(); ++i) {
+        dists[i] = (dist2s[i] == DBL_MAX) ? DBL_MAX : sqrt(dist2s[i]);
+    }
+    return dists;
+}
@@ -29,6 +29,8 @@ Copyright Xu Shengpan, all rights reserved.
 
 #include <vector>
 #include "SmartArray2D.h"
+#include "PublicFunc.h"
+#include "Morton.h"
 
 namespace mpcdps {
 
@@ -75,6 +77,10 @@ namespace mpcdps {
 
 		std::vector<int> getClassVector() const { return _cls_ids; }
 
+	protected:
+		/*Sort the points in Morton order, so that the neighboring searches of a thread visit the same leaves. */
+		void sortMorton(std::vector<int>& ptids) const;
+
 	protected:
 		VertexArrayType _vtx_array;  /*Vertex array. */
 		std::vector<int> _target_points;   /*Target points for clustering. */
@@ -58,4 +58,28 @@ template<typename T, int K>
 void PointCloudCluster<T, K>::setTargetPoints(const std::vector<int>& points)
 {
 	_target_points = points;
-}
\ No newline at end of file
+}
+
+/*Morton codes of the points on a 2^21 grid of the range, of the first 3 dimensions. */
+template<typename T, int K>
+void PointCloudCluster<T, K>::sortMorton(std::vector<int>& ptids) const
+{
+	const int dims = MINV(K, 3);
+	double scale[3];
+	for (int d = 0; d < dims; ++d) {
+		scale[d] = 2097151.0 / MAXV(double(_vmax[d]) - _vmin[d], 1e-12);
+	}
+	const int n = ptids.size();
+	std::vector<uint64> codes(n);
+#pragma omp parallel for
+	for (int i = 0; i < n; ++i) {
+		const T* pt = _vtx_array[ptids[i]];
+		uint c[3] = { 0, 0, 0 };
+		for (int d = 0; d < dims; ++d) {
+			double v = (double(pt[d]) - _vmin[d]) * scale[d];
+			c[d] = uint(MINV(MAXV(v, 0.0), 2097151.0));
+		}
+		codes[i] = morton_encode3(c[0], c[1], c[2]);
+	}
+	sort_radix_syn(codes, ptids);
+}
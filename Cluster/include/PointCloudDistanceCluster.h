@@ -20,6 +20,7 @@
 #include "PointCloudCluster.h"
 #include "KDTree.h"
 #include "SmartArray.h"
+#include "ConcurrentUnionFind.h"
 
 namespace mpcdps {
 
@@ -42,11 +43,24 @@ namespace mpcdps {
         void setMaxDistance(T d) { _max_dist = d; }
         T getMaxDistance() const { return _max_dist; }
 
+        /*In the parallel mode, the neighborhoods of all of the target points, in Morton order, and of the seeds
+         * which are not targets are searched by threads, and the neighbors are merged by a concurrent union-find. The classes are the same as the sequential
+         * run, which grows a class from each seed, but all of the targets are searched even if few of them are
+         * reachable from the seeds. default: false.
+         */
+        void setParallel(bool parallel) { _parallel = parallel; }
+        bool isParallel() const { return _parallel; }
+
         /*Run the cluster. */
         virtual void run();
 
+    protected:
+        void runSequential(const KDTree<T, K>& kdtree);
+        void runParallel(const KDTree<T, K>& kdtree);
+
     protected:
         T _max_dist;
+        bool _parallel;
     };
 
 #include "PointCloudDistanceCluster.inl"
@@ -13,7 +13,7 @@
 */
 
 template<typename T, int K>
-PointCloudDistanceCluster<T, K>::PointCloudDistanceCluster()
+PointCloudDistanceCluster<T, K>::PointCloudDistanceCluster(): _parallel(false)
 {
 }
 
@@ -25,12 +25,12 @@ PointCloudDistanceCluster<T, K>::~PointCloudDistanceCluster()
 template<typename T, int K>
 void PointCloudDistanceCluster<T, K>::run()
 {
-	if (_target_points.empty()) {
-		_target_points = make_vector<int>(_vtx_array.size());
+	if (this->_target_points.empty()) {
+		this->_target_points = make_vector<int>(this->_vtx_array.size());
 	}
 
-	if (_seeds.empty())
-		_seeds = _target_points;
+	if (this->_seeds.empty())
+		this->_seeds = this->_target_points;
 
 	KDTree<T, K> kdtree;
 	double nodesize = 2.0;
@@ -39,22 +39,32 @@ void PointCloudDistanceCluster<T, K>::run()
 		ns[i] = nodesize;
 	}
 
-	kdtree.setElements(_vtx_array);
-	kdtree.build(_target_points, _vmin, _vmax, &ns[0]);
+	kdtree.setElements(this->_vtx_array);
+	kdtree.build(this->_target_points, this->_vmin, this->_vmax, &ns[0]);
 
+	if (_parallel) {
+		runParallel(kdtree);
+	} else {
+		runSequential(kdtree);
+	}
+}
+
+template<typename T, int K>
+void PointCloudDistanceCluster<T, K>::runSequential(const KDTree<T, K>& kdtree)
+{
 	std::stack<int> stk;
-	SmartArray<bool> tag(_vtx_array.size());
+	SmartArray<bool> tag(this->_vtx_array.size());
 	tag.reset(false);
 	int pt_id;
 
 	std::vector<double> dist2s;
 	std::vector<int> neigbs;
 
-	std::vector<int> cls_ids(_vtx_array.size(), -1);
+	std::vector<int> cls_ids(this->_vtx_array.size(), -1);
 	int next_cls_id = 0;
 
-	for (size_t i = 0; i < _seeds.size(); ++i) {
-		pt_id = _seeds[i];
+	for (size_t i = 0; i < this->_seeds.size(); ++i) {
+		pt_id = this->_seeds[i];
 
 		if (tag[pt_id]) {
 			continue;
@@ -69,7 +79,7 @@ void PointCloudDistanceCluster<T, K>::run()
             pt_id = stk.top();
             stk.pop();
 			dist2s.clear();
-			neigbs = kdtree.searchRadius(_vtx_array[pt_id], _max_dist, dist2s);
+			neigbs = kdtree.searchRadius(this->_vtx_array[pt_id], _max_dist, dist2s);
 
 			for (size_t j = 0; j < neigbs.size(); ++j) {
 				pt_id = neigbs[j];
@@ -82,6 +92,100 @@ void PointCloudDistanceCluster<T, K>::run()
 		}
 	}
 
-	_cls_count = next_cls_id;
-	_cls_ids = cls_ids;
-}
\ No newline at end of file
+	this->_cls_count = next_cls_id;
+	this->_cls_ids = cls_ids;
+}
+
+/*The targets within the max distance are connected, so a class of the sequential run from a target seed is
+ * the connected component of the seed. A seed that is not a target can not be reached from other seeds,
+ * it starts a new class which takes the components of its neighbors that have no class yet.
+ * The components are merged from the neighborhoods of the targets in parallel, then the classes are numbered
+ * in the order of the seeds, so the class ids are the same as the sequential run.
+ */
+template<typename T, int K>
+void PointCloudDistanceCluster<T, K>::runParallel(const KDTree<T, K>& kdtree)
+{
+	const int n = this->_vtx_array.size();
+	const std::vector<int>& targets = this->_target_points;
+	const std::vector<int>& seeds = this->_seeds;
+	std::vector<char> searched(n, 0);
+	for (size_t i = 0; i < targets.size(); ++i) {
+		searched[targets[i]] = 1;
+	}
+
+	/*the targets are searched in Morton order, so that the searches of a thread visit the same leaves. */
+	std::vector<int> query_pts = targets;
+	this->sortMorton(query_pts);
+	ConcurrentUnionFind sets(n);
+	const int m = query_pts.size();
+#pragma omp parallel
+	{
+		std::vector<double> dist2s;
+		std::vector<int> neigbs;
+#pragma omp for schedule(dynamic, 256)
+		for (int i = 0; i < m; ++i) {
+			const int pt_id = query_pts[i];
+			neigbs = kdtree.searchRadius(this->_vtx_array[pt_id], _max_dist, dist2s);
+			for (size_t j = 0; j < neigbs.size(); ++j) {
+				if (neigbs[j] < pt_id) {
+					sets.unite(pt_id, neigbs[j]);
+				}
+			}
+		}
+	}
+	sets.flatten();
+
+	/*components of the neighbors of the seeds which are not targets. */
+	const int seed_count = seeds.size();
+	std::vector<int> free_seeds;
+	for (int i = 0; i < seed_count; ++i) {
+		if (!searched[seeds[i]]) {
+			searched[seeds[i]] = 1;
+			free_seeds.push_back(seeds[i]);
+		}
+	}
+	const int free_count = free_seeds.size();
+	std::vector<std::vector<int> > free_neigbs(free_count);
+#pragma omp parallel
+	{
+		std::vector<double> dist2s;
+#pragma omp for schedule(dynamic, 64)
+		for (int i = 0; i < free_count; ++i) {
+			std::vector<int>& roots = free_neigbs[i];
+			roots = kdtree.searchRadius(this->_vtx_array[free_seeds[i]], _max_dist, dist2s);
+			for (size_t j = 0; j < roots.size(); ++j) {
+				roots[j] = sets.find(roots[j]);
+			}
+		}
+	}
+
+	std::vector<int> root_cls(n, -1);
+	int next_cls_id = 0;
+	for (int i = 0, k = 0; i < seed_count; ++i) {
+		const int pt_id = seeds[i];
+		const int root = sets.find(pt_id);
+		if (root_cls[root] >= 0) {
+			continue;
+		}
+		const int cls_id = next_cls_id++;
+		root_cls[root] = cls_id;
+		if (k == free_count || free_seeds[k] != pt_id) {
+			continue;
+		}
+		const std::vector<int>& roots = free_neigbs[k++];
+		for (size_t j = 0; j < roots.size(); ++j) {
+			if (root_cls[roots[j]] < 0) {
+				root_cls[roots[j]] = cls_id;
+			}
+		}
+	}
+
+	std::vector<int> cls_ids(n);
+#pragma omp parallel for
+	for (int i = 0; i < n; ++i) {
+		cls_ids[i] = root_cls[sets.find(i)];
+	}
+
+	this->_cls_count = next_cls_id;
+	this->_cls_ids.swap(cls_ids);
+}
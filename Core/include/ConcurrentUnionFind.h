@@ -0,0 +1,122 @@
+/*
+**********************************************************************
+*
+* This file is a part of library MPCDPS(Massive Point Cloud Data Processing System).
+* It is a free program and it is protected by the license GPL-v3.0, you may not use the
+* file except in compliance with the License.
+*
+* Copyright(c) 2013 - 2020 Xu Shengpan, all rights reserved.
+*
+* Email: jack_1227x@163.com
+*
+**********************************************************************
+*/
+
+#ifndef  MPCDPS_CONCURRENTUNIONFIND_H
+#define  MPCDPS_CONCURRENTUNIONFIND_H
+
+#include <atomic>
+#include <vector>
+
+namespace mpcdps {
+
+    /*Union-find of the elements 0 ... n-1, find() and unite() are lock-free and can be called from many threads.
+     * A root is linked under the smaller root by a compare-and-swap, which is retried if another thread has
+     * linked the root first, and find() halves the paths. As the smaller element is always the root,
+     * the sets and their roots do not depend on the order of the unions.
+     */
+    class ConcurrentUnionFind
+    {
+    public:
+        ConcurrentUnionFind()
+        {
+        }
+
+        explicit ConcurrentUnionFind(int n)
+        {
+            reset(n);
+        }
+
+        /*Make n singleton sets, not thread-safe. */
+        void reset(int n)
+        {
+            std::vector<std::atomic<int> >(n).swap(_parent);
+#pragma omp parallel for
+            for (int i = 0; i < n; ++i) {
+                _parent[i].store(i, std::memory_order_relaxed);
+            }
+        }
+
+        int size() const { return _parent.size(); }
+
+        /*Root of the set of x, the smallest element of the set once all of the unions are done. */
+        int find(int x)
+        {
+            int p = _parent[x].load(std::memory_order_relaxed);
+            while (p != x) {
+                int gp = _parent[p].load(std::memory_order_relaxed);
+                if (gp != p) {
+                    /*path halving, skip it if another thread has changed the parent. */
+                    _parent[x].compare_exchange_weak(p, gp, std::memory_order_relaxed);
+                }
+                x = gp;
+                p = _parent[x].load(std::memory_order_relaxed);
+            }
+            return x;
+        }
+
+        /*Merge the sets of a and b, return false if they are in the same set already. */
+        bool unite(int a, int b)
+        {
+            for (;;) {
+                a = find(a);
+                b = find(b);
+                if (a == b) {
+                    return false;
+                }
+                if (a < b) {
+                    int t = a; a = b; b = t;
+                }
+                /*a may have been linked by another thread since find(), then try again. */
+                int expected = a;
+                if (_parent[a].compare_exchange_strong(expected, b, std::memory_order_acq_rel)) {
+                    return true;
+                }
+            }
+        }
+
+        bool same(int a, int b)
+        {
+            for (;;) {
+                a = find(a);
+                b = find(b);
+                if (a == b) {
+                    return true;
+                }
+                /*a is still a root, so they were in different sets at that time. */
+                if (_parent[a].load(std::memory_order_acquire) == a) {
+                    return false;
+                }
+            }
+        }
+
+        /*Set each element to its root, call it when the unions are done so that find() is one step. */
+        void flatten()
+        {
+            const int n = _parent.size();
+#pragma omp parallel for
+            for (int i = 0; i < n; ++i) {
+                _parent[i].store(find(i), std::memory_order_relaxed);
+            }
+        }
+
+    private:
+        ConcurrentUnionFind(const ConcurrentUnionFind&);
+        ConcurrentUnionFind& operator=(const ConcurrentUnionFind&);
+
+    protected:
+        std::vector<std::atomic<int> > _parent;
+    };
+}
+
+#endif
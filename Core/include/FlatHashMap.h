@@ -0,0 +1,250 @@
+/*
+**********************************************************************
+*
+* This file is a part of library MPCDPS(Massive Point Cloud Data Processing System).
+* It is a free program and it is protected by the license GPL-v3.0, you may not use the
+* file except in compliance with the License.
+*
+* Copyright(c) 2013 - 2020 Xu Shengpan, all rights reserved.
+*
+* Email: jack_1227x@163.com
+*
+**********************************************************************
+*/
+
+#ifndef  MPCDPS_FLATHASHMAP_H
+#define  MPCDPS_FLATHASHMAP_H
+
+#include <vector>
+#include <utility>
+#include "PublicInfo.h"
+
+namespace mpcdps {
+
+    /*A hash map of 64-bit integer keys, stored in a flat array with open addressing and linear probing.
+     * The key EMPTY_KEY (all bits set) is reserved. The capacity is a power of two and the load factor
+     * is kept no more than 1/2. Pointers to values are invalidated by rehash, reserve before
+     * inserting to keep them valid.
+     */
+    template <typename Value>
+    class FlatHashMap
+    {
+    public:
+        typedef std::pair<uint64, Value> Slot;
+
+        static const uint64 EMPTY_KEY = ~uint64(0);
+
+        FlatHashMap() :_size(0), _mask(0)
+        {
+        }
+
+        /*Forward iterator over the occupied slots, slot->first is the key and slot->second is the value. */
+        template <typename SlotType>
+        class Iterator
+        {
+        public:
+            Iterator(SlotType* slot, SlotType* end) :_slot(slot), _end(end)
+            {
+                skip();
+            }
+
+            /*iterator converts to const_iterator. */
+            template <typename OtherSlot>
+            Iterator(const Iterator<OtherSlot>& other) :_slot(other.slot()), _end(other.slotEnd())
+            {
+            }
+
+            SlotType* slot() const { return _slot; }
+            SlotType* slotEnd() const { return _end; }
+
+            SlotType& operator* () const { return *_slot; }
+            SlotType* operator-> () const { return _slot; }
+
+            Iterator& operator++ ()
+            {
+                ++_slot;
+                skip();
+                return *this;
+            }
+
+            bool operator== (const Iterator& other) const { return _slot == other._slot; }
+            bool operator!= (const Iterator& other) const { return _slot != other._slot; }
+
+        protected:
+            void skip()
+            {
+                while (_slot != _end && _slot->first == EMPTY_KEY) {
+                    ++_slot;
+                }
+            }
+
+            SlotType* _slot;
+            SlotType* _end;
+        };
+
+        typedef Iterator<Slot> iterator;
+        typedef Iterator<const Slot> const_iterator;
+
+        iterator begin() { return iterator(slotBegin(), slotEnd()); }
+        iterator end() { return iterator(slotEnd(), slotEnd()); }
+        const_iterator begin() const { return const_iterator(slotBegin(), slotEnd()); }
+        const_iterator end() const { return const_iterator(slotEnd(), slotEnd()); }
+
+        int size() const { return _size; }
+
+        bool empty() const { return _size == 0; }
+
+        int capacity() const { return _slots.size(); }
+
+        void clear()
+        {
+            _slots.clear();
+            _size = 0;
+            _mask = 0;
+        }
+
+        /*Make room for n keys without rehash. */
+        void reserve(int n)
+        {
+            size_t capacity = 16;
+            while (capacity < size_t(n) * 2) {
+                capacity <<= 1;
+            }
+            if (capacity > _slots.size()) {
+                rehash(capacity);
+            }
+        }
+
+        /*Pointer to the value of key, NULL if it does not exist. */
+        Value* find(uint64 key)
+        {
+            return const_cast<Value*>(static_cast<const FlatHashMap*>(this)->find(key));
+        }
+
+        const Value* find(uint64 key) const
+        {
+            if (_size == 0) {
+                return NULL;
+            }
+            for (size_t i = hash(key) & _mask; ; i = (i + 1) & _mask) {
+                const Slot& slot = _slots[i];
+                if (slot.first == key) {
+                    return &slot.second;
+                }
+                if (slot.first == EMPTY_KEY) {
+                    return NULL;
+                }
+            }
+        }
+
+        bool contains(uint64 key) const
+        {
+            return find(key) != NULL;
+        }
+
+        /*Insert key with value if it does not exist, return the value of key and
+         * whether it is inserted.
+         */
+        std::pair<Value*, bool> insert(uint64 key, const Value& value)
+        {
+            if (size_t(_size + 1) * 2 > _slots.size()) {
+                rehash(_slots.empty() ? 16 : _slots.size() * 2);
+            }
+            size_t i = hash(key) & _mask;
+            for (; _slots[i].first != EMPTY_KEY; i = (i + 1) & _mask) {
+                if (_slots[i].first == key) {
+                    return std::make_pair(&_slots[i].second, false);
+                }
+            }
+            _slots[i].first = key;
+            _slots[i].second = value;
+            ++_size;
+            return std::make_pair(&_slots[i].second, true);
+        }
+
+        /*Value of key, a default value is inserted if it does not exist. */
+        Value& operator[] (uint64 key)
+        {
+            return *insert(key, Value()).first;
+        }
+
+        /*Remove key, the following slots of the probe sequence are shifted back,
+         * so no tombstone is left. Return false if it does not exist.
+         */
+        bool erase(uint64 key)
+        {
+            if (_size == 0) {
+                return false;
+            }
+            size_t i = hash(key) & _mask;
+            for (; _slots[i].first != key; i = (i + 1) & _mask) {
+                if (_slots[i].first == EMPTY_KEY) {
+                    return false;
+                }
+            }
+
+            size_t j = i;
+            while (1) {
+                j = (j + 1) & _mask;
+                if (_slots[j].first == EMPTY_KEY) {
+                    break;
+                }
+                /*move slot j back to i if its home is not in (i, j]. */
+                size_t home = hash(_slots[j].first) & _mask;
+                if ((j > i && (home <= i || home > j)) || (j < i && (home <= i && home > j))) {
+                    _slots[i] = _slots[j];
+                    i = j;
+                }
+            }
+            _slots[i].first = EMPTY_KEY;
+            _slots[i].second = Value();
+            --_size;
+            return true;
+        }
+
+        /*Mix of the bits of key, the finalizer of splitmix64. */
+        static uint64 hash(uint64 key)
+        {
+            key ^= key >> 30;
+            key *= 0xbf58476d1ce4e5b9ULL;
+            key ^= key >> 27;
+            key *= 0x94d049bb133111ebULL;
+            key ^= key >> 31;
+            return key;
+        }
+
+    protected:
+        Slot* slotBegin() { return _slots.empty() ? NULL : &_slots[0]; }
+        Slot* slotEnd() { return _slots.empty() ? NULL : &_slots[0] + _slots.size(); }
+        const Slot* slotBegin() const { return _slots.empty() ? NULL : &_slots[0]; }
+        const Slot* slotEnd() const { return _slots.empty() ? NULL : &_slots[0] + _slots.size(); }
+
+        void rehash(size_t capacity)
+        {
+            std::vector<Slot> slots(capacity, Slot(EMPTY_KEY, Value()));
+            slots.swap(_slots);
+            _mask = capacity - 1;
+            for (size_t k = 0; k < slots.size(); ++k) {
+                if (slots[k].first == EMPTY_KEY) {
+                    continue;
+                }
+                size_t i = hash(slots[k].first) & _mask;
+                while (_slots[i].first != EMPTY_KEY) {
+                    i = (i + 1) & _mask;
+                }
+                _slots[i] = slots[k];
+            }
+        }
+
+    protected:
+        std::vector<Slot> _slots;
+        int _size;
+        size_t _mask;
+    };
+
+    template <typename Value>
+    const uint64 FlatHashMap<Value>::EMPTY_KEY;
+
+}
+
+#endif
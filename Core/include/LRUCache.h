@@ -0,0 +1,164 @@
+/*
+**********************************************************************
+*
+* This file is a part of library MPCDPS(Massive Point Cloud Data Processing System).
+* It is a free program and it is protected by the license GPL-v3.0, you may not use the
+* file except in compliance with the License.
+*
+* Copyright(c) 2013 - 2020 Xu Shengpan, all rights reserved.
+*
+* Email: jack_1227x@163.com
+*
+**********************************************************************
+*/
+
+#ifndef  MPCDPS_LRUCACHE_H
+#define  MPCDPS_LRUCACHE_H
+
+#include <list>
+#include <unordered_map>
+#include <functional>
+#include "SmartPointer.h"
+
+namespace mpcdps {
+
+    /*A least recently used cache with a memory budget.
+     * Values are held by SmartPointer, so an evicted value is still valid for its other holders.
+     * The cache is not thread safe.
+     */
+    template <typename Key, typename Value>
+    class LRUCache
+    {
+    public:
+        typedef std::function<void(const Key&, const SmartPointer<Value>&)> EvictCallback;
+
+        /*Constructor: budget is the memory budget in bytes.*/
+        LRUCache(size_t budget = size_t(256) << 20) :_budget(budget), _usage(0)
+        {
+        }
+
+        ~LRUCache()
+        {
+            clear();
+        }
+
+        /*Set the memory budget in bytes, values are evicted if the usage exceeds it.*/
+        void setBudget(size_t budget)
+        {
+            _budget = budget;
+            shrink();
+        }
+
+        size_t budget() const { return _budget; }
+
+        /*Memory usage in bytes of cached values.*/
+        size_t usage() const { return _usage; }
+
+        int size() const { return _map.size(); }
+
+        /*The callback is called for each value evicted to fit the budget.*/
+        void setEvictCallback(const EvictCallback& callback)
+        {
+            _evict_callback = callback;
+        }
+
+        /*Get the value of key and mark it as the most recently used, return NULL if it is not cached.*/
+        SmartPointer<Value> get(const Key& key)
+        {
+            typename Map::iterator iter = _map.find(key);
+            if (iter == _map.end()) {
+                return SmartPointer<Value>();
+            }
+            _list.splice(_list.begin(), _list, iter->second);
+            return iter->second->value;
+        }
+
+        bool contains(const Key& key) const
+        {
+            return _map.count(key) > 0;
+        }
+
+        /*Insert the value of key with its size in bytes, least recently used values are evicted
+         * to fit the budget, but the inserted value itself is always kept.
+         */
+        void put(const Key& key, const SmartPointer<Value>& value, size_t bytes)
+        {
+            remove(key);
+            Entry entry;
+            entry.key = key;
+            entry.value = value;
+            entry.bytes = bytes;
+            _list.push_front(entry);
+            _map[key] = _list.begin();
+            _usage += bytes;
+            shrink();
+        }
+
+        /*Remove the value of key without calling the evict callback.*/
+        void remove(const Key& key)
+        {
+            typename Map::iterator iter = _map.find(key);
+            if (iter == _map.end()) {
+                return;
+            }
+            _usage -= iter->second->bytes;
+            _list.erase(iter->second);
+            _map.erase(iter);
+        }
+
+        /*Evict all of the values, the evict callback is called for each of them.*/
+        void flush()
+        {
+            while (!_list.empty()) {
+                evictLast();
+            }
+        }
+
+        /*Remove all of the values without calling the evict callback.*/
+        void clear()
+        {
+            _list.clear();
+            _map.clear();
+            _usage = 0;
+        }
+
+    protected:
+        struct Entry
+        {
+            Key key;
+            SmartPointer<Value> value;
+            size_t bytes;
+        };
+
+        typedef std::list<Entry> List;
+        typedef std::unordered_map<Key, typename List::iterator> Map;
+
+        void shrink()
+        {
+            while (_usage > _budget && _list.size() > 1) {
+                evictLast();
+            }
+        }
+
+        void evictLast()
+        {
+            Entry entry = _list.back();
+            _list.pop_back();
+            _map.erase(entry.key);
+            _usage -= entry.bytes;
+            if (_evict_callback) {
+                _evict_callback(entry.key, entry.value);
+            }
+        }
+
+    protected:
+        size_t _budget;
+        size_t _usage;
+        List _list;
+        Map _map;
+        EvictCallback _evict_callback;
+    };
+
+}
+
+#endif
@@ -0,0 +1,59 @@
+/*
+**********************************************************************
+*
+* This file is a part of library MPCDPS(Massive Point Cloud Data Processing System).
+* It is a free program and it is protected by the license GPL-v3.0, you may not use the
+* file except in compliance with the License.
+*
+* Copyright(c) 2013 - 2020 Xu Shengpan, all rights reserved.
+*
+* Email: jack_1227x@163.com
+*
+**********************************************************************
+*/
+
+#ifndef  MPCDPS_MAPPEDFILE_H
+#define MPCDPS_MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+#include "MPCDPSCoreLib.h"
+
+namespace mpcdps {
+
+    /*
+       A file mapped read-only into memory, the pages are loaded by the system when they are accessed
+       and shared by the processes mapping the same file.
+    */
+    class MPCDPS_CORE_ITEM MappedFile
+    {
+    public:
+        MappedFile();
+        ~MappedFile();
+
+        /*Map the whole file, the mapped file is closed first. Return false if it fails or the file is empty. */
+        bool open(const std::string& path);
+
+        void close();
+
+        bool isOpen() const { return _data != NULL; }
+
+        const char* data() const { return _data; }
+
+        size_t size() const { return _size; }
+
+    private:
+        MappedFile(const MappedFile&);
+        MappedFile& operator=(const MappedFile&);
+
+    protected:
+        const char* _data;
+        size_t _size;
+#ifdef _WIN32
+        void* _file;
+        void* _mapping;
+#endif
+    };
+}
+
+#endif
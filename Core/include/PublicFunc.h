@@ -15,6 +15,7 @@
 #ifndef  MPCDPS_PUBLICFUNC_H
 #define MPCDPS_PUBLICFUNC_H
 
+#include <cstdio>
 #include <vector>
 #include "PublicInfo.h"
 #include "MPCDPSCoreLib.h"
@@ -302,6 +303,70 @@ inline void sort_merge_syn(std::vector<T>& keys, std::vector<int>& idList)
     }
 }
 
+/*
+Sort for idList by 64-bit keys with LSD radix sort, the keys and idList will change synchronously.
+The sort is stable, passes whose digit is the same for all keys are skipped.
+Large inputs are split into blocks which are counted and scattered in parallel.
+*/
+inline void sort_radix_syn(std::vector<uint64>& keys, std::vector<int>& idList)
+{
+    const int n = keys.size();
+    if (n < 2)
+        return;
+
+    uint64 diff = 0;
+    const uint64 key0 = keys[0];
+    for (int i = 1; i < n; ++i)
+        diff |= keys[i] ^ key0;
+
+    const int n_block = (n < 65536) ? 1 : 64;
+    const int block_size = (n + n_block - 1) / n_block;
+    std::vector<uint64> keys1(n);
+    std::vector<int> idList1(n);
+    std::vector<int> hist(n_block * 256);
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        if (((diff >> shift) & 0xff) == 0)
+            continue;
+
+        hist.assign(n_block * 256, 0);
+
+#pragma omp parallel for
+        for (int b = 0; b < n_block; ++b) {
+            int* h = &hist[b * 256];
+            int beg = b * block_size;
+            int end = MINV(n, beg + block_size);
+            for (int i = beg; i < end; ++i)
+                ++h[(keys[i] >> shift) & 0xff];
+        }
+
+        int sum = 0, t;
+        for (int d = 0; d < 256; ++d) {
+            for (int b = 0; b < n_block; ++b) {
+                t = hist[b * 256 + d];
+                hist[b * 256 + d] = sum;
+                sum += t;
+            }
+        }
+
+#pragma omp parallel for
+        for (int b = 0; b < n_block; ++b) {
+            int* h = &hist[b * 256];
+            int beg = b * block_size;
+            int end = MINV(n, beg + block_size);
+            int pos;
+            for (int i = beg; i < end; ++i) {
+                pos = h[(keys[i] >> shift) & 0xff]++;
+                keys1[pos] = keys[i];
+                idList1[pos] = idList[i];
+            }
+        }
+
+        keys.swap(keys1);
+        idList.swap(idList1);
+    }
+}
+
 //Rearrange the keys as ascending order.
 template <typename T>
 inline void sort_shell(std::vector<T>& keys)
@@ -491,6 +556,16 @@ inline int find_low_bound(const std::vector<T>& elemList, const T v)
     return li;
 }
 
+/*Seek to a 64 bits offset from the beginning of file, return 0 on success. */
+inline int file_seek64(FILE* file, uint64 offset)
+{
+#ifdef _WIN32
+    return _fseeki64(file, int64(offset), SEEK_SET);
+#else
+    return fseeko(file, off_t(offset), SEEK_SET);
+#endif
+}
+
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,122 @@
+/*
+**********************************************************************
+*
+* This file is a part of library MPCDPS(Massive Point Cloud Data Processing System).
+* It is a free program and it is protected by the license GPL-v3.0, you may not use the
+* file except in compliance with the License.
+*
+* Copyright(c) 2013 - 2020 Xu Shengpan, all rights reserved.
+*
+* Email: jack_1227x@163.com
+*
+**********************************************************************
+*/
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace mpcdps {
+
+#ifdef _WIN32
+
+    MappedFile::MappedFile() : _data(NULL), _size(0), _file(INVALID_HANDLE_VALUE), _mapping(NULL)
+    {
+    }
+
+    bool MappedFile::open(const std::string& path)
+    {
+        close();
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+            CloseHandle(file);
+            return false;
+        }
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping == NULL) {
+            CloseHandle(file);
+            return false;
+        }
+        void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (data == NULL) {
+            CloseHandle(mapping);
+            CloseHandle(file);
+            return false;
+        }
+        _file = file;
+        _mapping = mapping;
+        _data = static_cast<const char*>(data);
+        _size = size_t(size.QuadPart);
+        return true;
+    }
+
+    void MappedFile::close()
+    {
+        if (_data) {
+            UnmapViewOfFile(_data);
+            CloseHandle(_mapping);
+            CloseHandle(_file);
+        }
+        _data = NULL;
+        _size = 0;
+        _file = INVALID_HANDLE_VALUE;
+        _mapping = NULL;
+    }
+
+#else
+
+    MappedFile::MappedFile() : _data(NULL), _size(0)
+    {
+    }
+
+    bool MappedFile::open(const std::string& path)
+    {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        /*the mapping stays valid after the descriptor is closed. */
+        void* data = mmap(NULL, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            return false;
+        }
+        _data = static_cast<const char*>(data);
+        _size = size_t(st.st_size);
+        return true;
+    }
+
+    void MappedFile::close()
+    {
+        if (_data) {
+            munmap(const_cast<char*>(_data), _size);
+        }
+        _data = NULL;
+        _size = 0;
+    }
+
+#endif
+
+    MappedFile::~MappedFile()
+    {
+        close();
+    }
+}
@@ -0,0 +1,92 @@
+/*
+**********************************************************************
+*
+* This file is a part of library MPCDPS(Massive Point Cloud Data Processing System).
+* It is a free program and it is protected by the license GPL-v3.0, you may not use the
+* file except in compliance with the License.
+*
+* Copyright(c) 2013 - 2020 Xu Shengpan, all rights reserved.
+*
+* Email: jack_1227x@163.com
+*
+**********************************************************************
+*/
+
+/*
+    Query performance of RTree2 built by bulkLoad versus addElem.
+    usage: RTree2Benchmark [rect_count] [query_count]
+    n random rects of up to 5 x 5 in 10000 x 10000 are loaded both ways, then the same window queries of
+    20 x 20 are run on both trees, the times and the hit counts are printed, the hit counts must be equal.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "RTree2.h"
+
+using namespace mpcdps;
+
+typedef RTree2<double, int> Tree;
+typedef std::chrono::steady_clock Clock;
+
+static double elapsed_ms(const Clock::time_point& t0)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+static double random_real(double vmax)
+{
+    return rand() / double(RAND_MAX) * vmax;
+}
+
+static double run_queries(const Tree& tree, const std::vector<Rect2<double> >& queries, long long& hits)
+{
+    std::vector<int> ids;
+    hits = 0;
+    const Clock::time_point t0 = Clock::now();
+    for (size_t i = 0; i < queries.size(); ++i) {
+        tree.searchElems(queries[i], ids);
+        hits += ids.size();
+    }
+    return elapsed_ms(t0);
+}
+
+int main(int argc, char** argv)
+{
+    const int rect_count = (argc > 1) ? atoi(argv[1]) : 1000000;
+    const int query_count = (argc > 2) ? atoi(argv[2]) : 20000;
+
+    srand(5);
+    std::vector<Tree::RTreeElem> elems;
+    elems.reserve(rect_count);
+    for (int i = 0; i < rect_count; ++i) {
+        const double x = random_real(10000), y = random_real(10000);
+        elems.push_back(Tree::RTreeElem(i, Rect2<double>(x, x + random_real(5), y, y + random_real(5))));
+    }
+    std::vector<Rect2<double> > queries(query_count);
+    for (int i = 0; i < query_count; ++i) {
+        const double x = random_real(10000), y = random_real(10000);
+        queries[i] = Rect2<double>(x, x + 20, y, y + 20);
+    }
+
+    Tree incremental, bulk;
+    Clock::time_point t0 = Clock::now();
+    for (int i = 0; i < rect_count; ++i) {
+        incremental.addElem(elems[i]);
+    }
+    const double insert_ms = elapsed_ms(t0);
+    t0 = Clock::now();
+    bulk.bulkLoad(elems);
+    const double bulk_ms = elapsed_ms(t0);
+
+    long long incremental_hits, bulk_hits;
+    const double incremental_query_ms = run_queries(incremental, queries, incremental_hits);
+    const double bulk_query_ms = run_queries(bulk, queries, bulk_hits);
+
+    printf("%d rects, %d queries\n", rect_count, query_count);
+    printf("build:   addElem %.0f ms, bulkLoad %.0f ms\n", insert_ms, bulk_ms);
+    printf("queries: incremental tree %.0f ms, bulk-loaded tree %.0f ms\n", incremental_query_ms, bulk_query_ms);
+    printf("hits:    %lld, %lld\n", incremental_hits, bulk_hits);
+    return (incremental_hits == bulk_hits) ? 0 : 1;
+}
@@ -0,0 +1,468 @@
+/*
+**********************************************************************
+*
+* This file is a part of library MPCDPS(Massive Point Cloud Data Processing System).
+* It is a free program and it is protected by the license GPL-v3.0, you may not use the
+* file except in compliance with the License.
+*
+* Copyright(c) 2013 - 2020 Xu Shengpan, all rights reserved.
+*
+* Email: jack_1227x@163.com
+*
+**********************************************************************
+*/
+
+#ifndef  MPCDPS_GRID2DFILTER_H
+#define MPCDPS_GRID2DFILTER_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+#include "Grid2D.h"
+
+namespace mpcdps {
+
+/*
+    Morphology and smoothing filters of Grid2D over square windows of (2 * radius + 1) cells.
+    The windows are clipped at the borders of the grid. dst gets the frame of src and a new buffer,
+    so dst can be src.
+
+    Erode and dilate are separable, each pass is van Herk/Gil-Werman with 3 comparisons per cell for any
+    window size. The row pass runs in parallel over rows, the column pass works on whole rows so that its
+    inner loops are vectorized, and runs in parallel over bands of rows.
+*/
+
+namespace grid_filter_detail {
+
+    const int BAND_ROWS = 32;
+
+    template<typename T>
+    inline void allocate_like(const Grid2D<T>& src, Grid2D<T>& dst)
+    {
+        const Grid2DFrame frame = src;
+        const int rn = src.rowCount(), cn = src.colCount();
+        dst.clear();
+        static_cast<Grid2DFrame&>(dst) = frame;
+        dst.SmartArrayReal2D<T>::resize(rn, cn);
+    }
+
+    template<typename T>
+    inline T max_value()
+    {
+        return std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max();
+    }
+
+    template<typename T>
+    inline T min_value()
+    {
+        return std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::lowest();
+    }
+
+    template<typename T>
+    struct MinOp
+    {
+        static T pad() { return max_value<T>(); }
+        static T apply(T a, T b) { return b < a ? b : a; }
+    };
+
+    template<typename T>
+    struct MaxOp
+    {
+        static T pad() { return min_value<T>(); }
+        static T apply(T a, T b) { return a < b ? b : a; }
+    };
+
+    /*out[i] = Op of in[i - rad, i + rad] of a line of n values, g and h have n + 4 * rad + 1 values.
+     * The line is padded by rad values of Op::pad() on both sides and split into blocks of w = 2 * rad + 1,
+     * g is the prefix and h is the suffix of each block, then a window is the suffix of one block and the prefix of the next.
+     */
+    template<typename T, typename Op>
+    inline void van_herk_line(const T* in, int n, int stride, int rad, T* g, T* h, T* out)
+    {
+        const int w = 2 * rad + 1;
+        const int m = ((n + 2 * rad + w - 1) / w) * w;
+        for (int i = 0; i < m; ++i) {
+            const int j = i - rad;
+            g[i] = (j >= 0 && j < n) ? in[size_t(j) * stride] : Op::pad();
+        }
+        for (int b = 0; b < m; b += w) {
+            const int e = b + w - 1;
+            h[e] = g[e];
+            for (int i = e - 1; i >= b; --i) {
+                h[i] = Op::apply(g[i], h[i + 1]);
+            }
+            for (int i = b + 1; i <= e; ++i) {
+                g[i] = Op::apply(g[i - 1], g[i]);
+            }
+        }
+        for (int i = 0; i < n; ++i) {
+            out[size_t(i) * stride] = Op::apply(h[i], g[i + w - 1]);
+        }
+    }
+
+    /*Row pass of erode or dilate, rows in parallel. */
+    template<typename T, typename Op>
+    inline void van_herk_rows(const SmartArrayReal2D<T>& src, int rad, SmartArrayReal2D<T>& dst)
+    {
+        const int rn = src.rowCount(), cn = src.colCount();
+#pragma omp parallel
+        {
+            std::vector<T> g(cn + 4 * rad + 1), h(cn + 4 * rad + 1);
+#pragma omp for schedule(dynamic, 16)
+            for (int r = 0; r < rn; ++r) {
+                van_herk_line<T, Op>(src[r], cn, 1, rad, &g[0], &h[0], dst[r]);
+            }
+        }
+    }
+
+    /*Column pass of erode or dilate, the same as van_herk_line() with rows as the values, in parallel over bands of rows.
+     * The blocks covering the windows of a band are computed, so the bands are independent.
+     */
+    template<typename T, typename Op>
+    inline void van_herk_cols(const SmartArrayReal2D<T>& src, int rad, SmartArrayReal2D<T>& dst)
+    {
+        const int rn = src.rowCount(), cn = src.colCount();
+        const int w = 2 * rad + 1;
+        const int n_band = (rn + BAND_ROWS - 1) / BAND_ROWS;
+#pragma omp parallel
+        {
+            std::vector<T> g, h;
+#pragma omp for schedule(dynamic, 1)
+            for (int band = 0; band < n_band; ++band) {
+                const int r0 = band * BAND_ROWS;
+                const int r1 = MINV(rn, r0 + BAND_ROWS);
+                /*padded rows [b0, b1) cover the windows [r, r + w) of the padded rows of the band. */
+                const int b0 = (r0 / w) * w;
+                const int b1 = ((r1 - 1 + w) / w + 1) * w;
+                g.resize(size_t(b1 - b0) * cn);
+                h.resize(size_t(b1 - b0) * cn);
+
+                for (int i = b0; i < b1; ++i) {
+                    const int j = i - rad;
+                    T* gi = &g[size_t(i - b0) * cn];
+                    if (j >= 0 && j < rn) {
+                        const T* s = src[j];
+#pragma omp simd
+                        for (int c = 0; c < cn; ++c) gi[c] = s[c];
+                    } else {
+                        const T pad = Op::pad();
+#pragma omp simd
+                        for (int c = 0; c < cn; ++c) gi[c] = pad;
+                    }
+                }
+                for (int b = b0; b < b1; b += w) {
+                    const int e = b + w - 1;
+                    T* he = &h[size_t(e - b0) * cn];
+                    const T* ge = &g[size_t(e - b0) * cn];
+#pragma omp simd
+                    for (int c = 0; c < cn; ++c) he[c] = ge[c];
+                    for (int i = e - 1; i >= b; --i) {
+                        T* hi = &h[size_t(i - b0) * cn];
+                        const T* hn = hi + cn;
+                        const T* gi = &g[size_t(i - b0) * cn];
+#pragma omp simd
+                        for (int c = 0; c < cn; ++c) hi[c] = Op::apply(gi[c], hn[c]);
+                    }
+                    for (int i = b + 1; i <= e; ++i) {
+                        T* gi = &g[size_t(i - b0) * cn];
+                        const T* gp = gi - cn;
+#pragma omp simd
+                        for (int c = 0; c < cn; ++c) gi[c] = Op::apply(gp[c], gi[c]);
+                    }
+                }
+                for (int r = r0; r < r1; ++r) {
+                    const T* hr = &h[size_t(r - b0) * cn];
+                    const T* gr = &g[size_t(r + w - 1 - b0) * cn];
+                    T* d = dst[r];
+#pragma omp simd
+                    for (int c = 0; c < cn; ++c) d[c] = Op::apply(hr[c], gr[c]);
+                }
+            }
+        }
+    }
+
+    template<typename T, typename Op>
+    inline void van_herk(const Grid2D<T>& src, int radius, Grid2D<T>& dst)
+    {
+        const Grid2D<T> in = src;
+        allocate_like(in, dst);
+        if (in.empty()) {
+            return;
+        }
+        SmartArrayReal2D<T> tmp(in.rowCount(), in.colCount());
+        van_herk_rows<T, Op>(in, radius, tmp);
+        van_herk_cols<T, Op>(tmp, radius, dst);
+    }
+
+}
+
+/*Minimum of the window of each cell. */
+template<typename T>
+inline void grid_erode(const Grid2D<T>& src, int radius, Grid2D<T>& dst)
+{
+    grid_filter_detail::van_herk<T, grid_filter_detail::MinOp<T> >(src, radius, dst);
+}
+
+/*Maximum of the window of each cell. */
+template<typename T>
+inline void grid_dilate(const Grid2D<T>& src, int radius, Grid2D<T>& dst)
+{
+    grid_filter_detail::van_herk<T, grid_filter_detail::MaxOp<T> >(src, radius, dst);
+}
+
+/*Erode then dilate, removes the peaks smaller than the window. */
+template<typename T>
+inline void grid_open(const Grid2D<T>& src, int radius, Grid2D<T>& dst)
+{
+    Grid2D<T> tmp;
+    grid_erode(src, radius, tmp);
+    grid_dilate(tmp, radius, dst);
+}
+
+/*Dilate then erode, fills the pits smaller than the window. */
+template<typename T>
+inline void grid_close(const Grid2D<T>& src, int radius, Grid2D<T>& dst)
+{
+    Grid2D<T> tmp;
+    grid_dilate(src, radius, tmp);
+    grid_erode(tmp, radius, dst);
+}
+
+/*Mean of the window of each cell by running sums, O(1) per cell.
+ * The column sums of the window are updated row by row within bands of rows in parallel.
+ */
+template<typename T>
+inline void grid_box_mean(const Grid2D<T>& src, int radius, Grid2D<T>& dst)
+{
+    const Grid2D<T> in = src;
+    grid_filter_detail::allocate_like(in, dst);
+    const int rn = in.rowCount(), cn = in.colCount();
+    const int n_band = (rn + grid_filter_detail::BAND_ROWS - 1) / grid_filter_detail::BAND_ROWS;
+
+#pragma omp parallel
+    {
+        std::vector<double> col_sum(cn), row_sum(cn + 1);
+#pragma omp for schedule(dynamic, 1)
+        for (int band = 0; band < n_band; ++band) {
+            const int r0 = band * grid_filter_detail::BAND_ROWS;
+            const int r1 = MINV(rn, r0 + grid_filter_detail::BAND_ROWS);
+            std::fill(col_sum.begin(), col_sum.end(), 0.0);
+            for (int i = MAXV(0, r0 - radius - 1); i < MINV(rn, r0 + radius); ++i) {
+                const T* s = in[i];
+#pragma omp simd
+                for (int c = 0; c < cn; ++c) col_sum[c] += s[c];
+            }
+            for (int r = r0; r < r1; ++r) {
+                /*col_sum holds rows [r - radius, r + radius] clipped. */
+                if (r + radius < rn) {
+                    const T* s = in[r + radius];
+#pragma omp simd
+                    for (int c = 0; c < cn; ++c) col_sum[c] += s[c];
+                }
+                if (r - radius - 1 >= 0) {
+                    const T* s = in[r - radius - 1];
+#pragma omp simd
+                    for (int c = 0; c < cn; ++c) col_sum[c] -= s[c];
+                }
+                const int rows = MINV(rn - 1, r + radius) - MAXV(0, r - radius) + 1;
+
+                row_sum[0] = 0;
+                for (int c = 0; c < cn; ++c) {
+                    row_sum[c + 1] = row_sum[c] + col_sum[c];
+                }
+                T* d = dst[r];
+                for (int c = 0; c < cn; ++c) {
+                    const int c0 = MAXV(0, c - radius), c1 = MINV(cn - 1, c + radius);
+                    const double v = (row_sum[c1 + 1] - row_sum[c0]) / (double(rows) * (c1 - c0 + 1));
+                    d[c] = std::numeric_limits<T>::is_integer ? T(std::floor(v + 0.5)) : T(v);
+                }
+            }
+        }
+    }
+}
+
+namespace grid_filter_detail {
+
+    /*counts of n ranks in three levels of 1, 64 and 4096 ranks, each rank is counted once at most.*/
+    struct RankCounts
+    {
+        std::vector<unsigned char> fine;
+        std::vector<int> mid, top;
+
+        void reset(int n)
+        {
+            fine.assign(n, 0);
+            mid.assign((n >> 6) + 1, 0);
+            top.assign((n >> 12) + 1, 0);
+        }
+
+        void add(int rank, int v)
+        {
+            fine[rank] = (unsigned char)(fine[rank] + v);
+            mid[rank >> 6] += v;
+            top[rank >> 12] += v;
+        }
+
+        /*the k-th counted rank from 0.*/
+        int select(int k) const
+        {
+            int t = 0;
+            while (k >= top[t]) {
+                k -= top[t++];
+            }
+            int m = t << 6;
+            while (k >= mid[m]) {
+                k -= mid[m++];
+            }
+            int f = m << 6;
+            while (k >= fine[f]) {
+                k -= fine[f++];
+            }
+            return f;
+        }
+    };
+
+    /*appends the valid values of row i of src to values, with (i % slots) * cn + column, sorted.*/
+    template<typename T>
+    inline void sorted_row(const Grid2D<T>& src, int i, int slots, bool has_nodata, const T& nodata,
+        std::vector<std::pair<T, int> >& values)
+    {
+        const int cn = src.colCount();
+        const int base = (i % slots) * cn;
+        const size_t first = values.size();
+        const T* s = src[i];
+        for (int c = 0; c < cn; ++c) {
+            if (s[c] == s[c] && !(has_nodata && s[c] == nodata)) {
+                values.push_back(std::make_pair(s[c], base + c));
+            }
+        }
+        std::sort(values.begin() + first, values.end());
+    }
+
+    template<typename T>
+    struct InSlot
+    {
+        int begin, end;
+        bool operator()(const std::pair<T, int>& v) const { return begin <= v.second && v.second < end; }
+    };
+
+    template<typename T>
+    inline void median(const Grid2D<T>& src, int radius, Grid2D<T>& dst, bool has_nodata, const T& nodata)
+    {
+        const Grid2D<T> in = src;
+        allocate_like(in, dst);
+        const int rn = in.rowCount(), cn = in.colCount();
+        if (rn == 0 || cn == 0) {
+            return;
+        }
+        const int slots = MINV(rn, 2 * radius + 1);
+        const int n_band = (rn + BAND_ROWS - 1) / BAND_ROWS;
+
+#pragma omp parallel
+        {
+            /*sorted holds the valid values of the rows of the windows of a row, with the slot of their cell,
+             * rows are kept in slots i % slots, the row leaving the windows and the row entering them share a slot.
+             */
+            std::vector<std::pair<T, int> > sorted, row, merged;
+            std::vector<int> rank(size_t(slots) * cn);
+            RankCounts counts;
+#pragma omp for schedule(dynamic, 1)
+            for (int band = 0; band < n_band; ++band) {
+                const int r0 = band * BAND_ROWS;
+                const int r1 = MINV(rn, r0 + BAND_ROWS);
+                sorted.clear();
+                for (int i = MAXV(0, r0 - radius); i < MINV(rn, r0 + radius); ++i) {
+                    sorted_row(in, i, slots, has_nodata, nodata, row);
+                    merged.resize(sorted.size() + row.size());
+                    std::merge(sorted.begin(), sorted.end(), row.begin(), row.end(), merged.begin());
+                    sorted.swap(merged);
+                    row.clear();
+                    std::fill(rank.begin() + (i % slots) * cn, rank.begin() + (i % slots + 1) * cn, -1);
+                }
+
+                for (int r = r0; r < r1; ++r) {
+                    if (r - radius - 1 >= 0) {
+                        InSlot<T> out;
+                        out.begin = ((r - radius - 1) % slots) * cn;
+                        out.end = out.begin + cn;
+                        sorted.erase(std::remove_if(sorted.begin(), sorted.end(), out), sorted.end());
+                    }
+                    if (r + radius < rn) {
+                        sorted_row(in, r + radius, slots, has_nodata, nodata, row);
+                        merged.resize(sorted.size() + row.size());
+                        std::merge(sorted.begin(), sorted.end(), row.begin(), row.end(), merged.begin());
+                        sorted.swap(merged);
+                        row.clear();
+                        std::fill(rank.begin() + ((r + radius) % slots) * cn,
+                            rank.begin() + ((r + radius) % slots + 1) * cn, -1);
+                    }
+                    const int n = int(sorted.size());
+                    for (int k = 0; k < n; ++k) {
+                        rank[sorted[k].second] = k;
+                    }
+
+                    const int ra = MAXV(0, r - radius), rb = MINV(rn - 1, r + radius);
+                    counts.reset(n);
+                    int count = 0;
+                    const T* s = in[r];
+                    T* d = dst[r];
+                    for (int c = -radius; c < cn; ++c) {
+                        const int c_in = c + radius, c_out = c - radius - 1;
+                        if (c_in < cn) {
+                            for (int i = ra; i <= rb; ++i) {
+                                const int k = rank[(i % slots) * cn + c_in];
+                                if (k >= 0) {
+                                    counts.add(k, 1);
+                                    ++count;
+                                }
+                            }
+                        }
+                        if (c_out >= 0) {
+                            for (int i = ra; i <= rb; ++i) {
+                                const int k = rank[(i % slots) * cn + c_out];
+                                if (k >= 0) {
+                                    counts.add(k, -1);
+                                    --count;
+                                }
+                            }
+                        }
+                        if (c < 0) {
+                            continue;
+                        }
+                        if (rank[(r % slots) * cn + c] < 0) {
+                            d[c] = s[c];
+                            continue;
+                        }
+                        d[c] = sorted[counts.select((count - 1) / 2)].first;
+                    }
+                }
+            }
+        }
+    }
+
+}
+
+/*Lower median of the valid values of the window of each cell, exact for any type.
+ * The valid values of the rows of the windows of a row are kept sorted, a row is merged in and a row taken out
+ * from one row to the next, and the window counts the ranks of its values in three levels, O(radius) per cell
+ * to update the counts and O(64) to find the median.
+ * NaN cells are not valid, they are kept in dst and left out of the windows. Bands of rows are filtered in parallel.
+ */
+template<typename T>
+inline void grid_median(const Grid2D<T>& src, int radius, Grid2D<T>& dst)
+{
+    grid_filter_detail::median(src, radius, dst, false, T());
+}
+
+/*As grid_median, the cells of nodata are not valid either, they keep nodata in dst.*/
+template<typename T>
+inline void grid_median(const Grid2D<T>& src, int radius, Grid2D<T>& dst, typename Grid2D<T>::CellType nodata)
+{
+    grid_filter_detail::median(src, radius, dst, true, nodata);
+}
+
+}
+
+#endif
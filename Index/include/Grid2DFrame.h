@@ -18,6 +18,10 @@
 #include <cmath>
 #include "PublicInfo.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 namespace mpcdps 
 {
 
@@ -29,7 +33,7 @@ namespace mpcdps
 	class Grid2DFrame
 	{
 	public:
-		Grid2DFrame():_dx(0), _dy(0), _rn(0), _cn(0)
+		Grid2DFrame():_x0(0), _y0(0), _dx(0), _dy(0), _inv_dx(0), _inv_dy(0), _rn(0), _cn(0)
 		{
 
 		}
@@ -39,7 +43,8 @@ namespace mpcdps
 
 		}
 
-		Grid2DFrame(const Grid2DFrame& obj):_x0(obj._x0), _y0(obj._y0), _dx(obj._dx), _dy(obj._dy), _rn(obj._rn), _cn(obj._cn)
+		Grid2DFrame(const Grid2DFrame& obj):_x0(obj._x0), _y0(obj._y0), _dx(obj._dx), _dy(obj._dy),
+			_inv_dx(obj._inv_dx), _inv_dy(obj._inv_dy), _rn(obj._rn), _cn(obj._cn)
 		{
 
 		}
@@ -50,6 +55,8 @@ namespace mpcdps
 			_y0 = yStart;
 			_dx = dx;
 			_dy = dy;
+			_inv_dx = 1.0 / dx;
+			_inv_dy = 1.0 / dy;
 
 			_rn = yLen/std::abs(dy) + 1;
 			_cn = xLen/std::abs(dx) + 1;
@@ -61,18 +68,57 @@ namespace mpcdps
 			_y0 = yStart;
 			_dx = dx;
 			_dy = dy;
+			_inv_dx = 1.0 / dx;
+			_inv_dy = 1.0 / dy;
 			_rn = rn;
 			_cn = cn;
 		}
 
+		/*Indices are floored, so the points before the start are at negative indices. */
 		int get_r(double y)  const
 		{
-			return LOCATE(y,_y0, _dy);
+			return floor_int((y - _y0) * _inv_dy);
 		}
 
 		int get_c(double x)  const
 		{
-			return LOCATE(x, _x0, _dx);
+			return floor_int((x - _x0) * _inv_dx);
+		}
+
+		/*Cell indices of n points, point i is pts + (ids ? ids[i] : i) * stride with x, y at [0], [1].
+		 * It gives the same indices as get_r() and get_c(), and is vectorized with AVX2 if it is enabled.
+		 * The batch is processed serially, call it on blocks of points in parallel loops.
+		 */
+		template<typename T>
+		void get_rc(const T* pts, int n, int stride, const int* ids, int* rs, int* cs) const
+		{
+			locate(pts, n, stride, ids, 1, _y0, _inv_dy, rs);
+			locate(pts, n, stride, ids, 0, _x0, _inv_dx, cs);
+		}
+
+		/*Linear keys r * cn + c of n points for sort based grouping, invalid for the points out of the grid. */
+		template<typename T>
+		void get_cell_keys(const T* pts, int n, int stride, const int* ids, uint64* keys,
+			uint64 invalid = ~uint64(0)) const
+		{
+			int i = 0;
+#if defined(__AVX2__)
+			int rs[4], cs[4];
+			for (; i + 4 <= n; i += 4) {
+				_mm_storeu_si128((__m128i*)rs, locate4(pts, stride, ids, i, 1, _y0, _inv_dy));
+				_mm_storeu_si128((__m128i*)cs, locate4(pts, stride, ids, i, 0, _x0, _inv_dx));
+				for (int k = 0; k < 4; ++k) {
+					keys[i + k] = (uint64(rs[k]) < uint64(_rn) && uint64(cs[k]) < uint64(_cn)) ?
+						uint64(rs[k]) * _cn + cs[k] : invalid;
+				}
+			}
+#endif
+			for (; i < n; ++i) {
+				const T* p = pts + size_t(ids ? ids[i] : i) * stride;
+				const int r = floor_int((double(p[1]) - _y0) * _inv_dy);
+				const int c = floor_int((double(p[0]) - _x0) * _inv_dx);
+				keys[i] = (uint64(r) < uint64(_rn) && uint64(c) < uint64(_cn)) ? uint64(r) * _cn + c : invalid;
+			}
 		}
 
 		int rowCount() const
@@ -105,14 +151,58 @@ namespace mpcdps
 			return SKIP(_y0, _dy, r);
 		}
 
-		float get_dx() const { return _dx;}
-		float get_dy() const { return _dy;}
+		double get_dx() const { return _dx;}
+		double get_dy() const { return _dy;}
+
+	protected:
+		/*floor of v as int, without the call of std::floor. */
+		static int floor_int(double v)
+		{
+			int i = int(v);
+			return i - (v < i);
+		}
+
+#if defined(__AVX2__)
+		/*floor((v - v0) * inv) of the axis values of points [i, i + 4). */
+		template<typename T>
+		static __m128i locate4(const T* pts, int stride, const int* ids, int i, int axis, double v0, double inv)
+		{
+			__m256d v;
+			if (ids) {
+				v = _mm256_set_pd(double(pts[size_t(ids[i + 3]) * stride + axis]), double(pts[size_t(ids[i + 2]) * stride + axis]),
+					double(pts[size_t(ids[i + 1]) * stride + axis]), double(pts[size_t(ids[i]) * stride + axis]));
+			} else {
+				const T* p = pts + size_t(i) * stride + axis;
+				v = _mm256_set_pd(double(p[3 * stride]), double(p[2 * stride]), double(p[stride]), double(p[0]));
+			}
+			v = _mm256_floor_pd(_mm256_mul_pd(_mm256_sub_pd(v, _mm256_set1_pd(v0)), _mm256_set1_pd(inv)));
+			return _mm256_cvttpd_epi32(v);
+		}
+#endif
+
+		/*out[i] = floor((v - v0) * inv) of the axis value v of point i. */
+		template<typename T>
+		static void locate(const T* pts, int n, int stride, const int* ids, int axis,
+			double v0, double inv, int* out)
+		{
+			int i = 0;
+#if defined(__AVX2__)
+			for (; i + 4 <= n; i += 4) {
+				_mm_storeu_si128((__m128i*)(out + i), locate4(pts, stride, ids, i, axis, v0, inv));
+			}
+#endif
+			for (; i < n; ++i) {
+				out[i] = floor_int((double(pts[size_t(ids ? ids[i] : i) * stride + axis]) - v0) * inv);
+			}
+		}
 
 	protected:
 		double _x0;
 		double _y0;
 		double _dx;
 		double _dy;
+		double _inv_dx;
+		double _inv_dy;
 		int      _rn;
 		int      _cn;
 	};
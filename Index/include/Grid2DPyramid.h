@@ -0,0 +1,189 @@
+/*
+**********************************************************************
+*
+* This file is a part of library MPCDPS(Massive Point Cloud Data Processing System).
+* It is a free program and it is protected by the license GPL-v3.0, you may not use the
+* file except in compliance with the License.
+*
+* Copyright(c) 2013 - 2020 Xu Shengpan, all rights reserved.
+*
+* Email: jack_1227x@163.com
+*
+**********************************************************************
+*/
+
+#ifndef  MPCDPS_GRID2DPYRAMID_H
+#define MPCDPS_GRID2DPYRAMID_H
+
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "Grid2D.h"
+
+namespace mpcdps {
+
+/*
+    Overviews of a Grid2D: level 0 is the base grid, and each level is downsampled 2x from the level before,
+    until the level has one cell. Cell (r, c) of a level reduces the cells [2r, 2r+1] x [2c, 2c+1] of the level
+    before, clipped at the borders, so all of the levels have the same start as the base grid.
+    The base grid is shared, not copied. Rows of a level are reduced in parallel.
+*/
+template <typename T>
+class Grid2DPyramid
+{
+public:
+    enum Reducer
+    {
+        REDUCE_MEAN = 0,
+        REDUCE_MIN = 1,
+        REDUCE_MAX = 2,
+        REDUCE_NEAREST = 3   /*the cell (2r, 2c). */
+    };
+
+    Grid2DPyramid(): _has_nodata(false), _nodata(T())
+    {
+    }
+
+    ~Grid2DPyramid()
+    {
+    }
+
+    /*Cells of the no data value are skipped by the reducers, a cell is no data if all of its cells are. */
+    void setNoData(const T& nodata)
+    {
+        _has_nodata = true;
+        _nodata = nodata;
+    }
+
+    /*Build the levels of base, the levels stop at max_levels if it is positive. */
+    void build(const Grid2D<T>& base, Reducer reducer = REDUCE_MEAN, int max_levels = -1)
+    {
+        clear();
+        _levels.push_back(base);
+        while (max_levels <= 0 || levelCount() < max_levels) {
+            const Grid2D<T>& src = _levels.back();
+            if (src.rowCount() <= 1 && src.colCount() <= 1) {
+                break;
+            }
+            Grid2D<T> dst;
+            dst.initialize2(src.get_xStart(), src.get_yStart(), 2.0 * src.get_dx(), 2.0 * src.get_dy(),
+                (src.rowCount() + 1) / 2, (src.colCount() + 1) / 2);
+            reduce(src, dst, reducer);
+            _levels.push_back(dst);
+        }
+    }
+
+    int levelCount() const
+    {
+        return _levels.size();
+    }
+
+    const Grid2D<T>& getLevel(int level) const
+    {
+        return _levels[level];
+    }
+
+    /*Cell size of a level, the larger of dx and dy. */
+    double getResolution(int level) const
+    {
+        return MAXV(std::abs(_levels[level].get_dx()), std::abs(_levels[level].get_dy()));
+    }
+
+    /*The coarsest level whose cells are not larger than res, level 0 if res is finer than the base grid. */
+    int levelForResolution(double res) const
+    {
+        if (_levels.empty()) {
+            return -1;
+        }
+        const double ratio = res / getResolution(0);
+        if (!(ratio >= 2.0)) {
+            return 0;
+        }
+        int level = int(std::floor(std::log(ratio) / std::log(2.0) + 1e-9));
+        return MINV(level, levelCount() - 1);
+    }
+
+    const Grid2D<T>& getLevelForResolution(double res) const
+    {
+        return _levels[levelForResolution(res)];
+    }
+
+    void clear()
+    {
+        _levels.clear();
+    }
+
+protected:
+    bool isData(const T& v) const
+    {
+        return !_has_nodata || !(v == _nodata);
+    }
+
+    static T castMean(double v)
+    {
+        return std::numeric_limits<T>::is_integer ? T(std::floor(v + 0.5)) : T(v);
+    }
+
+    void reduce(const Grid2D<T>& src, Grid2D<T>& dst, Reducer reducer) const
+    {
+        const int src_rn = src.rowCount();
+        const int src_cn = src.colCount();
+        const int rn = dst.rowCount();
+        const int cn = dst.colCount();
+        const T nodata = _has_nodata ? _nodata : T();
+
+#pragma omp parallel for schedule(dynamic, 16)
+        for (int r = 0; r < rn; ++r) {
+            const T* row0 = src[2 * r];
+            const T* row1 = (2 * r + 1 < src_rn) ? src[2 * r + 1] : NULL;
+            T* out = dst[r];
+            for (int c = 0; c < cn; ++c) {
+                if (reducer == REDUCE_NEAREST) {
+                    out[c] = row0[2 * c];
+                    continue;
+                }
+
+                T v[4];
+                int n = 0;
+                const int c0 = 2 * c, c1 = 2 * c + 1;
+                if (isData(row0[c0])) v[n++] = row0[c0];
+                if (c1 < src_cn && isData(row0[c1])) v[n++] = row0[c1];
+                if (row1 && isData(row1[c0])) v[n++] = row1[c0];
+                if (row1 && c1 < src_cn && isData(row1[c1])) v[n++] = row1[c1];
+                if (n == 0) {
+                    out[c] = nodata;
+                    continue;
+                }
+
+                if (reducer == REDUCE_MEAN) {
+                    double sum = 0;
+                    for (int i = 0; i < n; ++i) {
+                        sum += v[i];
+                    }
+                    out[c] = castMean(sum / n);
+                } else if (reducer == REDUCE_MIN) {
+                    T m = v[0];
+                    for (int i = 1; i < n; ++i) {
+                        if (v[i] < m) m = v[i];
+                    }
+                    out[c] = m;
+                } else {
+                    T m = v[0];
+                    for (int i = 1; i < n; ++i) {
+                        if (m < v[i]) m = v[i];
+                    }
+                    out[c] = m;
+                }
+            }
+        }
+    }
+
+protected:
+    std::vector<Grid2D<T> > _levels;
+    bool _has_nodata;
+    T _nodata;
+};
+
+}
+
+#endif
@@ -15,19 +15,29 @@
 #ifndef  MPCDPS_GRID3D_H
 #define MPCDPS_GRID3D_H
 
-#include <unordered_map>
-#include <string>
-#include <sstream>
+#include <vector>
+#include <cmath>
+#include <cassert>
 #include <VectorK.h>
+#include <FlatHashMap.h>
 
 namespace mpcdps {
 
-template<typename CellType>
+/*A sparse 3D grid of cells, keyed by the packed integer index of the cell.
+ * The index of a cell is floor((v - origin) / resolution) on each axis, computed in double.
+ * The key of cell (ix, iy, iz) is ix | iy << AXIS_BITS | iz << (2 * AXIS_BITS), where each index
+ * is offset by 2^(AXIS_BITS - 1) so that negative indices are kept, 3 * AXIS_BITS <= 63.
+ * So the index of each axis must be in [-2^(AXIS_BITS - 1), 2^(AXIS_BITS - 1)), +-2^20 cells by default,
+ * a cell out of range would alias another cell. Set the origin near the points, e.g. for projected coordinates,
+ * and check isInRange for points which may be far away, getIndexKey asserts it.
+ */
+template<typename CellType, int AXIS_BITS = 21>
 class Grid3D
 {
 public:
     Grid3D()
     {
+        _origin[0] = _origin[1] = _origin[2] = 0;
     }
 
     ~Grid3D()
@@ -36,51 +46,164 @@ public:
     }
 
     typedef Vector3<int> Index;
+    typedef FlatHashMap<CellType> Container;
 
-    void seResolution(float resolution)
+    void setResolution(float resolution)
     {
         _resolution = resolution;
     }
 
-    std::string getIndexKey(float x, float y, float z) const
+    void seResolution(float resolution)
+    {
+        setResolution(resolution);
+    }
+
+    float getResolution() const
+    {
+        return _resolution;
+    }
+
+    /*Origin of cell (0, 0, 0), default: (0, 0, 0).
+     * The cells within +-2^(AXIS_BITS - 1) cells of the origin can be keyed, e.g. +-104.8 km at 0.1 m by default.
+     */
+    void setOrigin(double x, double y, double z)
+    {
+        _origin[0] = x;
+        _origin[1] = y;
+        _origin[2] = z;
+    }
+
+    Index getIndex(double x, double y, double z) const
+    {
+        return Index(get_index(x, 0), get_index(y, 1), get_index(z, 2));
+    }
+
+    /*Whether the cell of the point, or the cell of index, can be keyed. */
+    bool isInRange(double x, double y, double z) const
     {
-        float ix = x / _resolution;
-        float iy = y / _resolution;
-        float iz = z / _resolution;
-        return get_string(ix) + "_" + get_string(iy) + "_" + get_string(iz);
+        return in_range(x, 0) && in_range(y, 1) && in_range(z, 2);
     }
 
-    CellType& getCell(const std::string& key)
+    static bool isInRange(const Index& index)
+    {
+        const int bias = 1 << (AXIS_BITS - 1);
+        return index[0] >= -bias && index[0] < bias && index[1] >= -bias && index[1] < bias &&
+            index[2] >= -bias && index[2] < bias;
+    }
+
+    uint64 getIndexKey(double x, double y, double z) const
+    {
+        assert(isInRange(x, y, z));
+        return pack(get_index(x, 0), get_index(y, 1), get_index(z, 2));
+    }
+
+    uint64 getIndexKey(const Index& index) const
+    {
+        assert(isInRange(index));
+        return pack(index[0], index[1], index[2]);
+    }
+
+    Index getIndex(uint64 key) const
+    {
+        const uint64 mask = (uint64(1) << AXIS_BITS) - 1;
+        const int bias = 1 << (AXIS_BITS - 1);
+        return Index(int(key & mask) - bias, int((key >> AXIS_BITS) & mask) - bias,
+            int((key >> (2 * AXIS_BITS)) & mask) - bias);
+    }
+
+    /*Keys of n points, pts is (x, y, z) of each point. Computed in parallel. */
+    template<typename T>
+    void getIndexKeys(const T* pts, int n, uint64* keys) const
+    {
+#pragma omp parallel for
+        for (int i = 0; i < n; ++i) {
+            keys[i] = getIndexKey(pts[i * 3], pts[i * 3 + 1], pts[i * 3 + 2]);
+        }
+    }
+
+    CellType& getCell(uint64 key)
     {
         return _data[key];
     }
 
-    CellType getCell(const std::string& key) const
+    CellType getCell(uint64 key) const
+    {
+        return *_data.find(key);
+    }
+
+    /*The cell of key, NULL if it does not exist. */
+    CellType* findCell(uint64 key)
+    {
+        return _data.find(key);
+    }
+
+    const CellType* findCell(uint64 key) const
+    {
+        return _data.find(key);
+    }
+
+    /*Get the cells of n keys, the cells not existing are inserted.
+     * The table is reserved before inserting, so the cells are valid until the next insertion.
+     */
+    void getCells(const uint64* keys, int n, CellType** cells)
+    {
+        _data.reserve(_data.size() + n);
+        for (int i = 0; i < n; ++i) {
+            cells[i] = &_data[keys[i]];
+        }
+    }
+
+    /*Find the cells of n keys in parallel, NULL for the cells not existing. */
+    void findCells(const uint64* keys, int n, const CellType** cells) const
+    {
+#pragma omp parallel for
+        for (int i = 0; i < n; ++i) {
+            cells[i] = _data.find(keys[i]);
+        }
+    }
+
+    void reserve(int n)
+    {
+        _data.reserve(n);
+    }
+
+    void clear()
     {
-        auto iter = _data.find(key);
-        return iter->second;
+        _data.clear();
     }
 
-    const auto& container() const
+    const Container& container() const
     {
         return _data;
     }
 
 protected:
-    std::string get_string(float v) const
+    int get_index(double v, int axis) const
+    {
+        return int(std::floor((v - _origin[axis]) / _resolution));
+    }
+
+    bool in_range(double v, int axis) const
+    {
+        const double i = std::floor((v - _origin[axis]) / _resolution);
+        const double bias = double(1 << (AXIS_BITS - 1));
+        return i >= -bias && i < bias;
+    }
+
+    static uint64 pack(int ix, int iy, int iz)
     {
-        int n = v;
-        if (v < 0) --n;
-        std::ostringstream strm;
-        strm << n;
-        return strm.str();
+        const uint64 mask = (uint64(1) << AXIS_BITS) - 1;
+        const int bias = 1 << (AXIS_BITS - 1);
+        return (uint64(ix + bias) & mask) | ((uint64(iy + bias) & mask) << AXIS_BITS) |
+            ((uint64(iz + bias) & mask) << (2 * AXIS_BITS));
     }
 
 protected:
     float _resolution = 0;
-    std::unordered_map<std::string, CellType> _data;
+    double _origin[3];
+    Container _data;
 };
 
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -44,6 +44,8 @@ public:
 	}
 
 	std::vector<int> elemList() const { return _elem_ids; }
+	/*the element ids without copy, for the searches. */
+	const std::vector<int>& elemIds() const { return _elem_ids; }
 	bool isLeafNode() const { return true; }
 
 private:
@@ -375,8 +377,8 @@ int KDTree<T, K, K1>::searchNearest(const T* elem, double radius, double& dist2)
 			continue;
 		}
 		if (node->isLeafNode()) {
-			KDTreeLeafNode* leaf = dynamic_cast <KDTreeLeafNode*>(node);
-			std::vector<int> ids = leaf->elemList();
+			KDTreeLeafNode* leaf = static_cast <KDTreeLeafNode*>(node);
+			const std::vector<int>& ids = leaf->elemIds();
 			double d2;
 			ElemType elemi;
 			for (int i = 0; i < ids.size(); ++i) {
@@ -432,8 +434,8 @@ std::vector<int> KDTree<T, K, K1>::searchKNearest(
 			continue;
 		}
 		if (node->isLeafNode()) {
-			KDTreeLeafNode* leaf = dynamic_cast <KDTreeLeafNode*>(node);
-			std::vector<int> ids = leaf->elemList();
+			KDTreeLeafNode* leaf = static_cast <KDTreeLeafNode*>(node);
+			const std::vector<int>& ids = leaf->elemIds();
 			double d2;
 			ElemType elemi;
 			for (int i = 0; i < ids.size(); ++i) {
@@ -482,8 +484,6 @@ std::vector<int> KDTree<T, K, K1>::searchRadius(
 	stk.push(_root);
 	const double dist2 = radius * radius;
 
-	std::vector<int> ids;
-
 	while (!stk.empty()) {
 		node = stk.top();
 		stk.pop();
@@ -491,8 +491,8 @@ std::vector<int> KDTree<T, K, K1>::searchRadius(
 			continue;
 		}
 		if (node->isLeafNode()) {
-			KDTreeLeafNode* leaf = dynamic_cast <KDTreeLeafNode*>(node);
-			ids = leaf->elemList();
+			KDTreeLeafNode* leaf = static_cast <KDTreeLeafNode*>(node);
+			const std::vector<int>& ids = leaf->elemIds();
 			double d2;
 			ElemType elemi;
 			for (int i = 0; i < ids.size(); ++i) {
@@ -507,7 +507,8 @@ std::vector<int> KDTree<T, K, K1>::searchRadius(
 			KDTreeBranchNode* branch = dynamic_cast <KDTreeBranchNode*>(node);
 			int dim = branch->_dim;
 			double d = branch->_key - elem[dim];
-			if (d * d < dist2) {
+			/*elements on the split key can be on both sides, and an element at the radius is found. */
+			if (d * d <= dist2) {
 				stk.push(branch->leftChild());
 				stk.push(branch->rightChild());
 			} else {
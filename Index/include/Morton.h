@@ -0,0 +1,122 @@
+/*
+**********************************************************************
+*
+* This file is a part of library MPCDPS(Massive Point Cloud Data Processing System).
+* It is a free program and it is protected by the license GPL-v3.0, you may not use the
+* file except in compliance with the License.
+*
+* Copyright(c) 2013 - 2020 Xu Shengpan, all rights reserved.
+*
+* Email: jack_1227x@163.com
+*
+**********************************************************************
+*/
+
+#ifndef  MPCDPS_MORTON_H
+#define MPCDPS_MORTON_H
+
+#include "PublicInfo.h"
+
+namespace mpcdps {
+
+    /*Spread the lower 21 bits of v so that there are two zero bits between each two bits. */
+    inline uint64 morton_split3(uint v)
+    {
+        uint64 x = v & 0x1fffff;
+        x = (x | x << 32) & 0x1f00000000ffffULL;
+        x = (x | x << 16) & 0x1f0000ff0000ffULL;
+        x = (x | x << 8) & 0x100f00f00f00f00fULL;
+        x = (x | x << 4) & 0x10c30c30c30c30c3ULL;
+        x = (x | x << 2) & 0x1249249249249249ULL;
+        return x;
+    }
+
+    /*Inverse of morton_split3. */
+    inline uint morton_compact3(uint64 x)
+    {
+        x &= 0x1249249249249249ULL;
+        x = (x ^ (x >> 2)) & 0x10c30c30c30c30c3ULL;
+        x = (x ^ (x >> 4)) & 0x100f00f00f00f00fULL;
+        x = (x ^ (x >> 8)) & 0x1f0000ff0000ffULL;
+        x = (x ^ (x >> 16)) & 0x1f00000000ffffULL;
+        x = (x ^ (x >> 32)) & 0x1fffff;
+        return uint(x);
+    }
+
+    /*63-bit Morton code of the cell (ix, iy, iz), 21 bits for each axis.
+     * In each group of 3 bits, x is the lowest bit and z is the highest bit,
+     * so the octant of a group is iz * 4 + iy * 2 + ix.
+     */
+    inline uint64 morton_encode3(uint ix, uint iy, uint iz)
+    {
+        return morton_split3(ix) | (morton_split3(iy) << 1) | (morton_split3(iz) << 2);
+    }
+
+    inline void morton_decode3(uint64 code, uint& ix, uint& iy, uint& iz)
+    {
+        ix = morton_compact3(code);
+        iy = morton_compact3(code >> 1);
+        iz = morton_compact3(code >> 2);
+    }
+
+    /*Spread the 32 bits of v so that there is one zero bit between each two bits. */
+    inline uint64 morton_split2(uint v)
+    {
+        uint64 x = v;
+        x = (x | x << 16) & 0x0000ffff0000ffffULL;
+        x = (x | x << 8) & 0x00ff00ff00ff00ffULL;
+        x = (x | x << 4) & 0x0f0f0f0f0f0f0f0fULL;
+        x = (x | x << 2) & 0x3333333333333333ULL;
+        x = (x | x << 1) & 0x5555555555555555ULL;
+        return x;
+    }
+
+    /*64-bit Morton code of the cell (ix, iy), 32 bits for each axis. */
+    inline uint64 morton_encode2(uint ix, uint iy)
+    {
+        return morton_split2(ix) | (morton_split2(iy) << 1);
+    }
+
+    /*32-bit Hilbert code of the cell (ix, iy), 16 bits for each axis.
+     * Cells close on the curve are closer in space than by the Morton order, as the curve has no jumps,
+     * the code is computed by the bit-parallel prefix scan of the curve states, without a loop over levels.
+     */
+    inline uint hilbert_encode2(uint ix, uint iy)
+    {
+        ix &= 0xffff;
+        iy &= 0xffff;
+        uint a = ix ^ iy;
+        uint b = 0xffff ^ a;
+        uint c = 0xffff ^ (ix | iy);
+        uint d = ix & (iy ^ 0xffff);
+
+        uint A = a | (b >> 1);
+        uint B = (a >> 1) ^ a;
+        uint C = ((c >> 1) ^ (b & (d >> 1))) ^ c;
+        uint D = ((a & (c >> 1)) ^ (d >> 1)) ^ d;
+
+        a = A; b = B; c = C; d = D;
+        A = (a & (a >> 2)) ^ (b & (b >> 2));
+        B = (a & (b >> 2)) ^ (b & ((a ^ b) >> 2));
+        C ^= (a & (c >> 2)) ^ (b & (d >> 2));
+        D ^= (b & (c >> 2)) ^ ((a ^ b) & (d >> 2));
+
+        a = A; b = B; c = C; d = D;
+        A = (a & (a >> 4)) ^ (b & (b >> 4));
+        B = (a & (b >> 4)) ^ (b & ((a ^ b) >> 4));
+        C ^= (a & (c >> 4)) ^ (b & (d >> 4));
+        D ^= (b & (c >> 4)) ^ ((a ^ b) & (d >> 4));
+
+        a = A; b = B; c = C; d = D;
+        C ^= (a & (c >> 8)) ^ (b & (d >> 8));
+        D ^= (b & (c >> 8)) ^ ((a ^ b) & (d >> 8));
+
+        a = C ^ (C >> 1);
+        b = D ^ (D >> 1);
+        uint i0 = ix ^ iy;
+        uint i1 = b | (0xffff ^ (i0 | a));
+        return uint((morton_split2(i1 & 0xffff) << 1) | morton_split2(i0 & 0xffff));
+    }
+}
+
+#endif
@@ -16,99 +16,99 @@
 #define MPCDPS_OCTREE_H
 
 #include <vector>
-#include <stack>
+#include <deque>
+#include <algorithm>
+#include <unordered_map>
+#include <random>
+#include <cmath>
 #include "Box3.h"
 #include "SmartArray2D.h"
-#include "SmartPointer.h"
 #include "BoxGetter.h"
 #include "PublicFunc.h"
+#include "Morton.h"
 
 namespace mpcdps {
 
-class OctreeNode
-{
-public:
-    OctreeNode() {}
-    virtual ~OctreeNode() {}
-
-    Box3f box;
-    virtual bool isLeaf() const = 0;
-};
-
-class OctreeBranchNode: public OctreeNode
+/*Node of the linear octree.
+ * The points of a node are [begin, end) of the Morton ordered point ids of the tree,
+ * the children of a branch node are stored contiguously from first_child.
+ */
+template<typename T>
+struct OctreeNode
 {
-public:
-    OctreeBranchNode()
-    {
-        for (int i = 0; i < 8; ++i) {
-            children[i] = NULL;
-        }
-    }
+    Box3<T> box;        /*bounding box of the points in the node, in the type of the points. */
+    uint64 key;         /*Morton code prefix of the node cell. */
+    int level;          /*0 for root. */
+    int begin;
+    int end;
+    int first_child;    /*-1 for leaf. */
+    int child_count;
 
-    ~OctreeBranchNode()
+    bool isLeaf() const
     {
-        for (int i = 0; i < 8; ++i) {
-            if (children[i]) {
-                delete children[i];
-                children[i] = NULL;
-            }
-        }
+        return first_child < 0;
     }
 
-    virtual bool isLeaf() const
+    int size() const
     {
-        return false;
+        return end - begin;
     }
-
-    OctreeNode* children[8];
 };
 
-class OctreeLeafNode : public OctreeNode
+/*A linear octree.
+ * Points are sorted by the 63-bit Morton code of their cell in the root box (21 bits for each axis),
+ * each node is a range of the sorted points, and the level of a node selects the bits of its key.
+ */
+template<typename T>
+class Octree
 {
 public:
-    OctreeLeafNode(){}
-    ~OctreeLeafNode(){}
+    enum { MAX_LEVEL = 21 };
 
-    virtual bool isLeaf() const
-    {
-        return true;
-    }
+    /*Sampling methods of level of detail. */
+    enum { LOD_GRID = 0, LOD_POISSON = 1 };
 
-    std::vector<int> ptids;
-};
-
-template<typename T>
-class Octree
-{
 protected:
-    SmartArray2D<T, 3> _points;
+    SmartArray2D<T, 3> _points;      /*point storage, its capacity may be larger than _point_count. */
+    int _point_count;
+    bool _points_shared;             /*_points is shared with the caller of build. */
     int _min_points_per_node;
     T _max_leaf_size[3];
+    int _parallel_threshold;
 
-    SmartPointer<OctreeNode> _root;
+    double _origin[3];  /*min corner of the root cell. */
+    double _length[3];  /*size of the root cell. */
+    double _scale[3];   /*quantization scale, cells per unit length at MAX_LEVEL. */
 
-protected:
-    struct StackNode
-    {
-        StackNode() :branch_node(NULL) {}
-        StackNode(OctreeBranchNode* bn, const std::vector<int>& ptids_node)
-            : branch_node(bn), ptids(ptids_node)
-        {
-        }
-        StackNode(const StackNode& rth)
-            :branch_node(rth.branch_node), ptids(rth.ptids)
-        {
+    std::vector<uint64> _codes;      /*Morton codes in ascending order if _packed. */
+    std::vector<int> _ptids;         /*point ids ordered as _codes. */
+    std::vector<OctreeNode<T> > _nodes;  /*_nodes[0] is root. */
 
-        }
+    /*scratch of _codes and _ptids while building, the large nodes are partitioned into their ranges in parallel. */
+    std::vector<uint64> _split_codes;
+    std::vector<int> _split_ids;
 
-        OctreeBranchNode* branch_node;
-        std::vector<int> ptids;
-    };
+    /*After insert or evict, _codes and _nodes have holes which are counted as garbage,
+     * and the point ranges of branch nodes are invalid until compact.
+     */
+    int _garbage;
+    int _garbage_nodes;
+    bool _packed;
+
+    std::vector<int> _lod_offsets;   /*LOD sample of node i is _lod_ids[_lod_offsets[i], _lod_offsets[i+1]). */
+    std::vector<int> _lod_ids;
+    std::vector<double> _lod_spacing;
 
 public:
-    Octree()
+    Octree(): _point_count(0), _points_shared(false), _min_points_per_node(1), _parallel_threshold(100000),
+        _garbage(0), _garbage_nodes(0), _packed(true)
     {
-        _root = NULL;
+        for (int i = 0; i < 3; ++i) {
+            _max_leaf_size[i] = 1;
+            _origin[i] = 0;
+            _length[i] = 0;
+            _scale[i] = 0;
+        }
     }
 
     ~Octree()
@@ -127,40 +127,332 @@ public:
         _max_leaf_size[2] = max_shape[2];
     }
 
+    /*Subtrees with more points than n are built by separate OpenMP tasks, default: 100000. */
+    void setParallelThreshold(int n)
+    {
+        _parallel_threshold = n;
+    }
+
     void build(const SmartArray2D<T, 3>& points, std::vector<int> ptids = std::vector<int>())
     {
+        clear();
         if (ptids.empty()) {
             ptids = make_vector<int>(points.size());
         }
         _points = points;
+        _point_count = points.size();
+        _points_shared = true;
+        if (ptids.empty()) {
+            return;
+        }
 
-        auto box = getBox(ptids);
+        _ptids.swap(ptids);
+        buildNodes(getBox());
+    }
 
-        if (!isSplit(box, ptids.size())) {
-            OctreeLeafNode* node = new OctreeLeafNode;
-            node->box = box;
-            node->ptids = ptids;
-            _root = node;
+    /*Restore a tree built by build() from its nodes, the points are in the order of its point ids,
+     * so the point ids are 0 ... n - 1 and the nodes are used as they are, e.g. a tree stored in a file.
+     * The root cell is the box of the root node as in build(), only the Morton codes are computed.
+     */
+    void restore(const SmartArray2D<T, 3>& points, std::vector<OctreeNode<T> > nodes)
+    {
+        clear();
+        _points = points;
+        _point_count = points.size();
+        _points_shared = true;
+        if (nodes.empty()) {
             return;
         }
 
-        OctreeBranchNode* branch = new OctreeBranchNode;
-        branch->box = box;
-        _root = branch;
+        const int n = _point_count;
+        _ptids = make_vector<int>(n);
+        _nodes.swap(nodes);
+        initializeCell(_nodes[0].box);
+        _codes.resize(n);
+#pragma omp parallel for
+        for (int i = 0; i < n; ++i) {
+            _codes[i] = getMortonCode(_points[i]);
+        }
+    }
+
+    /*Insert points into the tree, return the id of the first inserted point, ids of the points
+     * are consecutive. The points are copied, point ids of the tree are kept.
+     * Points are merged into the leaves they fall in, and only the leaves which exceed the split rules
+     * are split, the ranges of the updated leaves are moved to the end of the point ids,
+     * and the holes are compacted when they are more than the live points.
+     * If any point is out of the root cell, the tree is rebuilt in a root cell enlarged at least twice.
+     * The LOD samples are cleared.
+     */
+    int insert(const SmartArray2D<T, 3>& points)
+    {
+        const int first_id = _point_count;
+        const int m = points.size();
+        if (m == 0) {
+            return first_id;
+        }
+        appendPoints(points);
+        clearLOD();
+
+        std::vector<int> new_ids = make_vector<int>(m);
+        for (int i = 0; i < m; ++i) {
+            new_ids[i] += first_id;
+        }
+
+        if (_nodes.empty()) {
+            _ptids.swap(new_ids);
+            buildNodes(getBox());
+            return first_id;
+        }
+
+        BoxGetter bg;
+        for (int i = 0; i < m; ++i) {
+            const T* vtx = _points[first_id + i];
+            bg.add_point(vtx[0], vtx[1], vtx[2]);
+        }
+        const Box3<T> box = bg.getBox<T>();
+        if (!cellContains(box)) {
+            rebuildCell(box, new_ids);
+            return first_id;
+        }
+
+        std::vector<uint64> codes(m);
+#pragma omp parallel for
+        for (int i = 0; i < m; ++i) {
+            codes[i] = getMortonCode(_points[new_ids[i]]);
+        }
+        sort_radix_syn(codes, new_ids);
+        insertSorted(codes, new_ids);
+
+        if (_garbage > int(_codes.size()) - _garbage || _garbage_nodes > int(_nodes.size()) - _garbage_nodes) {
+            compact();
+        }
+        return first_id;
+    }
+
+    /*Remove the nodes disjoint with roi with their points, return the count of points removed.
+     * Nodes intersecting roi are kept with all of their points. The storage of removed points is kept
+     * so that point ids are still valid, call compact with old_ids to release it.
+     */
+    int evict(const Box3<T>& roi)
+    {
+        if (_nodes.empty()) {
+            return 0;
+        }
+        clearLOD();
 
-        std::stack<StackNode> stk;
-        stk.push(StackNode(branch, ptids));
+        int removed = 0;
+        if (boxRelation(_nodes[0].box, roi) == 0) {
+            removed = int(_codes.size()) - _garbage;
+            _codes.clear();
+            _ptids.clear();
+            _nodes.clear();
+            _garbage = 0;
+            _garbage_nodes = 0;
+            _packed = true;
+            return removed;
+        }
 
+        std::vector<int> stk(1, 0);
         while (!stk.empty()) {
-            StackNode node = stk.top();
-            stk.pop();
-            node_split(node, stk);
+            OctreeNode<T>& node = _nodes[stk.back()];
+            stk.pop_back();
+            if (node.isLeaf()) {
+                continue;
+            }
+            int count = 0;
+            for (int i = 0; i < node.child_count; ++i) {
+                int child_id = node.first_child + i;
+                if (boxRelation(_nodes[child_id].box, roi) == 0) {
+                    removed += removeSubtree(child_id);
+                } else {
+                    _nodes[node.first_child + count] = _nodes[child_id];
+                    stk.push_back(node.first_child + count);
+                    ++count;
+                }
+            }
+            _garbage_nodes += node.child_count - count;
+            node.child_count = count;
+            if (count == 0) {
+                node.first_child = -1;
+                node.begin = node.end = 0;
+            }
         }
+
+        if (removed > 0) {
+            _packed = false;
+        }
+        return removed;
+    }
+
+    /*Remove the holes of the nodes and the point ids left by insert and evict, so that the point ranges
+     * of branch nodes are valid and the point ids are in Morton order again. Node ids are changed.
+     * If old_ids is not NULL, the point storage is compacted too, the points are renumbered in Morton order
+     * and (*old_ids)[i] is the old id of point i.
+     */
+    void compact(std::vector<int>* old_ids = NULL)
+    {
+        clearLOD();
+        if (_nodes.empty()) {
+            if (old_ids) {
+                old_ids->clear();
+                _points.clear();
+                _point_count = 0;
+            }
+            return;
+        }
+
+        std::vector<OctreeNode<T> > nodes(1, _nodes[0]);
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            if (nodes[i].isLeaf()) {
+                continue;
+            }
+            int first_child = nodes.size();
+            for (int j = 0; j < nodes[i].child_count; ++j) {
+                nodes.push_back(_nodes[nodes[i].first_child + j]);
+            }
+            nodes[i].first_child = first_child;
+        }
+
+        std::vector<uint64> codes;
+        std::vector<int> ptids;
+        codes.reserve(_codes.size() - _garbage);
+        ptids.reserve(_codes.size() - _garbage);
+        std::vector<std::pair<uint64, int> > leaf_points;
+        std::vector<int> stk(1, 0);
+        while (!stk.empty()) {
+            OctreeNode<T>& node = nodes[stk.back()];
+            stk.pop_back();
+            if (!node.isLeaf()) {
+                for (int i = node.child_count - 1; i >= 0; --i) {
+                    stk.push_back(node.first_child + i);
+                }
+                continue;
+            }
+            leaf_points.clear();
+            for (int i = node.begin; i < node.end; ++i) {
+                leaf_points.push_back(std::make_pair(_codes[i], _ptids[i]));
+            }
+            std::sort(leaf_points.begin(), leaf_points.end());
+            node.begin = codes.size();
+            for (size_t i = 0; i < leaf_points.size(); ++i) {
+                codes.push_back(leaf_points[i].first);
+                ptids.push_back(leaf_points[i].second);
+            }
+            node.end = codes.size();
+        }
+        for (int i = int(nodes.size()) - 1; i >= 0; --i) {
+            if (!nodes[i].isLeaf()) {
+                nodes[i].begin = nodes[nodes[i].first_child].begin;
+                nodes[i].end = nodes[nodes[i].first_child + nodes[i].child_count - 1].end;
+            }
+        }
+
+        _nodes.swap(nodes);
+        _codes.swap(codes);
+        _ptids.swap(ptids);
+        _garbage = 0;
+        _garbage_nodes = 0;
+        _packed = true;
+
+        if (old_ids) {
+            const int n = _ptids.size();
+            SmartArray2D<T, 3> points(n);
+#pragma omp parallel for
+            for (int i = 0; i < n; ++i) {
+                const T* vtx = _points[_ptids[i]];
+                points[i][0] = vtx[0];
+                points[i][1] = vtx[1];
+                points[i][2] = vtx[2];
+            }
+            old_ids->swap(_ptids);
+            _ptids = make_vector<int>(n);
+            _points = points;
+            _point_count = n;
+            _points_shared = false;
+        }
+    }
+
+    void clear()
+    {
+        _points.clear();
+        _point_count = 0;
+        _points_shared = false;
+        _codes.clear();
+        _ptids.clear();
+        _nodes.clear();
+        _garbage = 0;
+        _garbage_nodes = 0;
+        _packed = true;
+        clearLOD();
+    }
+
+    void clearLOD()
+    {
+        _lod_offsets.clear();
+        _lod_ids.clear();
+        _lod_spacing.clear();
+    }
+
+    bool hasLOD() const
+    {
+        return !_lod_offsets.empty();
+    }
+
+    bool empty() const
+    {
+        return _nodes.empty();
+    }
+
+    const OctreeNode<T>* getRoot() const
+    {
+        return _nodes.empty() ? NULL : &_nodes[0];
+    }
+
+    int nodeCount() const
+    {
+        return _nodes.size();
+    }
+
+    const OctreeNode<T>& getNode(int i) const
+    {
+        return _nodes[i];
     }
 
-    const OctreeNode* getRoot() const
+    /*All nodes, the root is the first. */
+    const std::vector<OctreeNode<T> >& getNodes() const
     {
-        return _root;
+        return _nodes;
+    }
+
+    /*The i'th child of node, i < node.child_count. */
+    const OctreeNode<T>& getChild(const OctreeNode<T>& node, int i) const
+    {
+        return _nodes[node.first_child + i];
+    }
+
+    /*Octant of the node in its parent: iz * 4 + iy * 2 + ix. */
+    int getOctant(const OctreeNode<T>& node) const
+    {
+        return (node.level == 0) ? 0 : int((node.key >> (3 * (MAX_LEVEL - node.level))) & 7);
+    }
+
+    /*Point ids in Morton order, the points of node are [node.begin, node.end).
+     * If the tree is not packed, only the ranges of leaves are valid.
+     */
+    const std::vector<int>& getPointIds() const
+    {
+        return _ptids;
+    }
+
+    bool isPacked() const
+    {
+        return _packed;
+    }
+
+    /*Count of stored points, including the points removed by evict. */
+    int pointCount() const
+    {
+        return _point_count;
     }
 
     const T* getVertex(int ptid) const
@@ -168,34 +460,901 @@ public:
         return _points[ptid];
     }
 
+    /*Morton code of the point in the root cell. */
+    uint64 getMortonCode(const T* pt) const
+    {
+        uint q[3];
+        double t;
+        for (int i = 0; i < 3; ++i) {
+            t = (pt[i] - _origin[i]) * _scale[i];
+            if (t <= 0) {
+                q[i] = 0;
+            } else if (t >= double(1 << MAX_LEVEL)) {
+                q[i] = (1 << MAX_LEVEL) - 1;
+            } else {
+                q[i] = uint(t);
+            }
+        }
+        return morton_encode3(q[0], q[1], q[2]);
+    }
+
+    /*The cell of a node, which contains the bounding box of the node. */
+    Box3<T> getCellBox(const OctreeNode<T>& node) const
+    {
+        uint q[3];
+        morton_decode3(node.key, q[0], q[1], q[2]);
+        const double s = 1.0 / double(1 << node.level);
+        T vmin[3], vmax[3];
+        for (int i = 0; i < 3; ++i) {
+            double len = _length[i] * s;
+            double v0 = _origin[i] + (q[i] >> (MAX_LEVEL - node.level)) * len;
+            vmin[i] = v0;
+            vmax[i] = v0 + len;
+        }
+        return Box3<T>(vmin, vmax);
+    }
+
+    /*Search elements within radius, return the count of elements found.
+     * ids and dist2_list are cleared before searching, so they can be reused between queries
+     * without allocation. dist2 is square distance.
+     */
+    int searchRadius(const T* pt, double radius,
+        std::vector<int>& ids, std::vector<double>& dist2_list) const
+    {
+        ids.clear();
+        dist2_list.clear();
+        if (_nodes.empty()) {
+            return 0;
+        }
+
+        const double r2 = radius * radius;
+        int stk[STACK_SIZE];
+        int top = 0;
+        stk[top++] = 0;
+        double d2;
+        while (top > 0) {
+            const OctreeNode<T>& node = _nodes[stk[--top]];
+            if (boxDistance2(node.box, pt) > r2) {
+                continue;
+            }
+            if (node.isLeaf()) {
+                for (int i = node.begin; i < node.end; ++i) {
+                    d2 = squareDistance(_points[_ptids[i]], pt);
+                    if (d2 <= r2) {
+                        ids.push_back(_ptids[i]);
+                        dist2_list.push_back(d2);
+                    }
+                }
+            } else {
+                for (int i = 0; i < node.child_count; ++i) {
+                    stk[top++] = node.first_child + i;
+                }
+            }
+        }
+        return ids.size();
+    }
+
+    /*Search elements within radius, return element ids, the same as KDTree::searchRadius. */
+    std::vector<int> searchRadius(const T* pt, double radius, std::vector<double>& dist2_list) const
+    {
+        std::vector<int> ids;
+        searchRadius(pt, radius, ids, dist2_list);
+        return ids;
+    }
+
+    /*Search the nearest element with radius, return element id.
+     * If no element found, return -1. The element at the address pt is skipped, as KDTree does.
+     */
+    int searchNearest(const T* pt, double radius, double& dist2) const
+    {
+        dist2 = radius * radius;
+        if (_nodes.empty()) {
+            return -1;
+        }
+
+        int id = -1;
+        int stk[STACK_SIZE];
+        int top = 0;
+        stk[top++] = 0;
+        double d2;
+        const T* vtx;
+        while (top > 0) {
+            const OctreeNode<T>& node = _nodes[stk[--top]];
+            if (boxDistance2(node.box, pt) > dist2) {
+                continue;
+            }
+            if (node.isLeaf()) {
+                for (int i = node.begin; i < node.end; ++i) {
+                    vtx = _points[_ptids[i]];
+                    if (vtx == pt) {
+                        continue;
+                    }
+                    d2 = squareDistance(vtx, pt);
+                    if (d2 <= dist2) {
+                        dist2 = d2;
+                        id = _ptids[i];
+                    }
+                }
+            } else {
+                top = pushChildren(node, pt, stk, top);
+            }
+        }
+        return id;
+    }
+
+    /*Search k nearest elements with radius, return the count of elements found.
+     * ids and dist2_list are sorted by distance ascending, and are reused as in searchRadius.
+     */
+    int searchKNearest(const T* pt, int k, double radius,
+        std::vector<int>& ids, std::vector<double>& dist2_list) const
+    {
+        ids.clear();
+        dist2_list.clear();
+        if (_nodes.empty() || k <= 0) {
+            return 0;
+        }
+
+        double bound = radius * radius;
+        int stk[STACK_SIZE];
+        int top = 0;
+        stk[top++] = 0;
+        double d2;
+        while (top > 0) {
+            const OctreeNode<T>& node = _nodes[stk[--top]];
+            if (boxDistance2(node.box, pt) > bound) {
+                continue;
+            }
+            if (node.isLeaf()) {
+                for (int i = node.begin; i < node.end; ++i) {
+                    d2 = squareDistance(_points[_ptids[i]], pt);
+                    if (d2 > bound) {
+                        continue;
+                    }
+                    int j = ids.size();
+                    if (j < k) {
+                        ids.push_back(0);
+                        dist2_list.push_back(0);
+                    } else {
+                        --j;
+                    }
+                    while (j > 0 && dist2_list[j - 1] > d2) {
+                        ids[j] = ids[j - 1];
+                        dist2_list[j] = dist2_list[j - 1];
+                        --j;
+                    }
+                    ids[j] = _ptids[i];
+                    dist2_list[j] = d2;
+                    if (int(ids.size()) == k) {
+                        bound = dist2_list[k - 1];
+                    }
+                }
+            } else {
+                top = pushChildren(node, pt, stk, top);
+            }
+        }
+        return ids.size();
+    }
+
+    /*Search k nearest elements with radius, return element ids, the same as KDTree::searchKNearest. */
+    std::vector<int> searchKNearest(const T* pt, int k, double radius, std::vector<double>& dist2_list) const
+    {
+        std::vector<int> ids;
+        searchKNearest(pt, k, radius, ids, dist2_list);
+        return ids;
+    }
+
+    /*Search elements within box, return the count of elements found. ids is cleared before searching. */
+    int searchBox(const Box3<T>& box, std::vector<int>& ids) const
+    {
+        ids.clear();
+        if (_nodes.empty()) {
+            return 0;
+        }
+
+        int stk[STACK_SIZE];
+        int top = 0;
+        stk[top++] = 0;
+        const T* vtx;
+        while (top > 0) {
+            const OctreeNode<T>& node = _nodes[stk[--top]];
+            int rel = boxRelation(node.box, box);
+            if (rel == 0) {
+                continue;
+            }
+            if (rel == 2 && (_packed || node.isLeaf())) {
+                ids.insert(ids.end(), _ptids.begin() + node.begin, _ptids.begin() + node.end);
+            } else if (node.isLeaf()) {
+                for (int i = node.begin; i < node.end; ++i) {
+                    vtx = _points[_ptids[i]];
+                    if (vtx[0] >= box.min(0) && vtx[0] <= box.max(0) &&
+                        vtx[1] >= box.min(1) && vtx[1] <= box.max(1) &&
+                        vtx[2] >= box.min(2) && vtx[2] <= box.max(2)) {
+                        ids.push_back(_ptids[i]);
+                    }
+                }
+            } else {
+                for (int i = 0; i < node.child_count; ++i) {
+                    stk[top++] = node.first_child + i;
+                }
+            }
+        }
+        return ids.size();
+    }
+
+    /*Traverse the ray (origin, dir), collect the leaf nodes it passes through, front to back.
+     * t_list is the ray parameter where the ray enters each node, dir is not required to be normalized.
+     */
+    int traverseRay(const T* origin, const T* dir,
+        std::vector<int>& node_ids, std::vector<double>& t_list) const
+    {
+        return traverseRay(origin, dir, 0, node_ids, t_list);
+    }
+
+    /*Search elements whose distance to the ray (origin, dir) is within radius, sorted by t ascending,
+     * where origin + t * dir is the projection of the element on the ray, t >= 0.
+     */
+    int searchRay(const T* origin, const T* dir, double radius,
+        std::vector<int>& ids, std::vector<double>& t_list) const
+    {
+        ids.clear();
+        t_list.clear();
+        if (_nodes.empty()) {
+            return 0;
+        }
+
+        const double dd = double(dir[0]) * dir[0] + double(dir[1]) * dir[1] + double(dir[2]) * dir[2];
+        if (dd <= 0) {
+            return 0;
+        }
+
+        const double r2 = radius * radius;
+        int stk[STACK_SIZE];
+        int top = 0;
+        stk[top++] = 0;
+        double tmin, v[3], t, d2;
+        const T* vtx;
+        while (top > 0) {
+            const OctreeNode<T>& node = _nodes[stk[--top]];
+            if (!rayIntersects(node.box, origin, dir, radius, tmin)) {
+                continue;
+            }
+            if (node.isLeaf()) {
+                for (int i = node.begin; i < node.end; ++i) {
+                    vtx = _points[_ptids[i]];
+                    for (int j = 0; j < 3; ++j) {
+                        v[j] = double(vtx[j]) - origin[j];
+                    }
+                    t = (v[0] * dir[0] + v[1] * dir[1] + v[2] * dir[2]) / dd;
+                    if (t < 0) {
+                        continue;
+                    }
+                    d2 = 0;
+                    for (int j = 0; j < 3; ++j) {
+                        d2 += Square(v[j] - t * dir[j]);
+                    }
+                    if (d2 <= r2) {
+                        ids.push_back(_ptids[i]);
+                        t_list.push_back(t);
+                    }
+                }
+            } else {
+                for (int i = 0; i < node.child_count; ++i) {
+                    stk[top++] = node.first_child + i;
+                }
+            }
+        }
+        sort_shell_syn(t_list, ids);
+        return ids.size();
+    }
+
+    /*Batch searchRadius of the queries, run in parallel.
+     * The result of query i is ids[offsets[i], offsets[i+1]), offsets has queries.size() + 1 elements.
+     */
+    void searchRadius(const SmartArray2D<T, 3>& queries, double radius,
+        std::vector<int>& offsets, std::vector<int>& ids) const
+    {
+        const int n = queries.size();
+        const int n_block = MINV(n, 256);
+        const int block_size = (n_block > 0) ? (n + n_block - 1) / n_block : 0;
+        std::vector<std::vector<int> > block_ids(n_block);
+        offsets.assign(n + 1, 0);
+
+#pragma omp parallel for schedule(dynamic, 1)
+        for (int b = 0; b < n_block; ++b) {
+            std::vector<int> ids1;
+            std::vector<double> dist2s;
+            int end = MINV(n, (b + 1) * block_size);
+            for (int i = b * block_size; i < end; ++i) {
+                offsets[i + 1] = searchRadius(queries[i], radius, ids1, dist2s);
+                block_ids[b].insert(block_ids[b].end(), ids1.begin(), ids1.end());
+            }
+        }
+
+        for (int i = 0; i < n; ++i) {
+            offsets[i + 1] += offsets[i];
+        }
+        ids.resize(offsets[n]);
+
+#pragma omp parallel for
+        for (int b = 0; b < n_block; ++b) {
+            if (!block_ids[b].empty()) {
+                std::copy(block_ids[b].begin(), block_ids[b].end(), ids.begin() + offsets[b * block_size]);
+            }
+        }
+    }
+
+    /*Batch searchKNearest of the queries, run in parallel.
+     * The result of query i is ids[i*k, i*k+k) and dist2_list[i*k, i*k+k), padded by -1 and -1.0
+     * when less than k elements are found.
+     */
+    void searchKNearest(const SmartArray2D<T, 3>& queries, int k, double radius,
+        std::vector<int>& ids, std::vector<double>& dist2_list) const
+    {
+        const int n = queries.size();
+        ids.assign(size_t(n) * k, -1);
+        dist2_list.assign(size_t(n) * k, -1.0);
+
+#pragma omp parallel
+        {
+            std::vector<int> ids1;
+            std::vector<double> dist2s;
+            ids1.reserve(k);
+            dist2s.reserve(k);
+
+#pragma omp for schedule(dynamic, 256)
+            for (int i = 0; i < n; ++i) {
+                int m = searchKNearest(queries[i], k, radius, ids1, dist2s);
+                for (int j = 0; j < m; ++j) {
+                    ids[size_t(i) * k + j] = ids1[j];
+                    dist2_list[size_t(i) * k + j] = dist2s[j];
+                }
+            }
+        }
+    }
+
+    /*Build the level of detail sample of each node bottom up, with at most max_points for each node.
+     * A node keeps all of its candidates if they are not more than max_points, the candidates
+     * of a leaf are its points and those of a branch are the samples of its children.
+     * Otherwise the candidates are sampled by method: LOD_GRID keeps the nearest point to the center
+     * of each grid cell, LOD_POISSON keeps points no closer than the spacing, where the spacing
+     * is enlarged until the sample fits max_points. Nodes of a level are sampled in parallel.
+     */
+    void buildLOD(int max_points, int method = LOD_GRID)
+    {
+        clearLOD();
+        if (_nodes.empty() || max_points <= 0) {
+            return;
+        }
+
+        const int n = _nodes.size();
+        std::vector<std::vector<int> > levels;
+        for (int i = 0; i < n; ++i) {
+            if (int(levels.size()) <= _nodes[i].level) {
+                levels.resize(_nodes[i].level + 1);
+            }
+            levels[_nodes[i].level].push_back(i);
+        }
+
+        std::vector<std::vector<int> > samples(n);
+        _lod_spacing.assign(n, 0);
+        for (int l = int(levels.size()) - 1; l >= 0; --l) {
+            const std::vector<int>& node_ids = levels[l];
+            const int m = node_ids.size();
+#pragma omp parallel for schedule(dynamic, 16)
+            for (int i = 0; i < m; ++i) {
+                sampleNode(node_ids[i], max_points, method, samples);
+            }
+        }
+
+        _lod_offsets.assign(n + 1, 0);
+        for (int i = 0; i < n; ++i) {
+            _lod_offsets[i + 1] = _lod_offsets[i] + samples[i].size();
+        }
+        _lod_ids.resize(_lod_offsets[n]);
+#pragma omp parallel for
+        for (int i = 0; i < n; ++i) {
+            std::copy(samples[i].begin(), samples[i].end(), _lod_ids.begin() + _lod_offsets[i]);
+        }
+    }
+
+    /*Point ids of the LOD sample of a node. */
+    int getLODPoints(int node_id, std::vector<int>& ids) const
+    {
+        ids.assign(_lod_ids.begin() + _lod_offsets[node_id], _lod_ids.begin() + _lod_offsets[node_id + 1]);
+        return ids.size();
+    }
+
+    /*Sampling distance of the LOD sample of a node, 0 if it contains all the points of the node. */
+    double getLODSpacing(int node_id) const
+    {
+        return _lod_spacing[node_id];
+    }
+
+    /*Search the nodes whose LOD samples make up the view from eye within error_budget.
+     * The projected error of a node is its spacing divided by the distance from eye to its box,
+     * a node is selected if its error is within error_budget or it is a leaf, otherwise its children
+     * are visited. The selected samples do not overlap. Nodes disjoint with region are skipped if it is not NULL.
+     */
+    int searchLODNodes(const T* eye, double error_budget, std::vector<int>& node_ids,
+        const Box3<T>* region = NULL) const
+    {
+        node_ids.clear();
+        if (_nodes.empty() || !hasLOD()) {
+            return 0;
+        }
+
+        int stk[STACK_SIZE];
+        int top = 0;
+        stk[top++] = 0;
+        while (top > 0) {
+            int node_id = stk[--top];
+            const OctreeNode<T>& node = _nodes[node_id];
+            if (region && boxRelation(node.box, *region) == 0) {
+                continue;
+            }
+            double d = std::sqrt(boxDistance2(node.box, eye));
+            if (node.isLeaf() || _lod_spacing[node_id] <= error_budget * d) {
+                node_ids.push_back(node_id);
+            } else {
+                for (int i = node.child_count - 1; i >= 0; --i) {
+                    stk[top++] = node.first_child + i;
+                }
+            }
+        }
+        return node_ids.size();
+    }
+
+    /*Search the points of the LOD samples selected by searchLODNodes, the points are clipped by region. */
+    int searchLOD(const T* eye, double error_budget, std::vector<int>& ids,
+        const Box3<T>* region = NULL) const
+    {
+        ids.clear();
+        std::vector<int> node_ids;
+        searchLODNodes(eye, error_budget, node_ids, region);
+        const T* vtx;
+        for (size_t i = 0; i < node_ids.size(); ++i) {
+            int begin = _lod_offsets[node_ids[i]];
+            int end = _lod_offsets[node_ids[i] + 1];
+            if (!region) {
+                ids.insert(ids.end(), _lod_ids.begin() + begin, _lod_ids.begin() + end);
+                continue;
+            }
+            for (int j = begin; j < end; ++j) {
+                vtx = _points[_lod_ids[j]];
+                if (vtx[0] >= region->min(0) && vtx[0] <= region->max(0) &&
+                    vtx[1] >= region->min(1) && vtx[1] <= region->max(1) &&
+                    vtx[2] >= region->min(2) && vtx[2] <= region->max(2)) {
+                    ids.push_back(_lod_ids[j]);
+                }
+            }
+        }
+        return ids.size();
+    }
+
 protected:
+    enum { STACK_SIZE = 8 * (MAX_LEVEL + 1) };
 
-    inline int getIndex(T v, T v0) const
+    static double squareDistance(const T* p0, const T* p1)
     {
-        return (v < v0) ? 0 : 1;
+        double d = 0, d1;
+        for (int i = 0; i < 3; ++i) {
+            d1 = double(p0[i]) - p1[i];
+            d += d1 * d1;
+        }
+        return d;
     }
 
-    inline int getIndex(T* pt, float cnt[3]) const
+    static double boxDistance2(const Box3<T>& box, const T* pt)
     {
-        int ix = getIndex(pt[0], cnt[0]);
-        int iy = getIndex(pt[1], cnt[1]);
-        int iz = getIndex(pt[2], cnt[2]);
-        return (iz * 4 + iy * 2 + ix);
+        double d = 0, d1;
+        for (int i = 0; i < 3; ++i) {
+            if (pt[i] < box.min(i)) {
+                d1 = double(box.min(i)) - pt[i];
+                d += d1 * d1;
+            } else if (pt[i] > box.max(i)) {
+                d1 = double(pt[i]) - box.max(i);
+                d += d1 * d1;
+            }
+        }
+        return d;
     }
 
-    mpcdps::Box3f getBox(const std::vector<int>& ptids) const
+    /*0: disjoint, 1: intersected, 2: node box is contained by box.
+     * The node boxes bound their points exactly in T, so the points of a contained node are copied
+     * without tests, and boxDistance2 is never more than the distance to a point of the node.
+     */
+    static int boxRelation(const Box3<T>& node_box, const Box3<T>& box)
     {
-        BoxGetter bg;
-        T* vtx = NULL;
-        for (auto ptid: ptids) {
-            vtx = _points[ptid];
-            bg.add_point(vtx[0], vtx[1], vtx[2]);
+        bool contained = true;
+        for (int i = 0; i < 3; ++i) {
+            if (node_box.min(i) > box.max(i) || node_box.max(i) < box.min(i)) {
+                return 0;
+            }
+            if (node_box.min(i) < box.min(i) || node_box.max(i) > box.max(i)) {
+                contained = false;
+            }
+        }
+        return contained ? 2 : 1;
+    }
+
+    /*Slab test of the ray with the box expanded by radius, tmin is the entering parameter. */
+    static bool rayIntersects(const Box3<T>& box, const T* origin, const T* dir, double radius, double& tmin)
+    {
+        double t0 = 0, t1 = DBL_MAX, inv, ta, tb;
+        for (int i = 0; i < 3; ++i) {
+            double vmin = box.min(i) - radius;
+            double vmax = box.max(i) + radius;
+            if (dir[i] == 0) {
+                if (origin[i] < vmin || origin[i] > vmax) {
+                    return false;
+                }
+                continue;
+            }
+            inv = 1.0 / dir[i];
+            ta = (vmin - origin[i]) * inv;
+            tb = (vmax - origin[i]) * inv;
+            if (ta > tb) {
+                SWAP(ta, tb);
+            }
+            if (ta > t0) t0 = ta;
+            if (tb < t1) t1 = tb;
+            if (t0 > t1) {
+                return false;
+            }
+        }
+        tmin = t0;
+        return true;
+    }
+
+    int traverseRay(const T* origin, const T* dir, double radius,
+        std::vector<int>& node_ids, std::vector<double>& t_list) const
+    {
+        node_ids.clear();
+        t_list.clear();
+        if (_nodes.empty()) {
+            return 0;
+        }
+
+        int stk[STACK_SIZE];
+        int top = 0;
+        stk[top++] = 0;
+        double tmin;
+        while (top > 0) {
+            int node_id = stk[--top];
+            const OctreeNode<T>& node = _nodes[node_id];
+            if (!rayIntersects(node.box, origin, dir, radius, tmin)) {
+                continue;
+            }
+            if (node.isLeaf()) {
+                node_ids.push_back(node_id);
+                t_list.push_back(tmin);
+            } else {
+                for (int i = 0; i < node.child_count; ++i) {
+                    stk[top++] = node.first_child + i;
+                }
+            }
+        }
+        sort_shell_syn(t_list, node_ids);
+        return node_ids.size();
+    }
+
+    /*Push the children of node to stk, the nearest child to pt is pushed last. */
+    int pushChildren(const OctreeNode<T>& node, const T* pt, int* stk, int top) const
+    {
+        double dist[8];
+        int ids[8];
+        int n = node.child_count, j;
+        for (int i = 0; i < n; ++i) {
+            double d = boxDistance2(_nodes[node.first_child + i].box, pt);
+            for (j = i; j > 0 && dist[j - 1] < d; --j) {
+                dist[j] = dist[j - 1];
+                ids[j] = ids[j - 1];
+            }
+            dist[j] = d;
+            ids[j] = node.first_child + i;
+        }
+        for (int i = 0; i < n; ++i) {
+            stk[top++] = ids[i];
+        }
+        return top;
+    }
+
+    /*Build the nodes of _ptids in the root cell. */
+    void buildNodes(const Box3<T>& cell)
+    {
+        _codes.clear();
+        _nodes.clear();
+        _garbage = 0;
+        _garbage_nodes = 0;
+        _packed = true;
+        const int n = _ptids.size();
+
+        OctreeNode<T> root;
+        root.key = 0;
+        root.level = 0;
+        root.begin = 0;
+        root.end = n;
+        root.first_child = -1;
+        root.child_count = 0;
+        root.box = getBox();
+        initializeCell(cell);
+
+        _codes.resize(n);
+#pragma omp parallel for
+        for (int i = 0; i < n; ++i) {
+            _codes[i] = getMortonCode(_points[_ptids[i]]);
+        }
+
+        _nodes.push_back(root);
+        if (isSplit(getCellBox(root), n)) {
+            if (n >= _parallel_threshold) {
+                _split_codes.resize(n);
+                _split_ids.resize(n);
+            }
+#pragma omp parallel
+            {
+#pragma omp single
+                buildSubtree(_nodes);
+            }
+            std::vector<uint64>().swap(_split_codes);
+            std::vector<int>().swap(_split_ids);
+        }
+    }
+
+    /*Copy points to the end of the point storage, which grows geometrically. */
+    void appendPoints(const SmartArray2D<T, 3>& points)
+    {
+        const int m = points.size();
+        if (_points_shared || _point_count + m > int(_points.size())) {
+            int capacity = MAXV(_point_count + m, 2 * _point_count);
+            SmartArray2D<T, 3> buffer(capacity);
+            if (_point_count > 0) {
+                std::copy(_points.buffer(), _points.buffer() + size_t(_point_count) * 3, buffer.buffer());
+            }
+            _points = buffer;
+            _points_shared = false;
+        }
+        std::copy(points.buffer(), points.buffer() + size_t(m) * 3, _points.buffer() + size_t(_point_count) * 3);
+        _point_count += m;
+    }
+
+    bool cellContains(const Box3<T>& box) const
+    {
+        for (int i = 0; i < 3; ++i) {
+            if (box.min(i) < _origin[i] || box.max(i) > _origin[i] + _length[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*Rebuild the tree with the live points and new_ids, in the root cell enlarged to contain box. */
+    void rebuildCell(const Box3<T>& box, std::vector<int>& new_ids)
+    {
+        std::vector<int> ptids;
+        ptids.reserve(_codes.size() - _garbage + new_ids.size());
+        std::vector<int> stk(1, 0);
+        while (!stk.empty()) {
+            const OctreeNode<T>& node = _nodes[stk.back()];
+            stk.pop_back();
+            if (node.isLeaf()) {
+                ptids.insert(ptids.end(), _ptids.begin() + node.begin, _ptids.begin() + node.end);
+            } else {
+                for (int i = 0; i < node.child_count; ++i) {
+                    stk.push_back(node.first_child + i);
+                }
+            }
+        }
+        ptids.insert(ptids.end(), new_ids.begin(), new_ids.end());
+
+        /*the axes out of the cell are enlarged to twice of the union with box, so that
+         * the tree is rebuilt O(log) times for points moving away.
+         */
+        T vmin[3], vmax[3];
+        for (int i = 0; i < 3; ++i) {
+            double v0 = MINV(double(box.min(i)), _origin[i]);
+            double v1 = MAXV(double(box.max(i)), _origin[i] + _length[i]);
+            if (v0 >= _origin[i] && v1 <= _origin[i] + _length[i]) {
+                vmin[i] = v0;
+                vmax[i] = v1;
+                continue;
+            }
+            double len = 2 * MAXV(v1 - v0, _length[i]);
+            vmin[i] = 0.5 * (v0 + v1 - len);
+            vmax[i] = 0.5 * (v0 + v1 + len);
+        }
+
+        _ptids.swap(ptids);
+        buildNodes(Box3<T>(vmin, vmax));
+    }
+
+    /*Insert the new points sorted by Morton codes into the nodes. */
+    void insertSorted(const std::vector<uint64>& codes, const std::vector<int>& ptids)
+    {
+        struct Range { int node_id, begin, end; };
+        std::vector<Range> stk;
+        Range range = { 0, 0, int(codes.size()) };
+        stk.push_back(range);
+
+        while (!stk.empty()) {
+            range = stk.back();
+            stk.pop_back();
+            const int node_id = range.node_id;
+
+            BoxGetter bg;
+            if (_nodes[node_id].size() > 0 || !_nodes[node_id].isLeaf()) {
+                const Box3<T>& box = _nodes[node_id].box;
+                bg.add_point(box.min(0), box.min(1), box.min(2));
+                bg.add_point(box.max(0), box.max(1), box.max(2));
+            }
+            for (int i = range.begin; i < range.end; ++i) {
+                const T* vtx = _points[ptids[i]];
+                bg.add_point(vtx[0], vtx[1], vtx[2]);
+            }
+            _nodes[node_id].box = bg.getBox<T>();
+
+            if (_nodes[node_id].isLeaf()) {
+                insertLeaf(node_id, codes, ptids, range.begin, range.end);
+                continue;
+            }
+
+            /*the new points of each octant are contiguous, as they are sorted. */
+            const int shift = 3 * (MAX_LEVEL - _nodes[node_id].level - 1);
+            int head[9];
+            int k = 0;
+            head[0] = range.begin;
+            for (int i = range.begin; i < range.end; ++i) {
+                int d = int(codes[i] >> shift) & 7;
+                while (k < d) {
+                    head[++k] = i;
+                }
+            }
+            while (k < 8) {
+                head[++k] = range.end;
+            }
+
+            addChildren(node_id, head);
+            const OctreeNode<T>& node = _nodes[node_id];
+            for (int i = node.first_child; i < node.first_child + node.child_count; ++i) {
+                int d = getOctant(_nodes[i]);
+                if (head[d] < head[d + 1]) {
+                    Range child = { i, head[d], head[d + 1] };
+                    stk.push_back(child);
+                }
+            }
+        }
+    }
+
+    /*Add empty leaves for the octants of the new points which are not children of the node,
+     * the children are moved to the end of the nodes to keep them contiguous.
+     */
+    void addChildren(int node_id, const int head[9])
+    {
+        const OctreeNode<T> node = _nodes[node_id];
+        bool exists[8] = { false, false, false, false, false, false, false, false };
+        int count = node.child_count;
+        for (int i = node.first_child; i < node.first_child + node.child_count; ++i) {
+            exists[getOctant(_nodes[i])] = true;
+        }
+        for (int k = 0; k < 8; ++k) {
+            if (!exists[k] && head[k] < head[k + 1]) {
+                ++count;
+            }
+        }
+        if (count == node.child_count) {
+            return;
         }
 
-        return bg.getBox<float>();
+        const int shift = 3 * (MAX_LEVEL - node.level - 1);
+        const int first_child = _nodes.size();
+        int j = node.first_child;
+        for (int k = 0; k < 8; ++k) {
+            if (exists[k]) {
+                _nodes.push_back(_nodes[j++]);
+            } else if (head[k] < head[k + 1]) {
+                OctreeNode<T> child;
+                child.key = node.key | (uint64(k) << shift);
+                child.level = node.level + 1;
+                child.begin = child.end = _codes.size();
+                child.first_child = -1;
+                child.child_count = 0;
+                _nodes.push_back(child);
+            }
+        }
+        _garbage_nodes += node.child_count;
+        _nodes[node_id].first_child = first_child;
+        _nodes[node_id].child_count = count;
+        _packed = false;
     }
 
-    bool isSplit(const Box3f& box, int points_size) const
+    /*Move the points of the leaf and the new points [begin, end) to the end of the point ids,
+     * then split the leaf if it exceeds the split rules.
+     */
+    void insertLeaf(int node_id, const std::vector<uint64>& codes, const std::vector<int>& ptids, int begin, int end)
+    {
+        OctreeNode<T>& leaf = _nodes[node_id];
+        const int new_begin = _codes.size();
+        if (leaf.end == new_begin) {
+            /*the leaf is already at the end. */
+            _codes.insert(_codes.end(), codes.begin() + begin, codes.begin() + end);
+            _ptids.insert(_ptids.end(), ptids.begin() + begin, ptids.begin() + end);
+            leaf.end = _codes.size();
+        } else {
+            for (int i = leaf.begin; i < leaf.end; ++i) {
+                _codes.push_back(_codes[i]);
+                _ptids.push_back(_ptids[i]);
+            }
+            _codes.insert(_codes.end(), codes.begin() + begin, codes.begin() + end);
+            _ptids.insert(_ptids.end(), ptids.begin() + begin, ptids.begin() + end);
+            _garbage += leaf.size();
+            leaf.begin = new_begin;
+            leaf.end = _codes.size();
+            _packed = false;
+        }
+
+        if (leaf.level < MAX_LEVEL && isSplit(getCellBox(leaf), leaf.size())) {
+            std::vector<OctreeNode<T> > subtree(1, leaf);
+            buildSubtree(subtree);
+            appendSubtree(_nodes, node_id, subtree);
+        }
+    }
+
+    /*Count of points in the subtree, which are counted as garbage with its nodes. */
+    int removeSubtree(int node_id)
+    {
+        int count = 0;
+        std::vector<int> stk(1, node_id);
+        while (!stk.empty()) {
+            const OctreeNode<T>& node = _nodes[stk.back()];
+            stk.pop_back();
+            if (node.isLeaf()) {
+                count += node.size();
+            } else {
+                for (int i = 0; i < node.child_count; ++i) {
+                    stk.push_back(node.first_child + i);
+                }
+                _garbage_nodes += node.child_count;
+            }
+        }
+        _garbage += count;
+        return count;
+    }
+
+    void initializeCell(const Box3<T>& box)
+    {
+        for (int i = 0; i < 3; ++i) {
+            _origin[i] = box.min(i);
+            _length[i] = box.length(i);
+            _scale[i] = (_length[i] > 0) ? double(1 << MAX_LEVEL) / _length[i] : 0;
+        }
+    }
+
+    /*Bounding box of _ptids, computed in parallel by blocks. */
+    Box3<T> getBox() const
+    {
+        const int n = _ptids.size();
+        const int n_block = (n < 65536) ? 1 : 64;
+        const int block_size = (n + n_block - 1) / n_block;
+        std::vector<BoxGetter> bgs(n_block);
+
+#pragma omp parallel for
+        for (int b = 0; b < n_block; ++b) {
+            int end = MINV(n, (b + 1) * block_size);
+            T* vtx = NULL;
+            for (int i = b * block_size; i < end; ++i) {
+                vtx = _points[_ptids[i]];
+                bgs[b].add_point(vtx[0], vtx[1], vtx[2]);
+            }
+        }
+
+        for (int b = 1; b < n_block; ++b) {
+            bgs[0].add_point(bgs[b]._xmin, bgs[b]._ymin, bgs[b]._zmin);
+            bgs[0].add_point(bgs[b]._xmax, bgs[b]._ymax, bgs[b]._zmax);
+        }
+        return bgs[0].getBox<T>();
+    }
+
+    bool isSplit(const Box3<T>& box, int points_size) const
     {
         if ((box.length(0) > _max_leaf_size[0] ||
             box.length(1) > _max_leaf_size[1] ||
@@ -205,35 +1364,333 @@ protected:
             return false;
     }
 
-    void node_split(StackNode& node, std::stack<StackNode>& stk) const
+    /*Count the points of [begin, end) in each octant and get the bounding box of each octant. */
+    void countOctants(int begin, int end, int shift, int count[8], BoxGetter bgs[8]) const
+    {
+        int k;
+        T* vtx = NULL;
+        for (int i = begin; i < end; ++i) {
+            k = int(_codes[i] >> shift) & 7;
+            ++count[k];
+            vtx = _points[_ptids[i]];
+            bgs[k].add_point(vtx[0], vtx[1], vtx[2]);
+        }
+    }
+
+    /*Partition the points of node into its octants, and append the non-empty octants
+     * to nodes as children of node. The boxes of children are got in the counting pass.
+     * Small nodes are partitioned in place. Large nodes are counted by blocks in tasks, then each block
+     * scatters its points to its offsets of the octants in the scratch range of the node, which is copied back.
+     */
+    void node_split(std::vector<OctreeNode<T> >& nodes, int node_id)
+    {
+        const OctreeNode<T> node = nodes[node_id];
+        const int level = node.level + 1;
+        const int shift = 3 * (MAX_LEVEL - level);
+
+        int count[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+        BoxGetter bgs[8];
+        const int n = node.size();
+        const int n_block = 64;
+        const int block_size = (n + n_block - 1) / n_block;
+        std::vector<int> block_count;
+        if (n < _parallel_threshold) {
+            countOctants(node.begin, node.end, shift, count, bgs);
+        } else {
+            block_count.assign(n_block * 8, 0);
+            std::vector<BoxGetter> block_bgs(n_block * 8);
+            for (int b = 0; b < n_block; ++b) {
+#pragma omp task firstprivate(b) shared(block_count, block_bgs)
+                {
+                    int beg = node.begin + b * block_size;
+                    int end = MINV(node.end, beg + block_size);
+                    countOctants(beg, end, shift, &block_count[b * 8], &block_bgs[b * 8]);
+                }
+            }
+#pragma omp taskwait
+            for (int b = 0; b < n_block; ++b) {
+                for (int k = 0; k < 8; ++k) {
+                    const BoxGetter& bg = block_bgs[b * 8 + k];
+                    count[k] += block_count[b * 8 + k];
+                    if (block_count[b * 8 + k] > 0) {
+                        bgs[k].add_point(bg._xmin, bg._ymin, bg._zmin);
+                        bgs[k].add_point(bg._xmax, bg._ymax, bg._zmax);
+                    }
+                }
+            }
+        }
+
+        int head[8], tail[8];
+        head[0] = node.begin;
+        for (int k = 0; k < 8; ++k) {
+            tail[k] = head[k] + count[k];
+            if (k < 7) {
+                head[k + 1] = tail[k];
+            }
+        }
+
+        OctreeNode<T> child;
+        child.level = level;
+        child.first_child = -1;
+        child.child_count = 0;
+        const int first_child = nodes.size();
+        for (int k = 0; k < 8; ++k) {
+            if (count[k] == 0) {
+                continue;
+            }
+            child.key = node.key | (uint64(k) << shift);
+            child.begin = head[k];
+            child.end = tail[k];
+            child.box = bgs[k].getBox<T>();
+            nodes.push_back(child);
+        }
+        nodes[node_id].first_child = first_child;
+        nodes[node_id].child_count = nodes.size() - first_child;
+
+        if (!block_count.empty() && int(_split_codes.size()) >= node.end) {
+            std::vector<int> block_head(n_block * 8);
+            for (int k = 0; k < 8; ++k) {
+                int offset = head[k];
+                for (int b = 0; b < n_block; ++b) {
+                    block_head[b * 8 + k] = offset;
+                    offset += block_count[b * 8 + k];
+                }
+            }
+            for (int b = 0; b < n_block; ++b) {
+#pragma omp task firstprivate(b) shared(block_head)
+                {
+                    int* pos = &block_head[b * 8];
+                    const int beg = node.begin + b * block_size;
+                    const int end = MINV(node.end, beg + block_size);
+                    for (int i = beg; i < end; ++i) {
+                        const int j = pos[int(_codes[i] >> shift) & 7]++;
+                        _split_codes[j] = _codes[i];
+                        _split_ids[j] = _ptids[i];
+                    }
+                }
+            }
+#pragma omp taskwait
+            for (int b = 0; b < n_block; ++b) {
+#pragma omp task firstprivate(b)
+                {
+                    const int beg = node.begin + b * block_size;
+                    const int end = MINV(node.end, beg + block_size);
+                    if (beg < end) {
+                        std::copy(_split_codes.begin() + beg, _split_codes.begin() + end, _codes.begin() + beg);
+                        std::copy(_split_ids.begin() + beg, _split_ids.begin() + end, _ptids.begin() + beg);
+                    }
+                }
+            }
+#pragma omp taskwait
+            return;
+        }
+
+        int d;
+        for (int k = 0; k < 8; ++k) {
+            while (head[k] < tail[k]) {
+                d = int(_codes[head[k]] >> shift) & 7;
+                if (d == k) {
+                    ++head[k];
+                } else {
+                    std::swap(_codes[head[k]], _codes[head[d]]);
+                    std::swap(_ptids[head[k]], _ptids[head[d]]);
+                    ++head[d];
+                }
+            }
+        }
+    }
+
+    /*Build the subtree of nodes[0], whose point range and box are set.
+     * Children larger than the parallel threshold are built into their own node lists
+     * by tasks, then appended to nodes after all tasks are finished.
+     */
+    void buildSubtree(std::vector<OctreeNode<T> >& nodes)
     {
-        std::vector<std::vector<int> > ptids_children(8);
-        int k = 0;
+        std::deque<std::vector<OctreeNode<T> > > subtrees;
+        std::vector<int> subtree_roots;
 
-        Point3f cnt = node.branch_node->box.center();
-        float* cnt_ptr = cnt.buffer();
-        for (auto ptid : node.ptids) {
-            k = getIndex(_points[ptid], cnt_ptr);
-            ptids_children[k].push_back(ptid);
+        std::vector<int> stk(1, 0);
+        while (!stk.empty()) {
+            int node_id = stk.back();
+            stk.pop_back();
+            node_split(nodes, node_id);
+
+            const OctreeNode<T>& node = nodes[node_id];
+            if (node.level + 1 == MAX_LEVEL) {
+                continue;
+            }
+            for (int i = node.first_child; i < node.first_child + node.child_count; ++i) {
+                const OctreeNode<T>& child = nodes[i];
+                if (!isSplit(getCellBox(child), child.size())) {
+                    continue;
+                }
+                if (child.size() < _parallel_threshold) {
+                    stk.push_back(i);
+                } else {
+                    subtrees.push_back(std::vector<OctreeNode<T> >(1, child));
+                    subtree_roots.push_back(i);
+                    std::vector<OctreeNode<T> >* subtree = &subtrees.back();
+#pragma omp task firstprivate(subtree)
+                    buildSubtree(*subtree);
+                }
+            }
         }
 
-        for (int i = 0; i < 8; ++i) {
-            auto box = getBox(ptids_children[i]);
-            if (isSplit(box, ptids_children[i].size())) {
-                OctreeBranchNode* branch = new OctreeBranchNode;
-                branch->box = box;
-                stk.push(StackNode(branch, ptids_children[i]));
-                node.branch_node->children[i] = branch;
-            } else if(!ptids_children[i].empty()){
-                OctreeLeafNode* leaf = new OctreeLeafNode;
-                leaf->box = box;
-                leaf->ptids = ptids_children[i];
-                node.branch_node->children[i] = leaf;
+#pragma omp taskwait
+        for (size_t s = 0; s < subtrees.size(); ++s) {
+            appendSubtree(nodes, subtree_roots[s], subtrees[s]);
+        }
+    }
+
+    /*Append the nodes of subtree, whose root is nodes[root_id], to nodes. */
+    static void appendSubtree(std::vector<OctreeNode<T> >& nodes, int root_id, const std::vector<OctreeNode<T> >& subtree)
+    {
+        const int offset = int(nodes.size()) - 1;
+        nodes[root_id].first_child = subtree[0].first_child + offset;
+        nodes[root_id].child_count = subtree[0].child_count;
+        for (size_t i = 1; i < subtree.size(); ++i) {
+            nodes.push_back(subtree[i]);
+            if (!subtree[i].isLeaf()) {
+                nodes.back().first_child += offset;
+            }
+        }
+    }
+
+    /*Key of the sampling cell (ix + dx, iy + dy, iz + dz) of size s from origin. */
+    static uint64 sampleCellKey(const int64* q, int dx, int dy, int dz)
+    {
+        const int64 bias = int64(1) << 20;
+        const uint64 mask = (uint64(1) << 21) - 1;
+        return (uint64(q[0] + dx + bias) & mask) | ((uint64(q[1] + dy + bias) & mask) << 21) |
+            ((uint64(q[2] + dz + bias) & mask) << 42);
+    }
+
+    static void sampleCell(const T* pt, const double* origin, double s, int64* q)
+    {
+        for (int i = 0; i < 3; ++i) {
+            q[i] = int64(std::floor((pt[i] - origin[i]) / s));
+        }
+    }
+
+    /*Keep the nearest candidate to the center of each grid cell of size s. */
+    void gridSample(const std::vector<int>& candidates, const double* origin, double s,
+        std::vector<int>& sample) const
+    {
+        sample.clear();
+        std::vector<double> dist2s;
+        std::unordered_map<uint64, int> cells;
+        int64 q[3];
+        double center[3];
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            const T* vtx = _points[candidates[i]];
+            sampleCell(vtx, origin, s, q);
+            double d2 = 0;
+            for (int j = 0; j < 3; ++j) {
+                center[j] = origin[j] + (q[j] + 0.5) * s;
+                d2 += Square(vtx[j] - center[j]);
+            }
+            std::pair<std::unordered_map<uint64, int>::iterator, bool> res =
+                cells.insert(std::make_pair(sampleCellKey(q, 0, 0, 0), int(sample.size())));
+            if (res.second) {
+                sample.push_back(candidates[i]);
+                dist2s.push_back(d2);
+            } else if (d2 < dist2s[res.first->second]) {
+                sample[res.first->second] = candidates[i];
+                dist2s[res.first->second] = d2;
+            }
+        }
+    }
+
+    /*Poisson disk sampling of the candidates in a random order, keep points no closer than s. */
+    void poissonSample(const std::vector<int>& candidates, const double* origin, double s,
+        std::vector<int>& sample, unsigned int seed) const
+    {
+        sample.clear();
+        std::vector<int> order(candidates);
+        std::mt19937 rng(seed);
+        std::shuffle(order.begin(), order.end(), rng);
+
+        const double s2 = s * s;
+        std::unordered_map<uint64, std::vector<int> > cells;
+        std::unordered_map<uint64, std::vector<int> >::const_iterator iter;
+        int64 q[3];
+        for (size_t i = 0; i < order.size(); ++i) {
+            const T* vtx = _points[order[i]];
+            sampleCell(vtx, origin, s, q);
+            bool accepted = true;
+            for (int dz = -1; dz <= 1 && accepted; ++dz) {
+                for (int dy = -1; dy <= 1 && accepted; ++dy) {
+                    for (int dx = -1; dx <= 1 && accepted; ++dx) {
+                        iter = cells.find(sampleCellKey(q, dx, dy, dz));
+                        if (iter == cells.end()) {
+                            continue;
+                        }
+                        for (size_t j = 0; j < iter->second.size(); ++j) {
+                            if (squareDistance(_points[iter->second[j]], vtx) < s2) {
+                                accepted = false;
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+            if (accepted) {
+                cells[sampleCellKey(q, 0, 0, 0)].push_back(order[i]);
+                sample.push_back(order[i]);
+            }
+        }
+    }
+
+    /*LOD sample of a node from its points or the samples of its children, see buildLOD. */
+    void sampleNode(int node_id, int max_points, int method, std::vector<std::vector<int> >& samples)
+    {
+        const OctreeNode<T>& node = _nodes[node_id];
+        std::vector<int> candidates;
+        double spacing = 0;
+        if (node.isLeaf()) {
+            candidates.assign(_ptids.begin() + node.begin, _ptids.begin() + node.end);
+        } else {
+            for (int i = node.first_child; i < node.first_child + node.child_count; ++i) {
+                candidates.insert(candidates.end(), samples[i].begin(), samples[i].end());
+                spacing = MAXV(spacing, _lod_spacing[i]);
+            }
+        }
+
+        std::vector<int>& sample = samples[node_id];
+        if (int(candidates.size()) <= max_points) {
+            sample.swap(candidates);
+            _lod_spacing[node_id] = spacing;
+            return;
+        }
+
+        const Box3<T> cell = getCellBox(node);
+        double origin[3];
+        double len = 0;
+        for (int i = 0; i < 3; ++i) {
+            origin[i] = cell.min(i);
+            len = MAXV(len, double(cell.length(i)));
+        }
+        if (!(len > 0)) {
+            len = 1e-6;
+        }
+
+        /*start from the spacing of a surface filled by max_points. */
+        double s = len / std::ceil(std::sqrt(double(max_points)));
+        while (1) {
+            if (method == LOD_POISSON) {
+                poissonSample(candidates, origin, s, sample, node_id);
+            } else {
+                gridSample(candidates, origin, s, sample);
+            }
+            if (int(sample.size()) <= max_points) {
+                break;
             }
+            s *= 1.26;
         }
+        _lod_spacing[node_id] = MAXV(spacing, s);
     }
 };
 
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,255 @@
+/*
+**********************************************************************
+*
+* This file is a part of library MPCDPS(Massive Point Cloud Data Processing System).
+* It is a free program and it is protected by the license GPL-v3.0, you may not use the
+* file except in compliance with the License.
+*
+* Copyright(c) 2013 - 2020 Xu Shengpan, all rights reserved.
+*
+* Email: jack_1227x@163.com
+*
+**********************************************************************
+*/
+
+#ifndef  MPCDPS_OUTOFCOREOCTREE_H
+#define MPCDPS_OUTOFCOREOCTREE_H
+
+#include <cstdio>
+#include <cmath>
+#include <climits>
+#include <string>
+#include <vector>
+#include "Octree.h"
+#include "LRUCache.h"
+#include "SmartPointer.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+namespace mpcdps {
+
+    /*Reader of a point stream, which reads points batch by batch. */
+    template<typename T>
+    class PointStreamReader
+    {
+    public:
+        virtual ~PointStreamReader() {}
+
+        /*Read at most n points into buffer as (x, y, z), return the count of points read, 0 at the end. */
+        virtual int read(T* buffer, int n) = 0;
+
+        /*Go back to the first point. */
+        virtual void rewind() = 0;
+    };
+
+    /*Reader of a binary file of (x, y, z) records of type T. */
+    template<typename T>
+    class BinaryPointReader : public PointStreamReader<T>
+    {
+    public:
+        BinaryPointReader() :_file(NULL) {}
+        ~BinaryPointReader() { close(); }
+
+        bool open(const std::string& path)
+        {
+            close();
+            _file = fopen(path.c_str(), "rb");
+            return _file != NULL;
+        }
+
+        void close()
+        {
+            if (_file) {
+                fclose(_file);
+                _file = NULL;
+            }
+        }
+
+        int read(T* buffer, int n)
+        {
+            return _file ? int(fread(buffer, sizeof(T) * 3, n, _file)) : 0;
+        }
+
+        void rewind()
+        {
+            if (_file) {
+                ::rewind(_file);
+            }
+        }
+
+    protected:
+        FILE* _file;
+    };
+
+    /*Entry of a chunk in the index of an out-of-core octree.
+     * A chunk is an octree cell (level, key) of the root box, its points are stored
+     * in the Morton order of the octree built on them, followed by the nodes of the octree.
+     */
+    struct OctreeChunk
+    {
+        uint64 key;          /*Morton code prefix of the chunk cell. */
+        int level;           /*level of the chunk cell, 0 for root. */
+        int node_count;      /*count of the octree nodes after the points, 0 in version 1 files. */
+        uint64 point_count;
+        uint64 first_point;  /*global id of the first point of the chunk. */
+        uint64 offset;       /*byte offset of the points in the chunk file. */
+        double box[6];       /*bounding box of the points: xmin, ymin, zmin, xmax, ymax, zmax. */
+    };
+
+    /*Builder of an out-of-core octree.
+     * Points are streamed from a reader in bounded memory:
+     *   1. count the points on a grid of 128^3 cells of the root box;
+     *   2. merge the counts into chunks, which are the largest octree cells
+     *      with no more than the maximum chunk points;
+     *   3. distribute the points into temporary chunk files;
+     *   4. split the chunks of more points the same way on a 128^3 grid of their cells,
+     *      counted from their temporary files, until no chunk has more than the maximum chunk points;
+     *   5. build an Octree on each chunk with the node/leaf split rules, and write the chunk
+     *      as its points in Morton order and the octree nodes.
+     * Chunks are written into a single container file, or into a directory with one file for each chunk.
+     */
+    template<typename T>
+    class OutOfCoreOctreeBuilder
+    {
+    public:
+        OutOfCoreOctreeBuilder();
+        ~OutOfCoreOctreeBuilder();
+
+        enum { COUNT_LEVEL = 7 };
+
+        void setMinPointsForNode(int n) { _min_points_per_node = n; }
+
+        void setMaxLeafShape(T max_shape[3])
+        {
+            for (int i = 0; i < 3; ++i) {
+                _max_leaf_size[i] = max_shape[i];
+            }
+        }
+
+        /*Maximum points of a chunk, default: 1000000.
+         * The points of a cell of the finest octree level are cut into several chunks if they are more.
+         */
+        void setMaxChunkPoints(int n) { _max_chunk_points = n; }
+
+        /*Memory budget in bytes for the point buffers while streaming, default: 256MB. */
+        void setMemoryBudget(size_t bytes) { _memory_budget = bytes; }
+
+        /*Set the root box, otherwise it is got by an extra pass over the points in each build. */
+        void setBox(const Box3<T>& box) { _box = box; _has_box = true; }
+
+        /*Build the octree of the points from reader.
+         * If single_file, path is the container file, otherwise path is the directory of chunk files.
+         */
+        bool build(PointStreamReader<T>& reader, const std::string& path, bool single_file = true);
+
+    protected:
+        bool computeBox(PointStreamReader<T>& reader);
+
+        /*Split the cell (level, key) of the points of reader into chunks and their temporary files,
+         * counted on a grid of COUNT_LEVEL levels below the cell, or less at the finest level.
+         */
+        bool splitCell(PointStreamReader<T>& reader, int level, uint64 key,
+            std::vector<OctreeChunk>& chunks, std::vector<std::string>& tmp_files);
+        void countPoints(PointStreamReader<T>& reader, int level, std::vector<uint64>& counts);
+        void createChunks(const std::vector<uint64>& counts, int level, uint64 key,
+            std::vector<OctreeChunk>& chunks, std::vector<int>& cell_chunks);
+        bool distributePoints(PointStreamReader<T>& reader, int level, const std::vector<int>& cell_chunks,
+            const std::vector<std::string>& tmp_files);
+        bool cutChunk(PointStreamReader<T>& reader, const OctreeChunk& chunk,
+            std::vector<OctreeChunk>& chunks, std::vector<std::string>& tmp_files);
+        bool writeChunk(int chunk_id, const std::string& tmp_file, FILE* out, uint64& offset);
+
+        /*Morton code of the point at the finest level of the root box. */
+        uint64 getCode(const T* pt) const;
+        static int countDepth(int level);
+        static uint64 getCountCell(uint64 code, int level);
+
+    protected:
+        int _min_points_per_node;
+        T _max_leaf_size[3];
+        int _max_chunk_points;
+        size_t _memory_budget;
+        Box3<T> _box;
+        bool _has_box;    /*_box is set by setBox. */
+
+        std::vector<OctreeChunk> _chunks;
+        std::string _tmp_base;
+        int _tmp_count;
+    };
+
+    /*An out-of-core octree, which pages the chunks written by OutOfCoreOctreeBuilder through a LRU cache.
+     * Point ids of the queries are global ids: first_point of the chunk plus the index in the chunk.
+     * It is not thread safe.
+     */
+    template<typename T>
+    class OutOfCoreOctree
+    {
+    public:
+        OutOfCoreOctree();
+        ~OutOfCoreOctree();
+
+        typedef Octree<T> ChunkTree;
+
+        /*Open a container file or a directory written by OutOfCoreOctreeBuilder. */
+        bool open(const std::string& path);
+
+        void close();
+
+        /*Memory budget in bytes of the paged chunks, default: 1GB. */
+        void setMemoryBudget(size_t bytes) { _cache.setBudget(bytes); }
+
+        size_t memoryUsage() const { return _cache.usage(); }
+
+        int chunkCount() const { return _chunks.size(); }
+
+        const OctreeChunk& getChunk(int i) const { return _chunks[i]; }
+
+        uint64 pointCount() const { return _point_count; }
+
+        Box3<T> getBox() const { return _box; }
+
+        /*Octree of the chunk, paged in if it is not cached. Return NULL if it can not be read.
+         * The tree is restored from the points and the nodes of the chunk without splitting the nodes again,
+         * a chunk of a version 1 file has no nodes and its tree is rebuilt from the points.
+         */
+        SmartPointer<ChunkTree> loadChunk(int i);
+
+        /*Search points within box, ids and xyz are cleared before searching, xyz is (x, y, z) of each point. */
+        int searchBox(const Box3<T>& box, std::vector<uint64>& ids, std::vector<T>& xyz);
+
+        /*Search points within radius, dist2_list is square distance. */
+        int searchRadius(const T* pt, double radius, std::vector<uint64>& ids,
+            std::vector<T>& xyz, std::vector<double>& dist2_list);
+
+        /*Search k nearest points within radius, sorted by distance ascending.
+         * Chunks are visited from the nearest one and skipped when farther than the k'th point.
+         */
+        int searchKNearest(const T* pt, int k, double radius, std::vector<uint64>& ids,
+            std::vector<T>& xyz, std::vector<double>& dist2_list);
+
+    protected:
+        std::string chunkPath(int i) const;
+        double chunkDistance2(int i, const T* pt) const;
+        bool chunkIntersects(int i, const Box3<T>& box) const;
+
+    protected:
+        std::string _path;
+        bool _single_file;
+        Box3<T> _box;
+        uint64 _point_count;
+        int _min_points_per_node;
+        T _max_leaf_size[3];
+        std::vector<OctreeChunk> _chunks;
+        LRUCache<int, ChunkTree> _cache;
+    };
+
+#include "OutOfCoreOctree.inl"
+
+}
+
+#endif
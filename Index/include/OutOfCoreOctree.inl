@@ -0,0 +1,744 @@
+/*
+**********************************************************************
+*
+* This file is a part of library MPCDPS(Massive Point Cloud Data Processing System).
+* It is a free program and it is protected by the license GPL-v3.0, you may not use the
+* file except in compliance with the License.
+*
+* Copyright(c) 2013 - 2020 Xu Shengpan, all rights reserved.
+*
+* Email: jack_1227x@163.com
+*
+**********************************************************************
+*/
+
+/*Header of the container file, or of index.bin in a chunk directory.
+ * The chunk index is stored at index_offset.
+ */
+struct OutOfCoreOctreeHeader
+{
+    int magic;
+    int version;
+    int elem_size;
+    int chunk_count;
+    int min_points_per_node;
+    int reserved;
+    double max_leaf_size[3];
+    double box[6];
+    uint64 point_count;
+    uint64 index_offset;
+};
+
+const int OUT_OF_CORE_OCTREE_MAGIC = ('M' << 0) | ('O' << 8) | ('C' << 16) | ('T' << 24);
+
+inline bool make_directory(const std::string& path)
+{
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+    FILE* file = fopen((path + "/.mpcdps").c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    fclose(file);
+    remove((path + "/.mpcdps").c_str());
+    return true;
+}
+
+//-------------------------------------------------------------------------------------//
+
+template<typename T>
+OutOfCoreOctreeBuilder<T>::OutOfCoreOctreeBuilder()
+    :_min_points_per_node(1), _max_chunk_points(1000000),
+    _memory_budget(size_t(256) << 20), _has_box(false), _tmp_count(0)
+{
+    for (int i = 0; i < 3; ++i) {
+        _max_leaf_size[i] = 1;
+    }
+}
+
+template<typename T>
+OutOfCoreOctreeBuilder<T>::~OutOfCoreOctreeBuilder()
+{
+}
+
+template<typename T>
+bool OutOfCoreOctreeBuilder<T>::build(PointStreamReader<T>& reader, const std::string& path, bool single_file)
+{
+    _chunks.clear();
+    if (!_has_box && !computeBox(reader)) {
+        return false;
+    }
+
+    if (!single_file && !make_directory(path)) {
+        return false;
+    }
+
+    _tmp_base = single_file ? path : path + "/chunk";
+    _tmp_count = 0;
+    std::vector<std::string> tmp_files;
+    bool result = splitCell(reader, 0, 0, _chunks, tmp_files);
+
+    /*the chunks of the counting cells with more than the maximum chunk points are split again from
+     * their temporary files, until they are small enough or at the finest level, where the points are
+     * cut into pieces in the order of the file. Sub chunks replace their chunk, so the Morton order is kept.
+     */
+    for (size_t i = 0; i < _chunks.size() && result; ) {
+        if (_chunks[i].point_count <= uint64(_max_chunk_points)) {
+            ++i;
+            continue;
+        }
+        std::vector<OctreeChunk> sub_chunks;
+        std::vector<std::string> sub_files;
+        BinaryPointReader<T> chunk_reader;
+        result = chunk_reader.open(tmp_files[i]);
+        if (result && _chunks[i].level < Octree<T>::MAX_LEVEL) {
+            const int shift = 3 * (Octree<T>::MAX_LEVEL - _chunks[i].level);
+            result = splitCell(chunk_reader, _chunks[i].level, _chunks[i].key >> shift, sub_chunks, sub_files);
+        } else if (result) {
+            result = cutChunk(chunk_reader, _chunks[i], sub_chunks, sub_files);
+        }
+        chunk_reader.close();
+        remove(tmp_files[i].c_str());
+        tmp_files.erase(tmp_files.begin() + i);
+        _chunks.erase(_chunks.begin() + i);
+        tmp_files.insert(tmp_files.begin() + i, sub_files.begin(), sub_files.end());
+        _chunks.insert(_chunks.begin() + i, sub_chunks.begin(), sub_chunks.end());
+    }
+
+    OutOfCoreOctreeHeader header;
+    header.magic = OUT_OF_CORE_OCTREE_MAGIC;
+    header.version = 2;
+    header.elem_size = sizeof(T);
+    header.chunk_count = _chunks.size();
+    header.min_points_per_node = _min_points_per_node;
+    header.reserved = 0;
+    for (int i = 0; i < 3; ++i) {
+        header.max_leaf_size[i] = _max_leaf_size[i];
+        header.box[i] = _box.min(i);
+        header.box[i + 3] = _box.max(i);
+    }
+    header.point_count = 0;
+    header.index_offset = sizeof(OutOfCoreOctreeHeader);
+
+    FILE* out = NULL;
+    uint64 offset = 0;
+    if (single_file && result) {
+        out = fopen(path.c_str(), "wb");
+        result = (out != NULL);
+        if (result) {
+            fwrite(&header, sizeof(header), 1, out);
+            offset = sizeof(header);
+        }
+    }
+
+    for (size_t i = 0; i < _chunks.size() && result; ++i) {
+        _chunks[i].first_point = header.point_count;
+        if (single_file) {
+            result = writeChunk(i, tmp_files[i], out, offset);
+        } else {
+            FILE* chunk_file = fopen((path + "/chunk_" + std::to_string(i) + ".bin").c_str(), "wb");
+            if (!chunk_file) {
+                result = false;
+                break;
+            }
+            uint64 chunk_offset = 0;
+            result = writeChunk(i, tmp_files[i], chunk_file, chunk_offset);
+            fclose(chunk_file);
+        }
+        header.point_count += _chunks[i].point_count;
+    }
+
+    if (result) {
+        if (single_file) {
+            header.index_offset = offset;
+        } else {
+            out = fopen((path + "/index.bin").c_str(), "wb");
+            result = (out != NULL);
+            if (result) {
+                fwrite(&header, sizeof(header), 1, out);
+            }
+        }
+    }
+
+    if (result) {
+        if (!_chunks.empty()) {
+            fwrite(&_chunks[0], sizeof(OctreeChunk), _chunks.size(), out);
+        }
+        fflush(out);
+        file_seek64(out, 0);
+        result = fwrite(&header, sizeof(header), 1, out) == 1;
+    }
+
+    if (out) {
+        fclose(out);
+    }
+    for (size_t i = 0; i < tmp_files.size(); ++i) {
+        remove(tmp_files[i].c_str());
+    }
+    return result;
+}
+
+template<typename T>
+bool OutOfCoreOctreeBuilder<T>::computeBox(PointStreamReader<T>& reader)
+{
+    const int batch = 1 << 16;
+    std::vector<T> buffer(batch * 3);
+    BoxGetter bg;
+    int n;
+    uint64 total = 0;
+
+    reader.rewind();
+    while ((n = reader.read(&buffer[0], batch)) > 0) {
+        for (int i = 0; i < n; ++i) {
+            bg.add_point(buffer[i * 3], buffer[i * 3 + 1], buffer[i * 3 + 2]);
+        }
+        total += n;
+    }
+
+    if (total == 0) {
+        return false;
+    }
+    _box = bg.getBox<T>();
+    return true;
+}
+
+template<typename T>
+uint64 OutOfCoreOctreeBuilder<T>::getCode(const T* pt) const
+{
+    const double cn = double(1 << Octree<T>::MAX_LEVEL);
+    uint q[3];
+    double t;
+    for (int i = 0; i < 3; ++i) {
+        double len = _box.length(i);
+        t = (len > 0) ? (pt[i] - _box.min(i)) / len * cn : 0;
+        if (t <= 0) {
+            q[i] = 0;
+        } else if (t >= cn) {
+            q[i] = uint(cn) - 1;
+        } else {
+            q[i] = uint(t);
+        }
+    }
+    return morton_encode3(q[0], q[1], q[2]);
+}
+
+template<typename T>
+int OutOfCoreOctreeBuilder<T>::countDepth(int level)
+{
+    return MINV(int(COUNT_LEVEL), int(Octree<T>::MAX_LEVEL) - level);
+}
+
+template<typename T>
+uint64 OutOfCoreOctreeBuilder<T>::getCountCell(uint64 code, int level)
+{
+    const int depth = countDepth(level);
+    return (code >> (3 * (Octree<T>::MAX_LEVEL - level - depth))) & ((uint64(1) << (3 * depth)) - 1);
+}
+
+template<typename T>
+bool OutOfCoreOctreeBuilder<T>::splitCell(PointStreamReader<T>& reader, int level, uint64 key,
+    std::vector<OctreeChunk>& chunks, std::vector<std::string>& tmp_files)
+{
+    std::vector<int> cell_chunks;
+    {
+        std::vector<uint64> counts;
+        countPoints(reader, level, counts);
+        createChunks(counts, level, key, chunks, cell_chunks);
+    }
+    tmp_files.resize(chunks.size());
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        tmp_files[i] = _tmp_base + ".tmp" + std::to_string(_tmp_count++);
+    }
+    return distributePoints(reader, level, cell_chunks, tmp_files);
+}
+
+template<typename T>
+void OutOfCoreOctreeBuilder<T>::countPoints(PointStreamReader<T>& reader, int level, std::vector<uint64>& counts)
+{
+    const int batch = 1 << 16;
+    std::vector<T> buffer(batch * 3);
+    counts.assign(size_t(1) << (3 * countDepth(level)), 0);
+    int n;
+
+    reader.rewind();
+    while ((n = reader.read(&buffer[0], batch)) > 0) {
+        for (int i = 0; i < n; ++i) {
+            ++counts[getCountCell(getCode(&buffer[i * 3]), level)];
+        }
+    }
+}
+
+/*The count of cell (l, k) is the sum of its 8 children (l + 1, 8k ... 8k + 7),
+ * so the counts of coarser levels are merged from the counting level.
+ * Levels and keys are relative to the cell (level, key) being split.
+ */
+template<typename T>
+void OutOfCoreOctreeBuilder<T>::createChunks(const std::vector<uint64>& counts, int level, uint64 key,
+    std::vector<OctreeChunk>& chunks, std::vector<int>& cell_chunks)
+{
+    const int depth = countDepth(level);
+    std::vector<std::vector<uint64> > sums(depth + 1);
+    sums[depth].assign(counts.begin(), counts.end());
+    for (int l = depth - 1; l >= 0; --l) {
+        sums[l].assign(size_t(1) << (3 * l), 0);
+        for (size_t k = 0; k < sums[l].size(); ++k) {
+            for (int j = 0; j < 8; ++j) {
+                sums[l][k] += sums[l + 1][k * 8 + j];
+            }
+        }
+    }
+
+    chunks.clear();
+    cell_chunks.assign(counts.size(), -1);
+    std::vector<std::pair<int, uint64> > stk;
+    stk.push_back(std::make_pair(0, uint64(0)));
+    while (!stk.empty()) {
+        int l = stk.back().first;
+        uint64 k = stk.back().second;
+        stk.pop_back();
+
+        uint64 count = sums[l][k];
+        if (count == 0) {
+            continue;
+        }
+        if (count > uint64(_max_chunk_points) && l < depth) {
+            for (int j = 7; j >= 0; --j) {
+                stk.push_back(std::make_pair(l + 1, k * 8 + j));
+            }
+            continue;
+        }
+
+        OctreeChunk chunk;
+        chunk.level = level + l;
+        chunk.key = ((key << (3 * l)) | k) << (3 * (Octree<T>::MAX_LEVEL - chunk.level));
+        chunk.node_count = 0;
+        chunk.point_count = count;
+        chunk.first_point = 0;
+        chunk.offset = 0;
+        for (int i = 0; i < 6; ++i) {
+            chunk.box[i] = 0;
+        }
+
+        int shift = 3 * (depth - l);
+        for (uint64 c = k << shift; c < ((k + 1) << shift); ++c) {
+            cell_chunks[c] = chunks.size();
+        }
+        chunks.push_back(chunk);
+    }
+}
+
+template<typename T>
+bool OutOfCoreOctreeBuilder<T>::distributePoints(PointStreamReader<T>& reader, int level,
+    const std::vector<int>& cell_chunks, const std::vector<std::string>& tmp_files)
+{
+    const size_t budget_points = MAXV(_memory_budget / (3 * sizeof(T)), size_t(1) << 16);
+    const int batch = int(MINV(budget_points / 4, size_t(1) << 20));
+    const size_t flush_points = budget_points - batch;
+
+    for (size_t i = 0; i < tmp_files.size(); ++i) {
+        remove(tmp_files[i].c_str());
+    }
+
+    std::vector<T> buffer(size_t(batch) * 3);
+    std::vector<std::vector<T> > chunk_buffers(tmp_files.size());
+    size_t buffered = 0;
+    int n;
+
+    reader.rewind();
+    while (1) {
+        n = reader.read(&buffer[0], batch);
+        for (int i = 0; i < n; ++i) {
+            const T* pt = &buffer[i * 3];
+            std::vector<T>& chunk_buffer = chunk_buffers[cell_chunks[getCountCell(getCode(pt), level)]];
+            chunk_buffer.insert(chunk_buffer.end(), pt, pt + 3);
+        }
+        buffered += n;
+
+        if (buffered > flush_points || n == 0) {
+            for (size_t c = 0; c < chunk_buffers.size(); ++c) {
+                if (chunk_buffers[c].empty()) {
+                    continue;
+                }
+                FILE* file = fopen(tmp_files[c].c_str(), "ab");
+                if (!file) {
+                    return false;
+                }
+                size_t m = chunk_buffers[c].size();
+                bool ok = fwrite(&chunk_buffers[c][0], sizeof(T), m, file) == m;
+                fclose(file);
+                if (!ok) {
+                    return false;
+                }
+                std::vector<T>().swap(chunk_buffers[c]);
+            }
+            buffered = 0;
+        }
+
+        if (n == 0) {
+            break;
+        }
+    }
+    return true;
+}
+
+/*Cut a chunk of the finest level into pieces of the maximum chunk points, in the order of the points. */
+template<typename T>
+bool OutOfCoreOctreeBuilder<T>::cutChunk(PointStreamReader<T>& reader, const OctreeChunk& chunk,
+    std::vector<OctreeChunk>& chunks, std::vector<std::string>& tmp_files)
+{
+    const int batch = 1 << 16;
+    std::vector<T> buffer(batch * 3);
+    FILE* file = NULL;
+    int n;
+    bool ok = true;
+
+    reader.rewind();
+    while (ok && (n = reader.read(&buffer[0], batch)) > 0) {
+        for (int i = 0; i < n && ok; ) {
+            if (chunks.empty() || chunks.back().point_count == uint64(_max_chunk_points)) {
+                if (file) {
+                    fclose(file);
+                }
+                chunks.push_back(chunk);
+                chunks.back().point_count = 0;
+                tmp_files.push_back(_tmp_base + ".tmp" + std::to_string(_tmp_count++));
+                file = fopen(tmp_files.back().c_str(), "wb");
+                if (!file) {
+                    return false;
+                }
+            }
+            const int m = int(MINV(uint64(n - i), uint64(_max_chunk_points) - chunks.back().point_count));
+            ok = int(fwrite(&buffer[i * 3], sizeof(T) * 3, m, file)) == m;
+            chunks.back().point_count += m;
+            i += m;
+        }
+    }
+    if (file) {
+        fclose(file);
+    }
+    return ok;
+}
+
+template<typename T>
+bool OutOfCoreOctreeBuilder<T>::writeChunk(int chunk_id, const std::string& tmp_file, FILE* out, uint64& offset)
+{
+    OctreeChunk& chunk = _chunks[chunk_id];
+    const int n = int(chunk.point_count);  /*no more than the maximum chunk points after splitting. */
+    SmartArray2D<T, 3> points(n);
+
+    FILE* file = fopen(tmp_file.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    bool ok = int(fread(points.buffer(), sizeof(T) * 3, n, file)) == n;
+    fclose(file);
+    if (!ok) {
+        return false;
+    }
+
+    Octree<T> tree;
+    tree.setMinPointsForNode(_min_points_per_node);
+    tree.setMaxLeafShape(_max_leaf_size);
+    tree.build(points);
+
+    const std::vector<int>& ptids = tree.getPointIds();
+    std::vector<T> sorted(size_t(n) * 3);
+    BoxGetter bg;
+    for (int i = 0; i < n; ++i) {
+        const T* pt = points[ptids[i]];
+        sorted[i * 3] = pt[0];
+        sorted[i * 3 + 1] = pt[1];
+        sorted[i * 3 + 2] = pt[2];
+        bg.add_point(pt[0], pt[1], pt[2]);
+    }
+
+    chunk.offset = offset;
+    chunk.box[0] = bg._xmin;
+    chunk.box[1] = bg._ymin;
+    chunk.box[2] = bg._zmin;
+    chunk.box[3] = bg._xmax;
+    chunk.box[4] = bg._ymax;
+    chunk.box[5] = bg._zmax;
+
+    // The node ranges index the point ids, which are the order of the sorted points.
+    const std::vector<OctreeNode<T> >& nodes = tree.getNodes();
+    chunk.node_count = nodes.size();
+    if (n > 0 && fwrite(&sorted[0], sizeof(T), sorted.size(), out) != sorted.size()) {
+        return false;
+    }
+    if (!nodes.empty() && fwrite(&nodes[0], sizeof(OctreeNode<T>), nodes.size(), out) != nodes.size()) {
+        return false;
+    }
+    offset += sorted.size() * sizeof(T) + nodes.size() * sizeof(OctreeNode<T>);
+    remove(tmp_file.c_str());
+    return true;
+}
+
+//-------------------------------------------------------------------------------------//
+
+template<typename T>
+OutOfCoreOctree<T>::OutOfCoreOctree()
+    :_single_file(true), _point_count(0), _min_points_per_node(1), _cache(size_t(1) << 30)
+{
+    for (int i = 0; i < 3; ++i) {
+        _max_leaf_size[i] = 1;
+    }
+}
+
+template<typename T>
+OutOfCoreOctree<T>::~OutOfCoreOctree()
+{
+    close();
+}
+
+template<typename T>
+bool OutOfCoreOctree<T>::open(const std::string& path)
+{
+    close();
+
+    OutOfCoreOctreeHeader header;
+    FILE* file = fopen(path.c_str(), "rb");
+    bool ok = file && fread(&header, sizeof(header), 1, file) == 1 && header.magic == OUT_OF_CORE_OCTREE_MAGIC;
+    _single_file = ok;
+    if (!ok) {
+        if (file) {
+            fclose(file);
+        }
+        file = fopen((path + "/index.bin").c_str(), "rb");
+        ok = file && fread(&header, sizeof(header), 1, file) == 1 && header.magic == OUT_OF_CORE_OCTREE_MAGIC;
+    }
+
+    ok = ok && (header.version == 1 || header.version == 2) && header.elem_size == sizeof(T);
+    if (ok) {
+        _chunks.resize(header.chunk_count);
+        ok = file_seek64(file, header.index_offset) == 0;
+        if (ok && header.chunk_count > 0) {
+            ok = int(fread(&_chunks[0], sizeof(OctreeChunk), _chunks.size(), file)) == header.chunk_count;
+        }
+    }
+    if (file) {
+        fclose(file);
+    }
+    if (!ok) {
+        _chunks.clear();
+        return false;
+    }
+
+    _path = path;
+    _point_count = header.point_count;
+    _min_points_per_node = header.min_points_per_node;
+    for (int i = 0; i < 3; ++i) {
+        _max_leaf_size[i] = header.max_leaf_size[i];
+        _box.setMin(i, header.box[i]);
+        _box.setMax(i, header.box[i + 3]);
+    }
+    return true;
+}
+
+template<typename T>
+void OutOfCoreOctree<T>::close()
+{
+    _cache.clear();
+    _chunks.clear();
+    _point_count = 0;
+    _path.clear();
+}
+
+template<typename T>
+std::string OutOfCoreOctree<T>::chunkPath(int i) const
+{
+    return _single_file ? _path : _path + "/chunk_" + std::to_string(i) + ".bin";
+}
+
+template<typename T>
+SmartPointer<typename OutOfCoreOctree<T>::ChunkTree> OutOfCoreOctree<T>::loadChunk(int i)
+{
+    SmartPointer<ChunkTree> tree = _cache.get(i);
+    if (tree != NULL) {
+        return tree;
+    }
+
+    const OctreeChunk& chunk = _chunks[i];
+    if (chunk.point_count > uint64(INT_MAX)) {
+        return tree;
+    }
+    const int n = int(chunk.point_count);
+    SmartArray2D<T, 3> points(n);
+    FILE* file = fopen(chunkPath(i).c_str(), "rb");
+    if (!file) {
+        return tree;
+    }
+    std::vector<OctreeNode<T> > nodes(chunk.node_count);
+    bool ok = file_seek64(file, chunk.offset) == 0 &&
+        int(fread(points.buffer(), sizeof(T) * 3, n, file)) == n &&
+        (nodes.empty() || int(fread(&nodes[0], sizeof(OctreeNode<T>), nodes.size(), file)) == chunk.node_count);
+    fclose(file);
+    if (!ok) {
+        return tree;
+    }
+
+    tree = new ChunkTree;
+    tree->setMinPointsForNode(_min_points_per_node);
+    tree->setMaxLeafShape(_max_leaf_size);
+    if (!nodes.empty()) {
+        tree->restore(points, nodes);
+    } else {
+        // The points are stored in Morton order, so the build does not move them.
+        tree->build(points);
+    }
+
+    size_t bytes = size_t(n) * (3 * sizeof(T) + sizeof(int) + sizeof(uint64)) +
+        size_t(tree->nodeCount()) * sizeof(OctreeNode<T>);
+    _cache.put(i, tree, bytes);
+    return tree;
+}
+
+template<typename T>
+double OutOfCoreOctree<T>::chunkDistance2(int i, const T* pt) const
+{
+    const double* box = _chunks[i].box;
+    double d = 0, d1;
+    for (int j = 0; j < 3; ++j) {
+        if (pt[j] < box[j]) {
+            d1 = box[j] - pt[j];
+            d += d1 * d1;
+        } else if (pt[j] > box[j + 3]) {
+            d1 = pt[j] - box[j + 3];
+            d += d1 * d1;
+        }
+    }
+    return d;
+}
+
+template<typename T>
+bool OutOfCoreOctree<T>::chunkIntersects(int i, const Box3<T>& box) const
+{
+    const double* cbox = _chunks[i].box;
+    for (int j = 0; j < 3; ++j) {
+        if (cbox[j] > box.max(j) || cbox[j + 3] < box.min(j)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename T>
+int OutOfCoreOctree<T>::searchBox(const Box3<T>& box, std::vector<uint64>& ids, std::vector<T>& xyz)
+{
+    ids.clear();
+    xyz.clear();
+    std::vector<int> local_ids;
+    for (int i = 0; i < chunkCount(); ++i) {
+        if (!chunkIntersects(i, box)) {
+            continue;
+        }
+        SmartPointer<ChunkTree> tree = loadChunk(i);
+        if (tree == NULL) {
+            continue;
+        }
+        tree->searchBox(box, local_ids);
+        for (size_t j = 0; j < local_ids.size(); ++j) {
+            const T* pt = tree->getVertex(local_ids[j]);
+            ids.push_back(_chunks[i].first_point + local_ids[j]);
+            xyz.insert(xyz.end(), pt, pt + 3);
+        }
+    }
+    return ids.size();
+}
+
+template<typename T>
+int OutOfCoreOctree<T>::searchRadius(const T* pt, double radius, std::vector<uint64>& ids,
+    std::vector<T>& xyz, std::vector<double>& dist2_list)
+{
+    ids.clear();
+    xyz.clear();
+    dist2_list.clear();
+    std::vector<int> local_ids;
+    std::vector<double> local_dist2s;
+    const double r2 = radius * radius;
+    for (int i = 0; i < chunkCount(); ++i) {
+        if (chunkDistance2(i, pt) > r2) {
+            continue;
+        }
+        SmartPointer<ChunkTree> tree = loadChunk(i);
+        if (tree == NULL) {
+            continue;
+        }
+        tree->searchRadius(pt, radius, local_ids, local_dist2s);
+        for (size_t j = 0; j < local_ids.size(); ++j) {
+            const T* vtx = tree->getVertex(local_ids[j]);
+            ids.push_back(_chunks[i].first_point + local_ids[j]);
+            xyz.insert(xyz.end(), vtx, vtx + 3);
+        }
+        dist2_list.insert(dist2_list.end(), local_dist2s.begin(), local_dist2s.end());
+    }
+    return ids.size();
+}
+
+template<typename T>
+int OutOfCoreOctree<T>::searchKNearest(const T* pt, int k, double radius, std::vector<uint64>& ids,
+    std::vector<T>& xyz, std::vector<double>& dist2_list)
+{
+    ids.clear();
+    xyz.clear();
+    dist2_list.clear();
+
+    std::vector<double> chunk_dist2s;
+    std::vector<int> chunk_ids;
+    double bound = radius * radius;
+    for (int i = 0; i < chunkCount(); ++i) {
+        double d2 = chunkDistance2(i, pt);
+        if (d2 <= bound) {
+            chunk_dist2s.push_back(d2);
+            chunk_ids.push_back(i);
+        }
+    }
+    sort_shell_syn(chunk_dist2s, chunk_ids);
+
+    std::vector<int> local_ids;
+    std::vector<double> local_dist2s;
+    std::vector<uint64> ids1;
+    std::vector<T> xyz1;
+    std::vector<double> dist2s1;
+    for (size_t c = 0; c < chunk_ids.size(); ++c) {
+        if (chunk_dist2s[c] > bound) {
+            break;
+        }
+        const int i = chunk_ids[c];
+        SmartPointer<ChunkTree> tree = loadChunk(i);
+        if (tree == NULL) {
+            continue;
+        }
+        tree->searchKNearest(pt, k, std::sqrt(bound), local_ids, local_dist2s);
+
+        // merge the two sorted lists and keep the first k.
+        ids1.clear();
+        xyz1.clear();
+        dist2s1.clear();
+        size_t a = 0, b = 0;
+        while (int(ids1.size()) < k && (a < ids.size() || b < local_ids.size())) {
+            if (b == local_ids.size() || (a < ids.size() && dist2_list[a] <= local_dist2s[b])) {
+                ids1.push_back(ids[a]);
+                xyz1.insert(xyz1.end(), xyz.begin() + a * 3, xyz.begin() + a * 3 + 3);
+                dist2s1.push_back(dist2_list[a]);
+                ++a;
+            } else {
+                const T* vtx = tree->getVertex(local_ids[b]);
+                ids1.push_back(_chunks[i].first_point + local_ids[b]);
+                xyz1.insert(xyz1.end(), vtx, vtx + 3);
+                dist2s1.push_back(local_dist2s[b]);
+                ++b;
+            }
+        }
+        ids.swap(ids1);
+        xyz.swap(xyz1);
+        dist2_list.swap(dist2s1);
+        if (int(ids.size()) == k) {
+            bound = dist2_list[k - 1];
+        }
+    }
+    return ids.size();
+}
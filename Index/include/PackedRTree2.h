@@ -0,0 +1,489 @@
+/*
+**********************************************************************
+*
+* This file is a part of library MPCDPS(Massive Point Cloud Data Processing System).
+* It is a free program and it is protected by the license GPL-v3.0, you may not use the
+* file except in compliance with the License.
+*
+* Copyright(c) 2013 - 2020 Xu Shengpan, all rights reserved.
+*
+* Email: jack_1227x@163.com
+*
+**********************************************************************
+*/
+
+#ifndef MPCDPS_PACKEDRTREE2_H
+#define MPCDPS_PACKEDRTREE2_H
+
+#include <cfloat>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <type_traits>
+#include "MappedFile.h"
+#include "RTree2.h"
+
+namespace mpcdps {
+
+/*
+    Read-only packed RTree for 2D, of the same elements as RTree2.
+    The elements are sorted by the Hilbert codes of their centers, and each node has node_size children
+    except the last node of a level. The boxes of all of the levels are stored contiguously from the leaves
+    to the root, so the tree is one flat buffer without pointers: the first child of a node is found
+    from its position in its level.
+
+    The buffer is the file format: a saved tree can be memory mapped and searched in place,
+    without reading or rebuilding the nodes, and the pages are shared by the processes searching the same file.
+
+    DataType must be trivially copyable, as it is stored in the file.
+    The file is in the byte order of the machine that saved it, load() rejects a file of another byte order.
+*/
+template<typename T, typename DataType>
+class PackedRTree2
+{
+public:
+    typedef typename RTree2<T, DataType>::RTreeElem RTreeElem;
+
+    enum { MIN_NODE_SIZE = 2, MAX_NODE_SIZE = 256 };
+
+    PackedRTree2() : _header(NULL), _level_end(NULL), _boxes(NULL), _data(NULL)
+    {
+        build(std::vector<RTreeElem>());
+    }
+
+    ~PackedRTree2()
+    {
+    }
+
+    /*Pack elems, node_size is clamped to [MIN_NODE_SIZE, MAX_NODE_SIZE]. */
+    void build(const std::vector<RTreeElem>& elems, int node_size = 16);
+
+    /*Pack the elements of an RTree2. */
+    void build(const RTree2<T, DataType>& tree, int node_size = 16)
+    {
+        build(tree.getElems(), node_size);
+    }
+
+    bool save(const std::string& path) const;
+
+    /*Load a saved tree. If map is true, the file is memory mapped and the tree is searched in place,
+     * otherwise it is read into memory. Return false if the file is not a tree of T and DataType,
+     * then the tree is empty.
+     */
+    bool load(const std::string& path, bool map = true);
+
+    bool isMapped() const { return _file.isOpen(); }
+
+    /*
+      All of the elements that intersect with rect.
+    */
+    std::vector<DataType> searchElems(const Rect2<T>& rect) const
+    {
+        std::vector<DataType> ids;
+        searchElems(rect, ids);
+        return ids;
+    }
+
+    /*
+      All of the elements that contains the searching point.
+    */
+    std::vector<DataType> searchElems(const Point2<T>& point) const
+    {
+        std::vector<DataType> ids;
+        searchElems(point, ids);
+        return ids;
+    }
+
+    /*
+      The same as above, but the results replace the contents of ids, so that its memory can be reused.
+    */
+    void searchElems(const Rect2<T>& rect, std::vector<DataType>& ids) const
+    {
+        ids.clear();
+        visitElems(rect, [&ids](const DataType& data) {
+            ids.push_back(data);
+            return true;
+        });
+    }
+
+    void searchElems(const Point2<T>& point, std::vector<DataType>& ids) const
+    {
+        ids.clear();
+        visitElems(point, [&ids](const DataType& data) {
+            ids.push_back(data);
+            return true;
+        });
+    }
+
+    /*
+      Call visitor(data) for each element that intersects with rect, or contains point, until it returns false.
+      Return the count of the elements visited. Nothing is allocated, the searches can run from many threads.
+    */
+    template<typename Visitor>
+    int visitElems(const Rect2<T>& rect, Visitor&& visitor) const
+    {
+        const T x0 = rect.min(0), y0 = rect.min(1), x1 = rect.max(0), y1 = rect.max(1);
+        return visit([x0, y0, x1, y1](const T* box) {
+            return box[0] <= x1 && box[1] <= y1 && box[2] >= x0 && box[3] >= y0;
+        }, visitor);
+    }
+
+    template<typename Visitor>
+    int visitElems(const Point2<T>& point, Visitor&& visitor) const
+    {
+        const T x = point[0], y = point[1];
+        return visit([x, y](const T* box) {
+            return box[0] <= x && box[1] <= y && box[2] >= x && box[3] >= y;
+        }, visitor);
+    }
+
+    int countElems(const Rect2<T>& rect) const
+    {
+        return visitElems(rect, [](const DataType&) { return true; });
+    }
+
+    bool hasElem(const Rect2<T>& rect) const
+    {
+        return visitElems(rect, [](const DataType&) { return false; }) > 0;
+    }
+
+    bool hasElem(const Point2<T>& point) const
+    {
+        return visitElems(point, [](const DataType&) { return false; }) > 0;
+    }
+
+    int elemCount() const { return int(_header->count); }
+
+    bool isEmpty() const { return _header->count == 0; }
+
+    int nodeSize() const { return _header->node_size; }
+
+    /*Level 0 is the elements, the last level is the root. */
+    int levelCount() const { return _header->level_count; }
+
+    /*Bytes of the tree, the same as the size of the file. */
+    size_t byteSize() const { return size_t(_header->file_size); }
+
+    Rect2<T> getRootRect() const
+    {
+        if (isEmpty()) {
+            return Rect2<T>();
+        }
+        const T* box = _boxes + 4 * (_header->box_count - 1);
+        return Rect2<T>(box[0], box[2], box[1], box[3]);
+    }
+
+    void clear()
+    {
+        build(std::vector<RTreeElem>());
+    }
+
+protected:
+    /*Layout of the buffer:
+     *   Header
+     *   uint64 level_end[level_count]: end of the boxes of each level, level 0 is [0, count)
+     *   T boxes[box_count][4]: (xmin, ymin, xmax, ymax)
+     *   DataType data[count]
+     * Each array starts at a multiple of 8 bytes.
+     */
+    struct Header
+    {
+        char magic[8];
+        uint version;
+        uint byte_order;
+        uint coord_size;
+        uint data_size;
+        uint node_size;
+        uint level_count;
+        uint64 count;
+        uint64 box_count;
+        uint64 boxes_offset;
+        uint64 data_offset;
+        uint64 file_size;
+    };
+
+    enum { VERSION = 1, BYTE_ORDER_MARK = 0x01020304 };
+
+    static const char* magic() { return "MPCDPRT"; }
+
+    static uint64 align8(uint64 v) { return (v + 7) & ~uint64(7); }
+
+    /*Depth first search of the branches passing test. The stack holds at most node_size - 1 siblings
+     * for each level, there are at most 32 levels for node_size 2 and 4 levels for node_size 256.
+     */
+    template<typename Test, typename Visitor>
+    int visit(const Test& test, Visitor& visitor) const
+    {
+        if (_header->count == 0) {
+            return 0;
+        }
+        enum { MAX_STACK = 1024 };
+        struct Entry
+        {
+            uint pos;
+            int level;
+        };
+        Entry stack[MAX_STACK];
+        int tos = 0;
+        int found = 0;
+        const uint node_size = _header->node_size;
+
+        stack[tos].pos = uint(_header->box_count - 1);
+        stack[tos].level = _header->level_count - 1;
+        ++tos;
+        while (tos > 0) {
+            const Entry e = stack[--tos];
+            const uint64 child_begin = e.level > 1 ? _level_end[e.level - 2] : 0;
+            const uint begin = uint(child_begin + (e.pos - _level_end[e.level - 1]) * node_size);
+            const uint end = uint(MINV(uint64(begin) + node_size, _level_end[e.level - 1]));
+            for (uint i = begin; i < end; ++i) {
+                if (!test(_boxes + 4 * size_t(i))) {
+                    continue;
+                }
+                if (e.level == 1) {
+                    ++found;
+                    if (!visitor(_data[i])) {
+                        return found;
+                    }
+                } else {
+                    stack[tos].pos = i;
+                    stack[tos].level = e.level - 1;
+                    ++tos;
+                }
+            }
+        }
+        return found;
+    }
+
+    /*Set the array pointers into buffer, return false if the layout is not valid. */
+    bool attach(const char* buffer, size_t size);
+
+private:
+    PackedRTree2(const PackedRTree2&);
+    PackedRTree2& operator=(const PackedRTree2&);
+
+protected:
+    std::vector<uint64> _buffer;    /*the built or loaded tree, uint64 for the alignment. */
+    MappedFile _file;               /*or the mapped file. */
+
+    const Header* _header;
+    const uint64* _level_end;
+    const T* _boxes;
+    const DataType* _data;
+};
+
+template<typename T, typename DataType>
+void PackedRTree2<T, DataType>::build(const std::vector<RTreeElem>& elems, int node_size)
+{
+    static_assert(std::is_trivially_copyable<DataType>::value, "DataType of PackedRTree2 must be trivially copyable");
+    static_assert(std::alignment_of<DataType>::value <= 8 && std::alignment_of<T>::value <= 8,
+        "PackedRTree2 arrays are aligned to 8 bytes");
+
+    _file.close();
+    node_size = MINV(MAXV(node_size, int(MIN_NODE_SIZE)), int(MAX_NODE_SIZE));
+    const int n = elems.size();
+
+    /*box count of each level, up to a level of one node. */
+    std::vector<uint64> level_end;
+    if (n > 0) {
+        uint64 level_size = n;
+        level_end.push_back(level_size);
+        do {
+            level_size = (level_size + node_size - 1) / node_size;
+            level_end.push_back(level_end.back() + level_size);
+        } while (level_size > 1);
+    }
+    const int level_count = level_end.size();
+    const uint64 box_count = level_count > 0 ? level_end.back() : 0;
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    strcpy(header.magic, magic());
+    header.version = VERSION;
+    header.byte_order = BYTE_ORDER_MARK;
+    header.coord_size = sizeof(T);
+    header.data_size = sizeof(DataType);
+    header.node_size = node_size;
+    header.level_count = level_count;
+    header.count = n;
+    header.box_count = box_count;
+    header.boxes_offset = align8(sizeof(Header) + sizeof(uint64) * level_count);
+    header.data_offset = align8(header.boxes_offset + sizeof(T) * 4 * box_count);
+    header.file_size = align8(header.data_offset + sizeof(DataType) * n);
+
+    std::vector<uint64>(header.file_size / 8, 0).swap(_buffer);
+    char* buffer = reinterpret_cast<char*>(&_buffer[0]);
+    memcpy(buffer, &header, sizeof(Header));
+    if (level_count > 0) {
+        memcpy(buffer + sizeof(Header), &level_end[0], sizeof(uint64) * level_count);
+    }
+    attach(buffer, size_t(header.file_size));
+    if (n == 0) {
+        return;
+    }
+
+    T* boxes = reinterpret_cast<T*>(buffer + header.boxes_offset);
+    DataType* data = reinterpret_cast<DataType*>(buffer + header.data_offset);
+
+    /*Hilbert codes of the centers on a 2^16 x 2^16 grid of their bounding box. */
+    double xmin = DBL_MAX, xmax = -DBL_MAX, ymin = DBL_MAX, ymax = -DBL_MAX;
+    for (int i = 0; i < n; ++i) {
+        const double x = 0.5 * (double(elems[i].rect.min(0)) + elems[i].rect.max(0));
+        const double y = 0.5 * (double(elems[i].rect.min(1)) + elems[i].rect.max(1));
+        xmin = MINV(xmin, x);
+        xmax = MAXV(xmax, x);
+        ymin = MINV(ymin, y);
+        ymax = MAXV(ymax, y);
+    }
+    const double sx = 65535.0 / MAXV(xmax - xmin, 1e-12);
+    const double sy = 65535.0 / MAXV(ymax - ymin, 1e-12);
+    std::vector<uint64> codes(n);
+    std::vector<int> order = make_vector<int>(n);
+#pragma omp parallel for
+    for (int i = 0; i < n; ++i) {
+        const double x = 0.5 * (double(elems[i].rect.min(0)) + elems[i].rect.max(0));
+        const double y = 0.5 * (double(elems[i].rect.min(1)) + elems[i].rect.max(1));
+        codes[i] = hilbert_encode2(uint((x - xmin) * sx), uint((y - ymin) * sy));
+    }
+    sort_radix_syn(codes, order);
+
+#pragma omp parallel for
+    for (int i = 0; i < n; ++i) {
+        const Rect2<T>& rect = elems[order[i]].rect;
+        T* box = boxes + 4 * size_t(i);
+        box[0] = rect.min(0);
+        box[1] = rect.min(1);
+        box[2] = rect.max(0);
+        box[3] = rect.max(1);
+        data[i] = elems[order[i]].data;
+    }
+
+    /*the nodes of a level cover consecutive runs of node_size boxes of the level below. */
+    for (int level = 1; level < level_count; ++level) {
+        const int64 child_begin = level == 1 ? 0 : int64(level_end[level - 2]);
+        const int64 child_end = int64(level_end[level - 1]);
+        const int64 node_begin = child_end;
+        const int64 node_count = int64(level_end[level]) - node_begin;
+#pragma omp parallel for
+        for (int64 j = 0; j < node_count; ++j) {
+            const int64 first = child_begin + j * node_size;
+            const int64 last = MINV(first + node_size, child_end);
+            T* box = boxes + 4 * size_t(node_begin + j);
+            const T* child = boxes + 4 * size_t(first);
+            box[0] = child[0];
+            box[1] = child[1];
+            box[2] = child[2];
+            box[3] = child[3];
+            for (int64 i = first + 1; i < last; ++i) {
+                child = boxes + 4 * size_t(i);
+                box[0] = MINV(box[0], child[0]);
+                box[1] = MINV(box[1], child[1]);
+                box[2] = MAXV(box[2], child[2]);
+                box[3] = MAXV(box[3], child[3]);
+            }
+        }
+    }
+}
+
+template<typename T, typename DataType>
+bool PackedRTree2<T, DataType>::save(const std::string& path) const
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    const size_t size = size_t(_header->file_size);
+    bool ok = fwrite(_header, 1, size, file) == size;
+    ok = (fclose(file) == 0) && ok;
+    return ok;
+}
+
+template<typename T, typename DataType>
+bool PackedRTree2<T, DataType>::load(const std::string& path, bool map)
+{
+    clear();
+    if (map) {
+        if (_file.open(path) && attach(_file.data(), _file.size())) {
+            std::vector<uint64>().swap(_buffer);
+            return true;
+        }
+        clear();
+        return false;
+    }
+
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    std::vector<uint64> buffer;
+    Header header;
+    bool ok = fread(&header, sizeof(Header), 1, file) == 1 && header.file_size % 8 == 0;
+    if (ok) {
+        buffer.resize(size_t(header.file_size / 8));
+        memcpy(&buffer[0], &header, sizeof(Header));
+        const size_t rest = size_t(header.file_size) - sizeof(Header);
+        ok = fread(reinterpret_cast<char*>(&buffer[0]) + sizeof(Header), 1, rest, file) == rest &&
+            fgetc(file) == EOF;
+    }
+    fclose(file);
+    if (ok) {
+        _buffer.swap(buffer);
+        ok = attach(reinterpret_cast<const char*>(&_buffer[0]), _buffer.size() * 8);
+    }
+    if (!ok) {
+        clear();
+    }
+    return ok;
+}
+
+template<typename T, typename DataType>
+bool PackedRTree2<T, DataType>::attach(const char* buffer, size_t size)
+{
+    if (size < sizeof(Header)) {
+        return false;
+    }
+    const Header* header = reinterpret_cast<const Header*>(buffer);
+    if (memcmp(header->magic, magic(), 8) != 0 || header->version != VERSION ||
+        header->byte_order != BYTE_ORDER_MARK || header->coord_size != sizeof(T) ||
+        header->data_size != sizeof(DataType) || header->file_size != size ||
+        header->node_size < MIN_NODE_SIZE || header->node_size > MAX_NODE_SIZE ||
+        header->count > 0x7fffffff || header->box_count > 0xffffffffULL || header->level_count > 32 ||
+        header->boxes_offset != align8(sizeof(Header) + sizeof(uint64) * header->level_count) ||
+        header->data_offset != align8(header->boxes_offset + sizeof(T) * 4 * header->box_count) ||
+        header->file_size != align8(header->data_offset + sizeof(DataType) * header->count)) {
+        return false;
+    }
+
+    /*the levels must shrink by node_size up to one root node, so the searches stay in the buffer.
+     * The levels are the only part of the tree read here, the boxes are paged in by the searches.
+     */
+    const uint64* level_end = reinterpret_cast<const uint64*>(buffer + sizeof(Header));
+    if (header->count == 0) {
+        if (header->level_count != 0 || header->box_count != 0) {
+            return false;
+        }
+    } else {
+        if (header->level_count < 2 || level_end[0] != header->count ||
+            level_end[header->level_count - 1] != header->box_count ||
+            level_end[header->level_count - 1] - level_end[header->level_count - 2] != 1) {
+            return false;
+        }
+        for (uint level = 1; level < header->level_count; ++level) {
+            const uint64 below = level_end[level - 1] - (level > 1 ? level_end[level - 2] : 0);
+            if (level_end[level] - level_end[level - 1] != (below + header->node_size - 1) / header->node_size) {
+                return false;
+            }
+        }
+    }
+
+    _header = header;
+    _level_end = level_end;
+    _boxes = reinterpret_cast<const T*>(buffer + header->boxes_offset);
+    _data = reinterpret_cast<const DataType*>(buffer + header->data_offset);
+    return true;
+}
+
+}
+
+#endif
@@ -16,7 +16,10 @@
 #define MPCDPS_RTREE2_H
 
 #include <vector>
+#include <utility>
 #include "Rect2.h"
+#include "PublicFunc.h"
+#include "Morton.h"
 #include "RTreeTemplate.h"
 
 namespace mpcdps {
@@ -46,25 +49,85 @@ namespace mpcdps {
 		*/
 		void addElem(const RTreeElem& elem);
 
+		/*
+		  Build the tree from elems by STR packing, the existing elements are removed.
+		  It is much faster than adding the elements one by one, and the nodes are better packed for searching.
+		*/
+		void bulkLoad(const std::vector<RTreeElem>& elems);
+
 		/*
 		  All of the elements that intersect with rect will be added to the result set.
 		*/
-		std::vector<DataType> searchElems(const Rect2<T>& rect);
+		std::vector<DataType> searchElems(const Rect2<T>& rect) const;
 
 		/*
 		  All of the elements that contains the searching point.
 		*/
-		std::vector<DataType> searchElems(const Point2<T>& point);
+		std::vector<DataType> searchElems(const Point2<T>& point) const;
+
+		/*
+		  The same as above, but the results replace the contents of ids, so that its memory can be reused.
+		*/
+		void searchElems(const Rect2<T>& rect, std::vector<DataType>& ids) const;
+		void searchElems(const Point2<T>& point, std::vector<DataType>& ids) const;
+
+		/*
+		  Call visitor(data) for each element that intersects with rect, or contains point, until it returns false.
+		  Return the count of the elements visited. The visitor is inlined, and nothing is allocated,
+		  so const searches can run from many threads at once.
+		*/
+		template<typename Visitor>
+		int visitElems(const Rect2<T>& rect, Visitor&& visitor) const
+		{
+			return mTree.Search(rect.min_ptr(), rect.max_ptr(), std::forward<Visitor>(visitor));
+		}
+
+		template<typename Visitor>
+		int visitElems(const Point2<T>& point, Visitor&& visitor) const
+		{
+			return mTree.Search(point.buffer(), std::forward<Visitor>(visitor));
+		}
+
+		/*
+		  Count of the elements that intersect with rect.
+		*/
+		int countElems(const Rect2<T>& rect) const;
+
+		/*
+		  Whether any element intersects with rect, or contains point. The search stops at the first one.
+		*/
+		bool hasElem(const Rect2<T>& rect) const;
+		bool hasElem(const Point2<T>& point) const;
+
+		/*
+		  The k elements nearest to point by the distance to their rects, nearest first.
+		  dist2: squared distances of the elements if it is not NULL.
+		*/
+		std::vector<DataType> searchNearest(const Point2<T>& point, int k, std::vector<double>* dist2 = NULL) const;
+
+		/*
+		  The k nearest elements of each point, the elements of points[i] are [i * m, (i + 1) * m) of ids,
+		  where m = min(k, elemCount()) is returned.
+		  Points are searched in parallel in Morton order, so that the neighboring searches of a thread
+		  visit the same nodes, and each thread reuses its priority queue.
+		*/
+		int searchNearest(const std::vector<Point2<T> >& points, int k, std::vector<DataType>& ids,
+			std::vector<double>* dist2 = NULL) const;
+
+		/*
+		  All of the elements in the order of the leaves, e.g. to pack the tree into PackedRTree2.
+		*/
+		std::vector<RTreeElem> getElems() const;
 
 		void removeElem(const RTreeElem& elem);
 
-		int elemCount();
+		int elemCount() const;
 
-		bool isEmpty();
+		bool isEmpty() const;
 
 		void clear();
 
-		Rect2<T> getRootRect();
+		Rect2<T> getRootRect() const;
 
 	protected:
 	   typedef RTree<DataType, T, 2, float> RTCore;
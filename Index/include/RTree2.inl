@@ -38,27 +38,151 @@ void RTree2<T, DataType>::addElem(const RTreeElem& elem)
 }
 
 template<typename T, typename DataType>
-std::vector<DataType> RTree2<T, DataType>::searchElems(const Rect2<T>& rect)
+void RTree2<T, DataType>::bulkLoad(const std::vector<RTreeElem>& elems)
+{
+	const int n = elems.size();
+	std::vector<typename RTCore::Rect> rects(n);
+	std::vector<DataType> data(n);
+	for (int i = 0; i < n; ++i) {
+		for (int k = 0; k < 2; ++k) {
+			rects[i].m_min[k] = elems[i].rect.min_ptr()[k];
+			rects[i].m_max[k] = elems[i].rect.max_ptr()[k];
+		}
+		data[i] = elems[i].data;
+	}
+	mTree.BulkLoad(rects.empty() ? NULL : &rects[0], data.empty() ? NULL : &data[0], n);
+}
+
+template<typename T, typename DataType>
+std::vector<DataType> RTree2<T, DataType>::searchElems(const Rect2<T>& rect) const
+{
+	std::vector<DataType> ids;
+	searchElems(rect, ids);
+	return ids;
+}
+
+template<typename T, typename DataType>
+std::vector<DataType> RTree2<T, DataType>::searchElems(const Point2<T>& point) const
 {
 	std::vector<DataType> ids;
-	if(isEmpty())
-		return ids;
-	mTree.Search(rect.min_ptr(), rect.max_ptr(), ids);
+	searchElems(point, ids);
 	return ids;
 }
 
 template<typename T, typename DataType>
-std::vector<DataType> RTree2<T, DataType>::searchElems(const Point2<T>& point)
+void RTree2<T, DataType>::searchElems(const Rect2<T>& rect, std::vector<DataType>& ids) const
+{
+	ids.clear();
+	visitElems(rect, [&ids](const DataType& data) {
+		ids.push_back(data);
+		return true;
+	});
+}
+
+template<typename T, typename DataType>
+void RTree2<T, DataType>::searchElems(const Point2<T>& point, std::vector<DataType>& ids) const
+{
+	ids.clear();
+	visitElems(point, [&ids](const DataType& data) {
+		ids.push_back(data);
+		return true;
+	});
+}
+
+template<typename T, typename DataType>
+int RTree2<T, DataType>::countElems(const Rect2<T>& rect) const
+{
+	return mTree.Count(rect.min_ptr(), rect.max_ptr());
+}
+
+template<typename T, typename DataType>
+bool RTree2<T, DataType>::hasElem(const Rect2<T>& rect) const
+{
+	return mTree.Any(rect.min_ptr(), rect.max_ptr());
+}
+
+template<typename T, typename DataType>
+bool RTree2<T, DataType>::hasElem(const Point2<T>& point) const
+{
+	return mTree.Any(point.buffer());
+}
+
+template<typename T, typename DataType>
+std::vector<DataType> RTree2<T, DataType>::searchNearest(const Point2<T>& point, int k, std::vector<double>* dist2) const
 {
 	std::vector<DataType> ids;
-	if(isEmpty())
-		return ids;
-	mTree.Search(point, ids);
+	mTree.NearestNeighbors(point.buffer(), k, ids, dist2);
 	return ids;
 }
 
 template<typename T, typename DataType>
-int RTree2<T, DataType>::elemCount()
+int RTree2<T, DataType>::searchNearest(const std::vector<Point2<T> >& points, int k, std::vector<DataType>& ids,
+	std::vector<double>* dist2) const
+{
+	const int n = points.size();
+	ids.clear();
+	if (dist2) {
+		dist2->clear();
+	}
+	if (n == 0 || k <= 0 || mTree.GetRootNode()->m_count == 0) {
+		return 0;
+	}
+
+	/*Morton codes of the points on a 2^16 x 2^16 grid of their bounding box. */
+	double xmin = points[0].x(), xmax = xmin, ymin = points[0].y(), ymax = ymin;
+	for (int i = 1; i < n; ++i) {
+		xmin = MINV(xmin, double(points[i].x()));
+		xmax = MAXV(xmax, double(points[i].x()));
+		ymin = MINV(ymin, double(points[i].y()));
+		ymax = MAXV(ymax, double(points[i].y()));
+	}
+	const double sx = 65535.0 / MAXV(xmax - xmin, 1e-12);
+	const double sy = 65535.0 / MAXV(ymax - ymin, 1e-12);
+	std::vector<uint64> codes(n);
+	std::vector<int> order = make_vector<int>(n);
+#pragma omp parallel for
+	for (int i = 0; i < n; ++i) {
+		codes[i] = morton_encode2(uint((points[i].x() - xmin) * sx), uint((points[i].y() - ymin) * sy));
+	}
+	sort_radix_syn(codes, order);
+
+	/*every search finds min(k, count of elements) elements. */
+	std::vector<DataType> first;
+	const int m = mTree.NearestNeighbors(points[0].buffer(), k, first);
+	ids.resize(size_t(n) * m);
+	if (dist2) {
+		dist2->resize(size_t(n) * m);
+	}
+#pragma omp parallel
+	{
+		typename RTCore::NearestQueue queue;
+		std::vector<DataType> result;
+		std::vector<double> result_dist2;
+#pragma omp for schedule(dynamic, 256)
+		for (int j = 0; j < n; ++j) {
+			const int i = order[j];
+			mTree.NearestNeighbors(points[i].buffer(), m, queue, result, dist2 ? &result_dist2 : NULL);
+			std::copy(result.begin(), result.end(), ids.begin() + size_t(i) * m);
+			if (dist2) {
+				std::copy(result_dist2.begin(), result_dist2.end(), dist2->begin() + size_t(i) * m);
+			}
+		}
+	}
+	return m;
+}
+
+template<typename T, typename DataType>
+std::vector<typename RTree2<T, DataType>::RTreeElem> RTree2<T, DataType>::getElems() const
+{
+	std::vector<RTreeElem> elems;
+	mTree.ForEachEntry([&elems](const typename RTCore::Rect& rect, const DataType& data) {
+		elems.push_back(RTreeElem(data, Rect2<T>(rect.m_min[0], rect.m_max[0], rect.m_min[1], rect.m_max[1])));
+	});
+	return elems;
+}
+
+template<typename T, typename DataType>
+int RTree2<T, DataType>::elemCount() const
 {
 	return mTree.Count();
 }
@@ -70,9 +194,9 @@ void RTree2<T, DataType>::removeElem(const RTreeElem& elem)
 }
 
 template<typename T, typename DataType>
-bool RTree2<T, DataType>::isEmpty()
+bool RTree2<T, DataType>::isEmpty() const
 {
-	return mTree.Count() == 0;
+	return mTree.GetRootNode()->m_count == 0;
 }
 
 template<typename T, typename DataType>
@@ -82,7 +206,7 @@ void RTree2<T, DataType>::clear()
 }
 
 template<typename T, typename DataType>
-Rect2<T> RTree2<T, DataType>::getRootRect()
+Rect2<T> RTree2<T, DataType>::getRootRect() const
 {
 	typename RTCore::Rect r = mTree.NodeCover(mTree.GetRootNode());
 	return Rect2<T>(r.m_min, r.m_max);
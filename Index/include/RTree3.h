@@ -0,0 +1,148 @@
+/*
+**********************************************************************
+*
+* This file is a part of library MPCDPS(Massive Point Cloud Data Processing System).
+* It is a free program and it is protected by the license GPL-v3.0, you may not use the
+* file except in compliance with the License.
+*
+* Copyright(c) 2013 - 2020 Xu Shengpan, all rights reserved.
+*
+* Email: jack_1227x@163.com
+*
+**********************************************************************
+*/
+
+#ifndef MPCDPS_RTREE3_H
+#define MPCDPS_RTREE3_H
+
+#include <vector>
+#include <utility>
+#include "Box3.h"
+#include "PublicFunc.h"
+#include "Morton.h"
+#include "RTreeTemplate.h"
+
+namespace mpcdps {
+    /* \brief RTree for 3D, e.g. for the bounding boxes of clusters or building elements.
+     * T: type of box, e.g. float; DataType: type of data that saved in a box node.
+    */
+	template<typename T, typename DataType>
+	class RTree3
+	{
+	public:
+		RTree3();
+		~RTree3();
+
+		struct RTreeElem
+		{
+			DataType data;
+			Box3<T> box;
+
+			RTreeElem(DataType d, const Box3<T>& b):data(d), box(b)
+			{
+			}
+		};
+
+		/*Relation between the searching box and the boxes of the found elements. */
+		enum SearchMode
+		{
+			SEARCH_INTERSECTS = 0,  /*the element intersects with the box. */
+			SEARCH_CONTAINED = 1,   /*the element is contained by the box. */
+			SEARCH_CONTAINING = 2   /*the element contains the box. */
+		};
+
+		void addElem(const RTreeElem& elem);
+
+		/*
+		  Build the tree from elems by STR packing, the existing elements are removed.
+		  It is much faster than adding the elements one by one, and the nodes are better packed for searching.
+		*/
+		void bulkLoad(const std::vector<RTreeElem>& elems);
+
+		/*
+		  All of the elements that have the relation mode with box.
+		*/
+		std::vector<DataType> searchElems(const Box3<T>& box, SearchMode mode = SEARCH_INTERSECTS) const;
+
+		/*
+		  All of the elements that contains the searching point.
+		*/
+		std::vector<DataType> searchElems(const Point3<T>& point) const;
+
+		/*
+		  The same as above, but the results replace the contents of ids, so that its memory can be reused.
+		*/
+		void searchElems(const Box3<T>& box, std::vector<DataType>& ids, SearchMode mode = SEARCH_INTERSECTS) const;
+		void searchElems(const Point3<T>& point, std::vector<DataType>& ids) const;
+
+		/*
+		  Search all of the boxes in parallel, the results are in CSR layout: the elements of boxes[i]
+		  are ids[offsets[i], offsets[i + 1]).
+		  Boxes are searched in Morton order of their centers, so that the neighboring searches of a thread
+		  visit the same nodes. Searching the boxes of the elements themselves finds all of the overlapping pairs.
+		*/
+		void searchElems(const std::vector<Box3<T> >& boxes, std::vector<int>& offsets, std::vector<DataType>& ids,
+			SearchMode mode = SEARCH_INTERSECTS) const;
+
+		/*
+		  Call visitor(data) for each element that has the relation mode with box, or contains point,
+		  until it returns false. Return the count of the elements visited. The visitor is inlined,
+		  and nothing is allocated, so const searches can run from many threads at once.
+		*/
+		template<typename Visitor>
+		int visitElems(const Box3<T>& box, Visitor&& visitor, SearchMode mode = SEARCH_INTERSECTS) const
+		{
+			if (mode == SEARCH_CONTAINED) {
+				return mTree.SearchContained(box.min_ptr(), box.max_ptr(), std::forward<Visitor>(visitor));
+			}
+			if (mode == SEARCH_CONTAINING) {
+				return mTree.SearchContaining(box.min_ptr(), box.max_ptr(), std::forward<Visitor>(visitor));
+			}
+			return mTree.Search(box.min_ptr(), box.max_ptr(), std::forward<Visitor>(visitor));
+		}
+
+		template<typename Visitor>
+		int visitElems(const Point3<T>& point, Visitor&& visitor) const
+		{
+			return mTree.Search(point.buffer(), std::forward<Visitor>(visitor));
+		}
+
+		/*
+		  Count of the elements that have the relation mode with box.
+		*/
+		int countElems(const Box3<T>& box, SearchMode mode = SEARCH_INTERSECTS) const;
+
+		/*
+		  Whether any element has the relation mode with box, or contains point. The search stops at the first one.
+		*/
+		bool hasElem(const Box3<T>& box, SearchMode mode = SEARCH_INTERSECTS) const;
+		bool hasElem(const Point3<T>& point) const;
+
+		/*
+		  The k elements nearest to point by the distance to their boxes, nearest first.
+		  dist2: squared distances of the elements if it is not NULL.
+		*/
+		std::vector<DataType> searchNearest(const Point3<T>& point, int k, std::vector<double>* dist2 = NULL) const;
+
+		void removeElem(const RTreeElem& elem);
+
+		int elemCount() const;
+
+		bool isEmpty() const;
+
+		void clear();
+
+		Box3<T> getRootBox() const;
+
+	protected:
+	   typedef RTree<DataType, T, 3, float> RTCore;
+	   RTCore mTree;
+
+	};
+
+#include "RTree3.inl"
+
+}
+
+
+#endif
@@ -0,0 +1,220 @@
+/*
+**********************************************************************
+*
+* This file is a part of library MPCDPS(Massive Point Cloud Data Processing System).
+* It is a free program and it is protected by the license GPL-v3.0, you may not use the
+* file except in compliance with the License.
+*
+* Copyright(c) 2013 - 2020 Xu Shengpan, all rights reserved.
+*
+* Email: jack_1227x@163.com
+*
+**********************************************************************
+*/
+
+template<typename T, typename DataType>
+RTree3<T, DataType>::RTree3()
+{
+}
+
+template<typename T, typename DataType>
+RTree3<T, DataType>::~RTree3()
+{
+
+}
+
+template<typename T, typename DataType>
+void RTree3<T, DataType>::addElem(const RTreeElem& elem)
+{
+	mTree.Insert(elem.box.min_ptr(), elem.box.max_ptr(), elem.data);
+}
+
+template<typename T, typename DataType>
+void RTree3<T, DataType>::bulkLoad(const std::vector<RTreeElem>& elems)
+{
+	const int n = elems.size();
+	std::vector<typename RTCore::Rect> rects(n);
+	std::vector<DataType> data(n);
+	for (int i = 0; i < n; ++i) {
+		for (int k = 0; k < 3; ++k) {
+			rects[i].m_min[k] = elems[i].box.min(k);
+			rects[i].m_max[k] = elems[i].box.max(k);
+		}
+		data[i] = elems[i].data;
+	}
+	mTree.BulkLoad(rects.empty() ? NULL : &rects[0], data.empty() ? NULL : &data[0], n);
+}
+
+template<typename T, typename DataType>
+std::vector<DataType> RTree3<T, DataType>::searchElems(const Box3<T>& box, SearchMode mode) const
+{
+	std::vector<DataType> ids;
+	searchElems(box, ids, mode);
+	return ids;
+}
+
+template<typename T, typename DataType>
+std::vector<DataType> RTree3<T, DataType>::searchElems(const Point3<T>& point) const
+{
+	std::vector<DataType> ids;
+	searchElems(point, ids);
+	return ids;
+}
+
+template<typename T, typename DataType>
+void RTree3<T, DataType>::searchElems(const Box3<T>& box, std::vector<DataType>& ids, SearchMode mode) const
+{
+	ids.clear();
+	visitElems(box, [&ids](const DataType& data) {
+		ids.push_back(data);
+		return true;
+	}, mode);
+}
+
+template<typename T, typename DataType>
+void RTree3<T, DataType>::searchElems(const Point3<T>& point, std::vector<DataType>& ids) const
+{
+	ids.clear();
+	visitElems(point, [&ids](const DataType& data) {
+		ids.push_back(data);
+		return true;
+	});
+}
+
+template<typename T, typename DataType>
+void RTree3<T, DataType>::searchElems(const std::vector<Box3<T> >& boxes, std::vector<int>& offsets,
+	std::vector<DataType>& ids, SearchMode mode) const
+{
+	const int n = boxes.size();
+	offsets.assign(n + 1, 0);
+	ids.clear();
+	if (n == 0 || isEmpty()) {
+		return;
+	}
+
+	/*Morton codes of the box centers on a 2^21 grid of their bounding box. */
+	double vmin[3], vmax[3], scale[3];
+	for (int k = 0; k < 3; ++k) {
+		vmin[k] = vmax[k] = 0.5 * (double(boxes[0].min(k)) + boxes[0].max(k));
+	}
+	for (int i = 1; i < n; ++i) {
+		for (int k = 0; k < 3; ++k) {
+			double v = 0.5 * (double(boxes[i].min(k)) + boxes[i].max(k));
+			vmin[k] = MINV(vmin[k], v);
+			vmax[k] = MAXV(vmax[k], v);
+		}
+	}
+	for (int k = 0; k < 3; ++k) {
+		scale[k] = 2097151.0 / MAXV(vmax[k] - vmin[k], 1e-12);
+	}
+	std::vector<uint64> codes(n);
+	std::vector<int> order = make_vector<int>(n);
+#pragma omp parallel for
+	for (int i = 0; i < n; ++i) {
+		uint c[3];
+		for (int k = 0; k < 3; ++k) {
+			c[k] = uint((0.5 * (double(boxes[i].min(k)) + boxes[i].max(k)) - vmin[k]) * scale[k]);
+		}
+		codes[i] = morton_encode3(c[0], c[1], c[2]);
+	}
+	sort_radix_syn(codes, order);
+
+	/*each block of the sorted boxes is searched into its own buffer, and the buffers are copied
+	 * to the slots of the boxes after the offsets are known.
+	 */
+	const int block_size = 256;
+	const int n_block = (n + block_size - 1) / block_size;
+	std::vector<std::vector<DataType> > block_ids(n_block);
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int b = 0; b < n_block; ++b) {
+		std::vector<DataType>& result = block_ids[b];
+		const int end = MINV(n, (b + 1) * block_size);
+		for (int j = b * block_size; j < end; ++j) {
+			const int i = order[j];
+			offsets[i + 1] = visitElems(boxes[i], [&result](const DataType& data) {
+				result.push_back(data);
+				return true;
+			}, mode);
+		}
+	}
+	for (int i = 0; i < n; ++i) {
+		offsets[i + 1] += offsets[i];
+	}
+
+	ids.resize(offsets[n]);
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int b = 0; b < n_block; ++b) {
+		const DataType* src = block_ids[b].empty() ? NULL : &block_ids[b][0];
+		const int end = MINV(n, (b + 1) * block_size);
+		for (int j = b * block_size; j < end; ++j) {
+			const int i = order[j];
+			const int count = offsets[i + 1] - offsets[i];
+			std::copy(src, src + count, ids.begin() + offsets[i]);
+			src += count;
+		}
+		std::vector<DataType>().swap(block_ids[b]);
+	}
+}
+
+template<typename T, typename DataType>
+int RTree3<T, DataType>::countElems(const Box3<T>& box, SearchMode mode) const
+{
+	if (mode == SEARCH_INTERSECTS) {
+		return mTree.Count(box.min_ptr(), box.max_ptr());
+	}
+	return visitElems(box, [](const DataType&) { return true; }, mode);
+}
+
+template<typename T, typename DataType>
+bool RTree3<T, DataType>::hasElem(const Box3<T>& box, SearchMode mode) const
+{
+	if (mode == SEARCH_INTERSECTS) {
+		return mTree.Any(box.min_ptr(), box.max_ptr());
+	}
+	return visitElems(box, [](const DataType&) { return false; }, mode) > 0;
+}
+
+template<typename T, typename DataType>
+bool RTree3<T, DataType>::hasElem(const Point3<T>& point) const
+{
+	return mTree.Any(point.buffer());
+}
+
+template<typename T, typename DataType>
+std::vector<DataType> RTree3<T, DataType>::searchNearest(const Point3<T>& point, int k, std::vector<double>* dist2) const
+{
+	std::vector<DataType> ids;
+	mTree.NearestNeighbors(point.buffer(), k, ids, dist2);
+	return ids;
+}
+
+template<typename T, typename DataType>
+int RTree3<T, DataType>::elemCount() const
+{
+	return mTree.Count();
+}
+
+template<typename T, typename DataType>
+void RTree3<T, DataType>::removeElem(const RTreeElem& elem)
+{
+	mTree.Remove(elem.box.min_ptr(), elem.box.max_ptr(), elem.data);
+}
+
+template<typename T, typename DataType>
+bool RTree3<T, DataType>::isEmpty() const
+{
+	return mTree.GetRootNode()->m_count == 0;
+}
+
+template<typename T, typename DataType>
+void RTree3<T, DataType>::clear()
+{
+	mTree.RemoveAll();
+}
+
+template<typename T, typename DataType>
+Box3<T> RTree3<T, DataType>::getRootBox() const
+{
+	typename RTCore::Rect r = mTree.NodeCover(mTree.GetRootNode());
+	return Box3<T>(r.m_min, r.m_max);
+}
@@ -16,6 +16,9 @@
 
 #include <algorithm>
 #include <functional>
+#include <new>
+#include <type_traits>
+#include <vector>
 
 #define ASSERT assert // RTree uses ASSERT( condition )
 #ifndef Min
@@ -32,13 +35,125 @@
 #define RTREE_TEMPLATE template<class DATATYPE, class ELEMTYPE, int NUMDIMS, class ELEMTYPEREAL, int TMAXNODES, int TMINNODES>
 #define RTREE_QUAL RTree<DATATYPE, ELEMTYPE, NUMDIMS, ELEMTYPEREAL, TMAXNODES, TMINNODES>
 
-#define RTREE_DONT_USE_MEMPOOLS // This version does not contain a fixed memory allocator, fill in lines with EXAMPLE to implement one.
+//#define RTREE_DONT_USE_MEMPOOLS // Define it before including this file to allocate nodes with new/delete instead of RTreeMemPool.
 #define RTREE_USE_SPHERICAL_VOLUME // Better split classification, may be slower on some systems
 
 // Fwd decl
 class RTFileStream;  // File I/O helper class, look below for implementation and notes.
 
 
+/// \class RTreeMemPool
+/// Fixed size allocator for the nodes of RTree: blocks are carved from slabs, each block is aligned to
+/// a cache line, and freed blocks are kept in a free list for reuse.
+/// Memory is returned to the system only when the pool is destroyed, Reset() frees all blocks at once.
+/// The pool is not thread safe.
+class RTreeMemPool
+{
+public:
+
+  enum
+  {
+    CACHE_LINE = 64,                              ///< Alignment and size granularity of blocks
+    MIN_SLAB_BLOCKS = 64,                         ///< Blocks of the first slab
+    MAX_SLAB_BLOCKS = 4096,                       ///< Slabs grow by 2x up to this count of blocks
+  };
+
+  RTreeMemPool(size_t a_size)
+  {
+    m_blockSize = (Max(a_size, sizeof(FreeBlock)) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    m_free = NULL;
+  }
+
+  ~RTreeMemPool()
+  {
+    for(size_t index = 0; index < m_slabs.size(); ++index)
+    {
+      ::operator delete(m_slabs[index].m_memory);
+    }
+  }
+
+  void* Alloc()
+  {
+    if(!m_free)
+    {
+      AddSlab();
+    }
+    FreeBlock* block = m_free;
+    m_free = block->m_next;
+    return block;
+  }
+
+  void Free(void* a_block)
+  {
+    FreeBlock* block = (FreeBlock*)a_block;
+    block->m_next = m_free;
+    m_free = block;
+  }
+
+  /// Free all blocks, the slabs are kept for reuse
+  void Reset()
+  {
+    m_free = NULL;
+    for(size_t index = m_slabs.size(); index-- > 0; )
+    {
+      PushSlab(m_slabs[index]);
+    }
+  }
+
+  /// Bytes of the slabs
+  size_t Capacity() const
+  {
+    size_t bytes = 0;
+    for(size_t index = 0; index < m_slabs.size(); ++index)
+    {
+      bytes += m_slabs[index].m_count * m_blockSize;
+    }
+    return bytes;
+  }
+
+private:
+
+  struct FreeBlock
+  {
+    FreeBlock* m_next;
+  };
+
+  struct Slab
+  {
+    void* m_memory;                               ///< Memory from operator new
+    char* m_first;                                ///< First aligned block
+    size_t m_count;                               ///< Count of blocks
+  };
+
+  void AddSlab()
+  {
+    Slab slab;
+    slab.m_count = m_slabs.empty() ? (size_t)MIN_SLAB_BLOCKS : Min((size_t)MAX_SLAB_BLOCKS, 2 * m_slabs.back().m_count);
+    slab.m_memory = ::operator new(slab.m_count * m_blockSize + CACHE_LINE - 1);
+    size_t address = ((size_t)slab.m_memory + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    slab.m_first = (char*)address;
+    m_slabs.push_back(slab);
+    PushSlab(slab);
+  }
+
+  // Push the blocks in reverse, so that they are allocated in address order
+  void PushSlab(const Slab& a_slab)
+  {
+    for(size_t index = a_slab.m_count; index-- > 0; )
+    {
+      Free(a_slab.m_first + index * m_blockSize);
+    }
+  }
+
+  RTreeMemPool(const RTreeMemPool&);
+  RTreeMemPool& operator=(const RTreeMemPool&);
+
+  size_t m_blockSize;
+  FreeBlock* m_free;
+  std::vector<Slab> m_slabs;
+};
+
+
 /// \class RTree
 /// Implementation of RTree, a multidimensional bounding rectangle tree.
 /// Example usage: For a 3-dimensional tree use RTree<Object*, float, 3> myTree;
@@ -51,7 +166,7 @@ class RTFileStream;  // File I/O helper class, look below for implementation and
 /// ELEMTYPEREAL Type of element that allows fractional and large values such as float or double, for use in volume calcs
 ///
 /// NOTES: Inserting and removing data requires the knowledge of its constant Minimal Bounding Rectangle.
-///        This version uses new/delete for nodes, I recommend using a fixed size allocator for efficiency.
+///        Nodes are allocated from RTreeMemPool, define RTREE_DONT_USE_MEMPOOLS to use new/delete.
 ///        Instead of using a callback function for returned results, I recommend and efficient pre-sized, grow-only memory
 ///        array similar to MFC CArray or STL Vector for returning search query result.
 ///
@@ -78,6 +193,8 @@ public:
   RTree();
   RTree(const RTree& other);
   virtual ~RTree();
+
+  RTree& operator=(const RTree& other);
   
   /// Insert entry
   /// \param a_min Min of bounding rect
@@ -105,18 +222,80 @@ public:
   /// \param a_max Max of search bounding rect
   /// \param searchResult for data of search bounding rect
   /// \return Returns the number of entries found
-  int Search(const ELEMTYPE a_min[NUMDIMS], const ELEMTYPE a_max[NUMDIMS], std::vector<DATATYPE>& searchResult);
+  int Search(const ELEMTYPE a_min[NUMDIMS], const ELEMTYPE a_max[NUMDIMS], std::vector<DATATYPE>& searchResult) const;
 
   /// Find all which contain the search point
   /// \param searchResult for data of search bounding rect
   /// \return Returns the number of entries found
-  int Search(const ELEMTYPE point[NUMDIMS], std::vector<DATATYPE>& searchResult);
+  int Search(const ELEMTYPE point[NUMDIMS], std::vector<DATATYPE>& searchResult) const;
+
+  /// Find all within search rectangle, the visitor is called for each of them and is inlined.
+  /// The search is iterative with a fixed stack, const searches can run from many threads at once.
+  /// \param a_visitor Called as a_visitor(const DATATYPE&), return false to stop searching
+  /// \return Returns the number of entries visited
+  template<typename VISITOR>
+  int Search(const ELEMTYPE a_min[NUMDIMS], const ELEMTYPE a_max[NUMDIMS], VISITOR&& a_visitor) const;
+
+  /// Find all which contain the search point, the visitor is called for each of them
+  template<typename VISITOR>
+  int Search(const ELEMTYPE point[NUMDIMS], VISITOR&& a_visitor) const;
+
+  /// Count all within search rectangle without returning them
+  int Count(const ELEMTYPE a_min[NUMDIMS], const ELEMTYPE a_max[NUMDIMS]) const;
+
+  /// Is there any entry within search rectangle, the search stops at the first one
+  bool Any(const ELEMTYPE a_min[NUMDIMS], const ELEMTYPE a_max[NUMDIMS]) const;
+
+  /// Is there any entry which contains the search point
+  bool Any(const ELEMTYPE point[NUMDIMS]) const;
+
+  /// Find all which are contained by the search rectangle, the visitor is called for each of them
+  template<typename VISITOR>
+  int SearchContained(const ELEMTYPE a_min[NUMDIMS], const ELEMTYPE a_max[NUMDIMS], VISITOR&& a_visitor) const;
+
+  /// Find all which contain the search rectangle, the visitor is called for each of them
+  template<typename VISITOR>
+  int SearchContaining(const ELEMTYPE a_min[NUMDIMS], const ELEMTYPE a_max[NUMDIMS], VISITOR&& a_visitor) const;
+
+  /// Call a_visitor(const Rect&, const DATATYPE&) for all entries, e.g. to export the tree
+  template<typename VISITOR>
+  void ForEachEntry(VISITOR&& a_visitor) const;
   
+  /// Entry of the priority queue of the nearest neighbor search
+  struct NearestEntry
+  {
+    double m_dist2;                               ///< Squared MINDIST from the query point
+    const Node* m_node;                           ///< Child node, or NULL for data
+    DATATYPE m_data;                              ///< Data if m_node is NULL
+
+    bool operator<(const NearestEntry& other) const { return m_dist2 > other.m_dist2; } // min heap
+  };
+
+  /// Priority queue of the nearest neighbor search, it can be reused by the searches of a thread
+  typedef std::vector<NearestEntry> NearestQueue;
+
+  /// Find the a_k entries nearest to a point by the distance to their rects, best first by MINDIST.
+  /// \param a_point Query point
+  /// \param a_k Count of neighbors
+  /// \param a_queue Priority queue, it is cleared
+  /// \param a_result Data of the neighbors nearest first, function will reset, not append to array
+  /// \param a_dist2 If it is not NULL, squared distances of the neighbors
+  /// \return Returns the number of entries found
+  int NearestNeighbors(const ELEMTYPE a_point[NUMDIMS], int a_k, NearestQueue& a_queue,
+    std::vector<DATATYPE>& a_result, std::vector<double>* a_dist2 = NULL) const;
+
+  int NearestNeighbors(const ELEMTYPE a_point[NUMDIMS], int a_k,
+    std::vector<DATATYPE>& a_result, std::vector<double>* a_dist2 = NULL) const
+  {
+    NearestQueue queue;
+    return NearestNeighbors(a_point, a_k, queue, a_result, a_dist2);
+  }
+
   /// Remove all entries from tree
   void RemoveAll();
 
   /// Count the data elements in this container.  This is slow as no internal counter is maintained.
-  int Count();
+  int Count() const;
 
   /// Load tree contents from file
   bool Load(const char* a_fileName);
@@ -141,7 +320,14 @@ public:
       ELEMTYPE m_max[NUMDIMS];                      ///< Max dimensions of bounding box 
   };
 
-  Rect NodeCover(const Node* a_node);
+  Rect NodeCover(const Node* a_node) const;
+
+  /// Build the tree from entries by Sort-Tile-Recursive packing, the existing entries are removed.
+  /// Nodes are fully packed except the last nodes of each level, the tiles are partitioned in parallel with OpenMP.
+  /// \param a_rects Bounding rects of entries
+  /// \param a_data Data of entries
+  /// \param a_count Count of entries
+  void BulkLoad(const Rect* a_rects, const DATATYPE* a_data, int a_count);
 
   /// Iterator is not remove safe.
   class Iterator
@@ -319,8 +505,8 @@ protected:
   /// Node for each branch level
   struct Node
   {
-    bool IsInternalNode()                         { return (m_level > 0); } // Not a leaf, but a internal node
-    bool IsLeaf()                                 { return (m_level == 0); } // A leaf, contains data
+    bool IsInternalNode() const                   { return (m_level > 0); } // Not a leaf, but a internal node
+    bool IsLeaf() const                           { return (m_level == 0); } // A leaf, contains data
     
     int m_count;                                  ///< Count
     int m_level;                                  ///< Leaf is zero, others positive
@@ -361,7 +547,7 @@ protected:
   bool AddBranch(const Branch* a_branch, Node* a_node, Node** a_newNode);
   void DisconnectBranch(Node* a_node, int a_index);
   int PickBranch(const Rect* a_rect, Node* a_node);
-  Rect CombineRect(const Rect* a_rectA, const Rect* a_rectB);
+  Rect CombineRect(const Rect* a_rectA, const Rect* a_rectB) const;
   void SplitNode(Node* a_node, const Branch* a_branch, Node** a_newNode);
   ELEMTYPEREAL RectSphericalVolume(Rect* a_rect);
   ELEMTYPEREAL RectVolume(Rect* a_rect);
@@ -376,16 +562,23 @@ protected:
   bool RemoveRectRec(Rect* a_rect, const DATATYPE& a_id, Node* a_node, ListNode** a_listNode);
   ListNode* AllocListNode();
   void FreeListNode(ListNode* a_listNode);
-  bool Overlap(Rect* a_rectA, Rect* a_rectB) const;
-  bool Contains(Rect* a_rect, const ELEMTYPE point[NUMDIMS]);
+  bool Overlap(const Rect* a_rectA, const Rect* a_rectB) const;
+  double MinDist2(const Rect* a_rect, const ELEMTYPE a_point[NUMDIMS]) const;
+  bool Contains(const Rect* a_rect, const ELEMTYPE point[NUMDIMS]) const;
+  bool Contains(const Rect* a_outer, const Rect* a_inner) const;
 
   void ReInsert(Node* a_node, ListNode** a_listNode);
+  void STRTile(Branch* a_branches, int a_count, int a_dim);
+  void STRSplit(Branch* a_branches, int a_count, int a_group, int a_dim);
+  Node* PackLevel(std::vector<Branch>& a_branches, int a_level);
   bool Search(Node* a_node, Rect* a_rect, int& a_foundCount, std::function<bool (const DATATYPE&)> callback) const;
-  bool Search(Node* a_node, Rect* a_rect, std::vector<DATATYPE>& searchResult);
-  bool Search(Node* a_node, const ELEMTYPE point[NUMDIMS], std::vector<DATATYPE>& searchResult);
+  bool Search(Node* a_node, const Rect* a_rect, std::vector<DATATYPE>& searchResult) const;
+  bool Search(Node* a_node, const ELEMTYPE point[NUMDIMS], std::vector<DATATYPE>& searchResult) const;
+  template<typename NODETEST, typename LEAFTEST, typename VISITOR>
+  int Visit(const NODETEST& a_nodeTest, const LEAFTEST& a_leafTest, VISITOR& a_visitor) const;
   void RemoveAllRec(Node* a_node);
   void Reset();
-  void CountRec(Node* a_node, int& a_count);
+  void CountRec(const Node* a_node, int& a_count) const;
 
   bool SaveRec(Node* a_node, RTFileStream& a_stream);
   bool LoadRec(Node* a_node, RTFileStream& a_stream);
@@ -393,6 +586,10 @@ protected:
 
   Node* m_root;                                    ///< Root of tree
   ELEMTYPEREAL m_unitSphereVolume;                 ///< Unit sphere constant for required number of dimensions
+#ifndef RTREE_DONT_USE_MEMPOOLS
+  RTreeMemPool m_nodePool;                         ///< Pool of Node
+  RTreeMemPool m_listNodePool;                     ///< Pool of ListNode
+#endif // RTREE_DONT_USE_MEMPOOLS
 };
 
 
@@ -476,6 +673,9 @@ public:
 
 RTREE_TEMPLATE
 RTREE_QUAL::RTree()
+#ifndef RTREE_DONT_USE_MEMPOOLS
+  : m_nodePool(sizeof(Node)), m_listNodePool(sizeof(ListNode))
+#endif // RTREE_DONT_USE_MEMPOOLS
 {
   ASSERT(MAXNODES > MINNODES);
   ASSERT(MINNODES > 0);
@@ -504,6 +704,18 @@ RTREE_QUAL::RTree(const RTree& other) : RTree()
 }
 
 
+RTREE_TEMPLATE
+RTREE_QUAL& RTREE_QUAL::operator=(const RTree& other)
+{
+  if(this != &other)
+  {
+    RemoveAll();
+    CopyRec(m_root, other.m_root);
+  }
+  return *this;
+}
+
+
 RTREE_TEMPLATE
 RTREE_QUAL::~RTree()
 {
@@ -584,7 +796,7 @@ int RTREE_QUAL::Search(const ELEMTYPE a_min[NUMDIMS], const ELEMTYPE a_max[NUMDI
 }
 
 RTREE_TEMPLATE
-int RTREE_QUAL::Search(const ELEMTYPE a_min[NUMDIMS], const ELEMTYPE a_max[NUMDIMS], std::vector<DATATYPE>& searchResult)
+int RTREE_QUAL::Search(const ELEMTYPE a_min[NUMDIMS], const ELEMTYPE a_max[NUMDIMS], std::vector<DATATYPE>& searchResult) const
 {
 #ifdef _DEBUG
     for (int index = 0; index < NUMDIMS; ++index)
@@ -609,7 +821,7 @@ int RTREE_QUAL::Search(const ELEMTYPE a_min[NUMDIMS], const ELEMTYPE a_max[NUMDI
 }
 
 RTREE_TEMPLATE
-int RTREE_QUAL::Search(const ELEMTYPE point[NUMDIMS], std::vector<DATATYPE>& searchResult)
+int RTREE_QUAL::Search(const ELEMTYPE point[NUMDIMS], std::vector<DATATYPE>& searchResult) const
 {
     // NOTE: May want to return search result another way, perhaps returning the number of found elements here.
 
@@ -619,7 +831,218 @@ int RTREE_QUAL::Search(const ELEMTYPE point[NUMDIMS], std::vector<DATATYPE>& sea
 }
 
 RTREE_TEMPLATE
-int RTREE_QUAL::Count()
+template<typename VISITOR>
+int RTREE_QUAL::Search(const ELEMTYPE a_min[NUMDIMS], const ELEMTYPE a_max[NUMDIMS], VISITOR&& a_visitor) const
+{
+  Rect rect;
+  for(int axis = 0; axis < NUMDIMS; ++axis)
+  {
+    rect.m_min[axis] = a_min[axis];
+    rect.m_max[axis] = a_max[axis];
+  }
+  auto test = [this, &rect](const Rect& a_rect) { return Overlap(&rect, &a_rect); };
+  return Visit(test, test, a_visitor);
+}
+
+
+RTREE_TEMPLATE
+template<typename VISITOR>
+int RTREE_QUAL::Search(const ELEMTYPE point[NUMDIMS], VISITOR&& a_visitor) const
+{
+  auto test = [this, point](const Rect& a_rect) { return Contains(&a_rect, point); };
+  return Visit(test, test, a_visitor);
+}
+
+
+RTREE_TEMPLATE
+int RTREE_QUAL::Count(const ELEMTYPE a_min[NUMDIMS], const ELEMTYPE a_max[NUMDIMS]) const
+{
+  return Search(a_min, a_max, [](const DATATYPE&) { return true; });
+}
+
+
+RTREE_TEMPLATE
+bool RTREE_QUAL::Any(const ELEMTYPE a_min[NUMDIMS], const ELEMTYPE a_max[NUMDIMS]) const
+{
+  return Search(a_min, a_max, [](const DATATYPE&) { return false; }) > 0;
+}
+
+
+RTREE_TEMPLATE
+bool RTREE_QUAL::Any(const ELEMTYPE point[NUMDIMS]) const
+{
+  return Search(point, [](const DATATYPE&) { return false; }) > 0;
+}
+
+
+RTREE_TEMPLATE
+template<typename VISITOR>
+int RTREE_QUAL::SearchContained(const ELEMTYPE a_min[NUMDIMS], const ELEMTYPE a_max[NUMDIMS], VISITOR&& a_visitor) const
+{
+  Rect rect;
+  for(int axis = 0; axis < NUMDIMS; ++axis)
+  {
+    rect.m_min[axis] = a_min[axis];
+    rect.m_max[axis] = a_max[axis];
+  }
+  // A node may hold contained entries if it overlaps the search rectangle
+  return Visit([this, &rect](const Rect& a_rect) { return Overlap(&rect, &a_rect); },
+    [this, &rect](const Rect& a_rect) { return Contains(&rect, &a_rect); }, a_visitor);
+}
+
+
+RTREE_TEMPLATE
+template<typename VISITOR>
+int RTREE_QUAL::SearchContaining(const ELEMTYPE a_min[NUMDIMS], const ELEMTYPE a_max[NUMDIMS], VISITOR&& a_visitor) const
+{
+  Rect rect;
+  for(int axis = 0; axis < NUMDIMS; ++axis)
+  {
+    rect.m_min[axis] = a_min[axis];
+    rect.m_max[axis] = a_max[axis];
+  }
+  // A node covers its entries, so it must contain the search rectangle too
+  auto test = [this, &rect](const Rect& a_rect) { return Contains(&a_rect, &rect); };
+  return Visit(test, test, a_visitor);
+}
+
+
+RTREE_TEMPLATE
+template<typename VISITOR>
+void RTREE_QUAL::ForEachEntry(VISITOR&& a_visitor) const
+{
+  enum { MAX_STACK = 32 * MAXNODES };
+  const Node* stack[MAX_STACK];
+  int tos = 0;
+
+  stack[tos++] = m_root;
+  while(tos > 0)
+  {
+    const Node* node = stack[--tos];
+    for(int index = 0; index < node->m_count; ++index)
+    {
+      if(node->IsInternalNode())
+      {
+        ASSERT(tos < MAX_STACK);
+        stack[tos++] = node->m_branch[index].m_child;
+      }
+      else
+      {
+        a_visitor(node->m_branch[index].m_rect, node->m_branch[index].m_data);
+      }
+    }
+  }
+}
+
+
+// Depth first traversal with an explicit stack, of the branches of internal nodes passing a_nodeTest
+// and the branches of leaves passing a_leafTest.
+// A node is pushed after it passes the test, so the stack holds at most MAXNODES - 1 siblings for each level.
+RTREE_TEMPLATE
+template<typename NODETEST, typename LEAFTEST, typename VISITOR>
+int RTREE_QUAL::Visit(const NODETEST& a_nodeTest, const LEAFTEST& a_leafTest, VISITOR& a_visitor) const
+{
+  enum { MAX_STACK = 32 * MAXNODES };
+  const Node* stack[MAX_STACK];
+  int tos = 0;
+  int foundCount = 0;
+
+  stack[tos++] = m_root;
+  while(tos > 0)
+  {
+    const Node* node = stack[--tos];
+    if(node->IsInternalNode())
+    {
+      for(int index = 0; index < node->m_count; ++index)
+      {
+        if(a_nodeTest(node->m_branch[index].m_rect))
+        {
+          ASSERT(tos < MAX_STACK);
+          stack[tos++] = node->m_branch[index].m_child;
+        }
+      }
+    }
+    else
+    {
+      for(int index = 0; index < node->m_count; ++index)
+      {
+        if(a_leafTest(node->m_branch[index].m_rect))
+        {
+          ++foundCount;
+          if(!a_visitor(node->m_branch[index].m_data))
+          {
+            return foundCount;
+          }
+        }
+      }
+    }
+  }
+  return foundCount;
+}
+
+
+RTREE_TEMPLATE
+int RTREE_QUAL::NearestNeighbors(const ELEMTYPE a_point[NUMDIMS], int a_k, NearestQueue& a_queue,
+  std::vector<DATATYPE>& a_result, std::vector<double>* a_dist2) const
+{
+  a_result.clear();
+  if(a_dist2)
+  {
+    a_dist2->clear();
+  }
+  a_queue.clear();
+  if(a_k <= 0)
+  {
+    return 0;
+  }
+
+  // The entries are popped in order of MINDIST, which is a lower bound of the distances of the data
+  // under a node, so a data entry popped is nearer than all of the entries left.
+  NearestEntry entry;
+  entry.m_dist2 = 0;
+  entry.m_node = m_root;
+  a_queue.push_back(entry);
+  while(!a_queue.empty() && (int)a_result.size() < a_k)
+  {
+    std::pop_heap(a_queue.begin(), a_queue.end());
+    NearestEntry top = a_queue.back();
+    a_queue.pop_back();
+
+    if(!top.m_node)
+    {
+      a_result.push_back(top.m_data);
+      if(a_dist2)
+      {
+        a_dist2->push_back(top.m_dist2);
+      }
+      continue;
+    }
+
+    const Node* node = top.m_node;
+    for(int index = 0; index < node->m_count; ++index)
+    {
+      const Branch& branch = node->m_branch[index];
+      entry.m_dist2 = MinDist2(&branch.m_rect, a_point);
+      if(node->m_level > 0)
+      {
+        entry.m_node = branch.m_child;
+      }
+      else
+      {
+        entry.m_node = NULL;
+        entry.m_data = branch.m_data;
+      }
+      a_queue.push_back(entry);
+      std::push_heap(a_queue.begin(), a_queue.end());
+    }
+  }
+
+  return (int)a_result.size();
+}
+
+
+RTREE_TEMPLATE
+int RTREE_QUAL::Count() const
 {
   int count = 0;
   CountRec(m_root, count);
@@ -630,7 +1053,7 @@ int RTREE_QUAL::Count()
 
 
 RTREE_TEMPLATE
-void RTREE_QUAL::CountRec(Node* a_node, int& a_count)
+void RTREE_QUAL::CountRec(const Node* a_node, int& a_count) const
 {
   if(a_node->IsInternalNode())  // not a leaf node
   {
@@ -886,6 +1309,140 @@ void RTREE_QUAL::RemoveAll()
 }
 
 
+RTREE_TEMPLATE
+void RTREE_QUAL::BulkLoad(const Rect* a_rects, const DATATYPE* a_data, int a_count)
+{
+  RemoveAll();
+  if(a_count <= 0)
+  {
+    return;
+  }
+
+  std::vector<Branch> branches(a_count);
+  for(int index = 0; index < a_count; ++index)
+  {
+    branches[index].m_rect = a_rects[index];
+    branches[index].m_child = NULL;
+    branches[index].m_data = a_data[index];
+  }
+
+  // Each level is tiled, packed into nodes, and the covers of the nodes are the branches of the level above
+  FreeNode(m_root);
+  for(int level = 0; ; ++level)
+  {
+#pragma omp parallel
+#pragma omp single
+    STRTile(&branches[0], (int)branches.size(), 0);
+
+    Node* root = PackLevel(branches, level);
+    if(root)
+    {
+      m_root = root;
+      break;
+    }
+  }
+}
+
+
+// Reorder the branches so that each MAXNODES consecutive branches are a tile:
+// the branches are split into slabs along a_dim, then each slab is tiled along the next dimensions.
+RTREE_TEMPLATE
+void RTREE_QUAL::STRTile(Branch* a_branches, int a_count, int a_dim)
+{
+  if(a_dim == NUMDIMS - 1)
+  {
+    STRSplit(a_branches, a_count, MAXNODES, a_dim);
+    return;
+  }
+
+  int nodeCount = (a_count + MAXNODES - 1) / MAXNODES;
+  int slabCount = (int)ceil(pow((double)nodeCount, 1.0 / (NUMDIMS - a_dim)));
+  int slabSize = ((nodeCount + slabCount - 1) / slabCount) * MAXNODES;
+  STRSplit(a_branches, a_count, slabSize, a_dim);
+
+  for(int first = 0; first < a_count; first += slabSize)
+  {
+#pragma omp task if(a_count > 65536)
+    STRTile(a_branches + first, Min(slabSize, a_count - first), a_dim + 1);
+  }
+#pragma omp taskwait
+}
+
+
+// Partition the branches into groups of a_group consecutive branches ordered by the centers along a_dim,
+// the groups are not sorted inside, so it is O(n log(n / a_group)).
+RTREE_TEMPLATE
+void RTREE_QUAL::STRSplit(Branch* a_branches, int a_count, int a_group, int a_dim)
+{
+  if(a_count <= a_group)
+  {
+    return;
+  }
+
+  int groupCount = (a_count + a_group - 1) / a_group;
+  int mid = (groupCount / 2) * a_group;
+  std::nth_element(a_branches, a_branches + mid, a_branches + a_count,
+    [a_dim](const Branch& a, const Branch& b)
+    {
+      return a.m_rect.m_min[a_dim] + a.m_rect.m_max[a_dim] < b.m_rect.m_min[a_dim] + b.m_rect.m_max[a_dim];
+    });
+
+#pragma omp task if(a_count > 65536)
+  STRSplit(a_branches, mid, a_group, a_dim);
+  STRSplit(a_branches + mid, a_count - mid, a_group, a_dim);
+#pragma omp taskwait
+}
+
+
+// Pack each MAXNODES consecutive branches into a node of a_level, the branches are replaced by the covers of the nodes.
+// Return the root if the level has only one node.
+RTREE_TEMPLATE
+typename RTREE_QUAL::Node* RTREE_QUAL::PackLevel(std::vector<Branch>& a_branches, int a_level)
+{
+  int count = (int)a_branches.size();
+  int nodeCount = (count + MAXNODES - 1) / MAXNODES;
+
+  std::vector<int> first(nodeCount + 1);
+  for(int index = 0; index <= nodeCount; ++index)
+  {
+    first[index] = Min(index * (int)MAXNODES, count);
+  }
+  // The last node takes branches from the one before it if it is not filled to MINNODES
+  if(nodeCount > 1 && count - first[nodeCount - 1] < MINNODES)
+  {
+    first[nodeCount - 1] = count - MINNODES;
+  }
+
+  std::vector<Node*> nodes(nodeCount);
+  for(int index = 0; index < nodeCount; ++index)
+  {
+    nodes[index] = AllocNode();
+  }
+
+  std::vector<Branch> covers(nodeCount);
+#pragma omp parallel for
+  for(int index = 0; index < nodeCount; ++index)
+  {
+    Node* node = nodes[index];
+    node->m_level = a_level;
+    node->m_count = first[index + 1] - first[index];
+    for(int branch = 0; branch < node->m_count; ++branch)
+    {
+      node->m_branch[branch] = a_branches[first[index] + branch];
+    }
+    covers[index].m_rect = NodeCover(node);
+    covers[index].m_child = node;
+  }
+
+  if(nodeCount == 1)
+  {
+    return nodes[0];
+  }
+  a_branches.swap(covers);
+  return NULL;
+}
+
+
 RTREE_TEMPLATE
 void RTREE_QUAL::Reset()
 {
@@ -893,8 +1450,13 @@ void RTREE_QUAL::Reset()
   // Delete all existing nodes
   RemoveAllRec(m_root);
 #else // RTREE_DONT_USE_MEMPOOLS
-  // Just reset memory pools.  We are not using complex types
-  // EXAMPLE
+  // Just reset memory pools, the nodes are only destructed if the data needs it
+  if(!std::is_trivially_destructible<DATATYPE>::value)
+  {
+    RemoveAllRec(m_root);
+  }
+  m_nodePool.Reset();
+  m_listNodePool.Reset();
 #endif // RTREE_DONT_USE_MEMPOOLS
 }
 
@@ -923,7 +1485,7 @@ typename RTREE_QUAL::Node* RTREE_QUAL::AllocNode()
 #ifdef RTREE_DONT_USE_MEMPOOLS
   newNode = new Node;
 #else // RTREE_DONT_USE_MEMPOOLS
-  // EXAMPLE
+  newNode = new(m_nodePool.Alloc()) Node;
 #endif // RTREE_DONT_USE_MEMPOOLS
   InitNode(newNode);
   return newNode;
@@ -938,7 +1500,8 @@ void RTREE_QUAL::FreeNode(Node* a_node)
 #ifdef RTREE_DONT_USE_MEMPOOLS
   delete a_node;
 #else // RTREE_DONT_USE_MEMPOOLS
-  // EXAMPLE
+  a_node->~Node();
+  m_nodePool.Free(a_node);
 #endif // RTREE_DONT_USE_MEMPOOLS
 }
 
@@ -951,7 +1514,7 @@ typename RTREE_QUAL::ListNode* RTREE_QUAL::AllocListNode()
 #ifdef RTREE_DONT_USE_MEMPOOLS
   return new ListNode;
 #else // RTREE_DONT_USE_MEMPOOLS
-  // EXAMPLE
+  return new(m_listNodePool.Alloc()) ListNode;
 #endif // RTREE_DONT_USE_MEMPOOLS
 }
 
@@ -962,7 +1525,7 @@ void RTREE_QUAL::FreeListNode(ListNode* a_listNode)
 #ifdef RTREE_DONT_USE_MEMPOOLS
   delete a_listNode;
 #else // RTREE_DONT_USE_MEMPOOLS
-  // EXAMPLE
+  m_listNodePool.Free(a_listNode);
 #endif // RTREE_DONT_USE_MEMPOOLS
 }
 
@@ -1098,7 +1661,7 @@ bool RTREE_QUAL::InsertRect(const Branch& a_branch, Node** a_root, int a_level)
 
 // Find the smallest rectangle that includes all rectangles in branches of a node.
 RTREE_TEMPLATE
-typename RTREE_QUAL::Rect RTREE_QUAL::NodeCover(const Node* a_node)
+typename RTREE_QUAL::Rect RTREE_QUAL::NodeCover(const Node* a_node) const
 {
   ASSERT(a_node);
   
@@ -1198,7 +1761,7 @@ int RTREE_QUAL::PickBranch(const Rect* a_rect, Node* a_node)
 
 // Combine two rectangles into larger one containing both
 RTREE_TEMPLATE
-typename RTREE_QUAL::Rect RTREE_QUAL::CombineRect(const Rect* a_rectA, const Rect* a_rectB)
+typename RTREE_QUAL::Rect RTREE_QUAL::CombineRect(const Rect* a_rectA, const Rect* a_rectB) const
 {
   ASSERT(a_rectA && a_rectB);
 
@@ -1631,7 +2194,7 @@ bool RTREE_QUAL::RemoveRectRec(Rect* a_rect, const DATATYPE& a_id, Node* a_node,
 
 // Decide whether two rectangles overlap.
 RTREE_TEMPLATE
-bool RTREE_QUAL::Overlap(Rect* a_rectA, Rect* a_rectB) const
+bool RTREE_QUAL::Overlap(const Rect* a_rectA, const Rect* a_rectB) const
 {
   ASSERT(a_rectA && a_rectB);
 
@@ -1647,6 +2210,28 @@ bool RTREE_QUAL::Overlap(Rect* a_rectA, Rect* a_rectB) const
 }
 
 
+// Squared distance from a point to the nearest point of a rectangle, 0 if it is inside.
+RTREE_TEMPLATE
+double RTREE_QUAL::MinDist2(const Rect* a_rect, const ELEMTYPE a_point[NUMDIMS]) const
+{
+  double dist2 = 0;
+  for(int index = 0; index < NUMDIMS; ++index)
+  {
+    double d = 0;
+    if(a_point[index] < a_rect->m_min[index])
+    {
+      d = (double)a_rect->m_min[index] - (double)a_point[index];
+    }
+    else if(a_point[index] > a_rect->m_max[index])
+    {
+      d = (double)a_point[index] - (double)a_rect->m_max[index];
+    }
+    dist2 += d * d;
+  }
+  return dist2;
+}
+
+
 // Add a node to the reinsertion list.  All its branches will later
 // be reinserted into the index structure.
 RTREE_TEMPLATE
@@ -1706,7 +2291,7 @@ bool RTREE_QUAL::Search(Node* a_node, Rect* a_rect, int& a_foundCount, std::func
 }
 
 RTREE_TEMPLATE
-bool RTREE_QUAL::Search(Node* a_node, Rect* a_rect, std::vector<DATATYPE>& searchResult)
+bool RTREE_QUAL::Search(Node* a_node, const Rect* a_rect, std::vector<DATATYPE>& searchResult) const
 {
     ASSERT(a_node);
     ASSERT(a_node->m_level >= 0);
@@ -1742,7 +2327,7 @@ bool RTREE_QUAL::Search(Node* a_node, Rect* a_rect, std::vector<DATATYPE>& searc
 
 // Decide whether a rectangle contains a point.
 RTREE_TEMPLATE
-bool RTREE_QUAL::Contains(Rect* a_rect, const ELEMTYPE point[NUMDIMS])
+bool RTREE_QUAL::Contains(const Rect* a_rect, const ELEMTYPE point[NUMDIMS]) const
 {
     ASSERT(a_rect);
 
@@ -1757,9 +2342,26 @@ bool RTREE_QUAL::Contains(Rect* a_rect, const ELEMTYPE point[NUMDIMS])
     return true;
 }
 
+// Decide whether a_outer contains a_inner.
+RTREE_TEMPLATE
+bool RTREE_QUAL::Contains(const Rect* a_outer, const Rect* a_inner) const
+{
+    ASSERT(a_outer && a_inner);
+
+    for (int index = 0; index < NUMDIMS; ++index)
+    {
+        if (a_outer->m_min[index] > a_inner->m_min[index] ||
+            a_outer->m_max[index] < a_inner->m_max[index])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
 RTREE_TEMPLATE
 bool RTREE_QUAL::Search(Node* a_node, const ELEMTYPE point[NUMDIMS],
-    std::vector<DATATYPE>& searchResult)
+    std::vector<DATATYPE>& searchResult) const
 {
     ASSERT(a_node);
     ASSERT(a_node->m_level >= 0);
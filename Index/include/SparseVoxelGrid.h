@@ -0,0 +1,419 @@
+/*
+**********************************************************************
+*
+* This file is a part of library MPCDPS(Massive Point Cloud Data Processing System).
+* It is a free program and it is protected by the license GPL-v3.0, you may not use the
+* file except in compliance with the License.
+*
+* Copyright(c) 2013 - 2020 Xu Shengpan, all rights reserved.
+*
+* Email: jack_1227x@163.com
+*
+**********************************************************************
+*/
+
+#ifndef  MPCDPS_SPARSEVOXELGRID_H
+#define MPCDPS_SPARSEVOXELGRID_H
+
+#include <deque>
+#include <vector>
+#include <cmath>
+#include <PublicInfo.h>
+#include <FlatHashMap.h>
+
+namespace mpcdps {
+
+/*Count of set bits. */
+inline int bit_count64(uint64 x)
+{
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return int((x * 0x0101010101010101ULL) >> 56);
+}
+
+/*Index of the lowest set bit, x != 0. */
+inline int bit_scan64(uint64 x)
+{
+    static const int table[64] = {
+        0, 1, 48, 2, 57, 49, 28, 3, 61, 58, 50, 42, 38, 29, 17, 4,
+        62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12, 5,
+        63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+        46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19, 9, 13, 8, 7, 6
+    };
+    return table[((x & (0 - x)) * 0x03f79d71b4cb0a89ULL) >> 58];
+}
+
+/*A sparse voxel grid of dense leaf bricks of (2^LOG2_DIM)^3 voxels, 8^3 by default,
+ * the bricks are found by a hash map of their packed coordinates, as the root and leaf levels of VDB.
+ * A voxel is active if it is set, its value is valid only if it is active, otherwise
+ * the background value is returned. Voxel coordinates are signed, 21 bits for each axis of the bricks.
+ * Use Accessor for coherent access, which caches the last brick, prune and clear invalidate the accessors.
+ */
+template<typename ValueType, int LOG2_DIM = 3>
+class SparseVoxelGrid
+{
+public:
+    enum {
+        LEAF_DIM = 1 << LOG2_DIM,
+        LEAF_VOLUME = 1 << (3 * LOG2_DIM),
+        MASK_WORDS = (LEAF_VOLUME + 63) / 64
+    };
+
+    struct Leaf
+    {
+        int origin[3];              /*coordinates of the first voxel. */
+        uint64 mask[MASK_WORDS];    /*active voxels. */
+        ValueType values[LEAF_VOLUME];
+
+        /*Offset of the voxel in the brick, x is the fastest. */
+        static int offset(int x, int y, int z)
+        {
+            return ((z & (LEAF_DIM - 1)) << (2 * LOG2_DIM)) | ((y & (LEAF_DIM - 1)) << LOG2_DIM) | (x & (LEAF_DIM - 1));
+        }
+
+        bool isActive(int i) const
+        {
+            return (mask[i >> 6] >> (i & 63)) & 1;
+        }
+
+        void setActive(int i, bool on)
+        {
+            if (on) {
+                mask[i >> 6] |= uint64(1) << (i & 63);
+            } else {
+                mask[i >> 6] &= ~(uint64(1) << (i & 63));
+            }
+        }
+
+        int activeCount() const
+        {
+            int n = 0;
+            for (int i = 0; i < MASK_WORDS; ++i) {
+                n += bit_count64(mask[i]);
+            }
+            return n;
+        }
+
+        /*Call f(x, y, z, value) for each active voxel. */
+        template<typename Func>
+        void forEachActive(Func f)
+        {
+            for (int w = 0; w < MASK_WORDS; ++w) {
+                for (uint64 m = mask[w]; m; m &= m - 1) {
+                    int i = (w << 6) + bit_scan64(m);
+                    f(origin[0] + (i & (LEAF_DIM - 1)), origin[1] + ((i >> LOG2_DIM) & (LEAF_DIM - 1)),
+                        origin[2] + (i >> (2 * LOG2_DIM)), values[i]);
+                }
+            }
+        }
+    };
+
+    SparseVoxelGrid(const ValueType& background = ValueType()): _background(background), _resolution(1)
+    {
+        _origin[0] = _origin[1] = _origin[2] = 0;
+    }
+
+    ~SparseVoxelGrid()
+    {
+    }
+
+    /*World frame of the voxels: voxel (0, 0, 0) is [origin, origin + resolution). */
+    void setTransform(double x0, double y0, double z0, double resolution)
+    {
+        _origin[0] = x0;
+        _origin[1] = y0;
+        _origin[2] = z0;
+        _resolution = resolution;
+    }
+
+    void worldToIndex(double x, double y, double z, int& ix, int& iy, int& iz) const
+    {
+        ix = int(std::floor((x - _origin[0]) / _resolution));
+        iy = int(std::floor((y - _origin[1]) / _resolution));
+        iz = int(std::floor((z - _origin[2]) / _resolution));
+    }
+
+    void indexToWorld(int ix, int iy, int iz, double& x, double& y, double& z) const
+    {
+        x = _origin[0] + (ix + 0.5) * _resolution;
+        y = _origin[1] + (iy + 0.5) * _resolution;
+        z = _origin[2] + (iz + 0.5) * _resolution;
+    }
+
+    const ValueType& background() const
+    {
+        return _background;
+    }
+
+    int leafCount() const
+    {
+        return _leaves.size();
+    }
+
+    Leaf& getLeaf(int i)
+    {
+        return _leaves[i];
+    }
+
+    const Leaf& getLeaf(int i) const
+    {
+        return _leaves[i];
+    }
+
+    /*The brick containing voxel (x, y, z), NULL if it does not exist. */
+    Leaf* findLeaf(int x, int y, int z)
+    {
+        const int* i = _table.find(leafKey(x, y, z));
+        return i ? &_leaves[*i] : NULL;
+    }
+
+    const Leaf* findLeaf(int x, int y, int z) const
+    {
+        const int* i = _table.find(leafKey(x, y, z));
+        return i ? &_leaves[*i] : NULL;
+    }
+
+    /*The brick containing voxel (x, y, z), it is created with no active voxel if it does not exist.
+     * Bricks are never moved, so the pointer is valid until clear or prune.
+     */
+    Leaf* touchLeaf(int x, int y, int z)
+    {
+        std::pair<int*, bool> res = _table.insert(leafKey(x, y, z), int(_leaves.size()));
+        if (res.second) {
+            _leaves.push_back(Leaf());
+            Leaf& leaf = _leaves.back();
+            leaf.origin[0] = x & ~(LEAF_DIM - 1);
+            leaf.origin[1] = y & ~(LEAF_DIM - 1);
+            leaf.origin[2] = z & ~(LEAF_DIM - 1);
+            for (int i = 0; i < MASK_WORDS; ++i) {
+                leaf.mask[i] = 0;
+            }
+            for (int i = 0; i < LEAF_VOLUME; ++i) {
+                leaf.values[i] = _background;
+            }
+        }
+        return &_leaves[*res.first];
+    }
+
+    ValueType getValue(int x, int y, int z) const
+    {
+        const Leaf* leaf = findLeaf(x, y, z);
+        if (!leaf) {
+            return _background;
+        }
+        int i = Leaf::offset(x, y, z);
+        return leaf->isActive(i) ? leaf->values[i] : _background;
+    }
+
+    /*Get the value if the voxel is active. */
+    bool probeValue(int x, int y, int z, ValueType& value) const
+    {
+        const Leaf* leaf = findLeaf(x, y, z);
+        int i = Leaf::offset(x, y, z);
+        if (!leaf || !leaf->isActive(i)) {
+            value = _background;
+            return false;
+        }
+        value = leaf->values[i];
+        return true;
+    }
+
+    bool isActive(int x, int y, int z) const
+    {
+        const Leaf* leaf = findLeaf(x, y, z);
+        return leaf && leaf->isActive(Leaf::offset(x, y, z));
+    }
+
+    /*Set the value and activate the voxel. */
+    void setValue(int x, int y, int z, const ValueType& value)
+    {
+        Leaf* leaf = touchLeaf(x, y, z);
+        int i = Leaf::offset(x, y, z);
+        leaf->values[i] = value;
+        leaf->setActive(i, true);
+    }
+
+    /*Deactivate the voxel, the brick is kept until prune. */
+    void setOff(int x, int y, int z)
+    {
+        Leaf* leaf = findLeaf(x, y, z);
+        if (leaf) {
+            int i = Leaf::offset(x, y, z);
+            leaf->values[i] = _background;
+            leaf->setActive(i, false);
+        }
+    }
+
+    int activeVoxelCount() const
+    {
+        const int n = _leaves.size();
+        int count = 0;
+#pragma omp parallel for reduction(+:count)
+        for (int i = 0; i < n; ++i) {
+            count += _leaves[i].activeCount();
+        }
+        return count;
+    }
+
+    /*Memory in bytes of the bricks and the hash table. */
+    size_t memoryUsage() const
+    {
+        return _leaves.size() * sizeof(Leaf) + size_t(_table.capacity()) * sizeof(typename Table::Slot);
+    }
+
+    /*Call f(leaf) for each brick in parallel, f must be thread safe for different bricks. */
+    template<typename Func>
+    void forEachLeaf(Func f)
+    {
+        const int n = _leaves.size();
+#pragma omp parallel for schedule(dynamic, 64)
+        for (int i = 0; i < n; ++i) {
+            f(_leaves[i]);
+        }
+    }
+
+    /*Call f(x, y, z, value) for each active voxel, the bricks are visited in parallel. */
+    template<typename Func>
+    void forEachActive(Func f)
+    {
+        const int n = _leaves.size();
+#pragma omp parallel for schedule(dynamic, 64)
+        for (int i = 0; i < n; ++i) {
+            _leaves[i].forEachActive(f);
+        }
+    }
+
+    /*Remove the bricks with no active voxel, leaf pointers and accessors are invalidated. */
+    void prune()
+    {
+        std::deque<Leaf> leaves;
+        _table.clear();
+        for (size_t i = 0; i < _leaves.size(); ++i) {
+            if (_leaves[i].activeCount() > 0) {
+                const Leaf& leaf = _leaves[i];
+                _table.insert(leafKey(leaf.origin[0], leaf.origin[1], leaf.origin[2]), int(leaves.size()));
+                leaves.push_back(leaf);
+            }
+        }
+        _leaves.swap(leaves);
+    }
+
+    void clear()
+    {
+        _leaves.clear();
+        _table.clear();
+    }
+
+    /*Accessor of the grid, which caches the last brick, so that access to the voxels of the same brick
+     * does not look up the hash table. Only existing bricks are cached, so a brick created later by the grid
+     * or another accessor is found. An accessor is not thread safe, use one for each thread.
+     * prune and clear of the grid move or free the bricks, which invalidates the accessors, call clear of
+     * the accessors after them.
+     */
+    class Accessor
+    {
+    public:
+        Accessor(SparseVoxelGrid& grid) :_grid(grid), _leaf(NULL)
+        {
+            _key[0] = _key[1] = _key[2] = 0;
+        }
+
+        ValueType getValue(int x, int y, int z)
+        {
+            Leaf* leaf = probeLeaf(x, y, z);
+            if (!leaf) {
+                return _grid._background;
+            }
+            int i = Leaf::offset(x, y, z);
+            return leaf->isActive(i) ? leaf->values[i] : _grid._background;
+        }
+
+        bool isActive(int x, int y, int z)
+        {
+            Leaf* leaf = probeLeaf(x, y, z);
+            return leaf && leaf->isActive(Leaf::offset(x, y, z));
+        }
+
+        void setValue(int x, int y, int z, const ValueType& value)
+        {
+            ValueType& v = touchValue(x, y, z);
+            v = value;
+        }
+
+        /*Value of the voxel to update in place, such as TSDF accumulation, the voxel is activated. */
+        ValueType& touchValue(int x, int y, int z)
+        {
+            if (!cached(x, y, z)) {
+                cache(x, y, z, _grid.touchLeaf(x, y, z));
+            }
+            int i = Leaf::offset(x, y, z);
+            _leaf->setActive(i, true);
+            return _leaf->values[i];
+        }
+
+        void clear()
+        {
+            _leaf = NULL;
+            _key[0] = _key[1] = _key[2] = 0;
+            _has_key = false;
+        }
+
+    protected:
+        bool cached(int x, int y, int z) const
+        {
+            return _has_key && (x & ~(LEAF_DIM - 1)) == _key[0] && (y & ~(LEAF_DIM - 1)) == _key[1] &&
+                (z & ~(LEAF_DIM - 1)) == _key[2];
+        }
+
+        void cache(int x, int y, int z, Leaf* leaf)
+        {
+            _key[0] = x & ~(LEAF_DIM - 1);
+            _key[1] = y & ~(LEAF_DIM - 1);
+            _key[2] = z & ~(LEAF_DIM - 1);
+            _has_key = true;
+            _leaf = leaf;
+        }
+
+        /*a missing brick is not cached, as it may be created later. */
+        Leaf* probeLeaf(int x, int y, int z)
+        {
+            if (cached(x, y, z)) {
+                return _leaf;
+            }
+            Leaf* leaf = _grid.findLeaf(x, y, z);
+            if (leaf) {
+                cache(x, y, z, leaf);
+            }
+            return leaf;
+        }
+
+    protected:
+        SparseVoxelGrid& _grid;
+        Leaf* _leaf;        /*the cached brick, not NULL if _has_key. */
+        int _key[3];
+        bool _has_key = false;
+    };
+
+protected:
+    typedef FlatHashMap<int> Table;
+
+    static uint64 leafKey(int x, int y, int z)
+    {
+        const uint64 mask = (uint64(1) << 21) - 1;
+        const int bias = 1 << 20;
+        return (uint64((x >> LOG2_DIM) + bias) & mask) | ((uint64((y >> LOG2_DIM) + bias) & mask) << 21) |
+            ((uint64((z >> LOG2_DIM) + bias) & mask) << 42);
+    }
+
+protected:
+    ValueType _background;
+    double _origin[3];
+    double _resolution;
+    std::deque<Leaf> _leaves;
+    Table _table;   /*packed brick coordinates to the index of the brick. */
+};
+
+}
+
+#endif
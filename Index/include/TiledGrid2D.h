@@ -0,0 +1,379 @@
+/*
+**********************************************************************
+*
+* This file is a part of library MPCDPS(Massive Point Cloud Data Processing System).
+* It is a free program and it is protected by the license GPL-v3.0, you may not use the
+* file except in compliance with the License.
+*
+* Copyright(c) 2013 - 2020 Xu Shengpan, all rights reserved.
+*
+* Email: jack_1227x@163.com
+*
+**********************************************************************
+*/
+
+#ifndef  MPCDPS_TILEDGRID2D_H
+#define MPCDPS_TILEDGRID2D_H
+
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "Grid2DFrame.h"
+#include "LRUCache.h"
+#include "SmartPointer.h"
+#include "PublicFunc.h"
+
+namespace mpcdps {
+
+/*
+    A Grid2D split into square tiles of 2^LOG2_TILE cells, for rasters too large for memory.
+    Tiles are allocated when they are first written, the cells of unallocated tiles have the background value.
+    Allocated tiles are kept in an LRU cache with a memory budget, cold tiles are paged to a swap file
+    and loaded back when they are accessed again.
+
+    Cell access is guarded by a mutex, use forEachTile() for bulk processing: each tile is pinned in memory
+    while it is processed, and tiles are processed in parallel.
+
+    \note
+    dimension 0:  r, related with y
+    dimension 1:  c, related with x
+*/
+template <typename T, int LOG2_TILE = 8>
+class TiledGrid2D : public Grid2DFrame
+{
+public:
+    enum { TILE_SIZE = 1 << LOG2_TILE };
+
+    typedef T CellType;
+
+    /*Constructor: budget is the memory budget of the cached tiles in bytes. */
+    TiledGrid2D(size_t budget = size_t(256) << 20)
+        : _tile_rn(0), _tile_cn(0), _background(T()), _cache(budget), _swap_file(NULL), _swap_end(0), _swap_error(false)
+    {
+        _cache.setEvictCallback([this](const int& tile_id, const SmartPointer<Tile>& tile) {
+            writeTile(tile_id, *tile);
+        });
+    }
+
+    ~TiledGrid2D()
+    {
+        clear();
+    }
+
+    void initialize1(double x_start, double y_start,
+        double x_len, double y_len, double dx, double dy)
+    {
+        clear();
+        Grid2DFrame::initialize1(x_start, y_start, x_len, y_len, dx, dy);
+        initializeTiles();
+    }
+
+    void initialize2(double x_start, double y_start,
+        double dx, double dy, int rn, int cn)
+    {
+        clear();
+        Grid2DFrame::initialize2(x_start, y_start, dx, dy, rn, cn);
+        initializeTiles();
+    }
+
+    /*Value of the cells of unallocated tiles, set it before writing any cell. */
+    void setBackground(const T& v) { _background = v; }
+    const T& getBackground() const { return _background; }
+
+    /*Path of the swap file, it is created when the first tile is paged out and removed by clear().
+     * A temporary file is used if no path is set.
+     */
+    void setSwapFile(const std::string& path) { _swap_path = path; }
+
+    void setMemoryBudget(size_t budget)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _cache.setBudget(budget);
+    }
+
+    size_t getMemoryBudget() const { return _cache.budget(); }
+
+    /*Memory of the cached tiles in bytes, pinned tiles are not counted. */
+    size_t memoryUsage() const { return _cache.usage(); }
+
+    /*false if writing or reading the swap file has failed. */
+    bool good() const { return !_swap_error; }
+
+    int rowCount() const
+    {
+        return Grid2DFrame::rowCount();
+    }
+
+    int colCount() const
+    {
+        return Grid2DFrame::colCount();
+    }
+
+    int tileRowCount() const { return _tile_rn; }
+    int tileColCount() const { return _tile_cn; }
+    int tileCount() const { return _tile_rn * _tile_cn; }
+
+    int getTileId(int r, int c) const
+    {
+        return (r >> LOG2_TILE) * _tile_cn + (c >> LOG2_TILE);
+    }
+
+    bool isTileAllocated(int tile_id) const
+    {
+        return _allocated[tile_id] != 0;
+    }
+
+    bool isInside(int r, int c) const
+    {
+        return r >= 0 && r < _rn && c >= 0 && c < _cn;
+    }
+
+    /*Value of cell (r, c), unallocated cells are not allocated. */
+    T getValue(int r, int c) const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        Tile* tile = findTile(getTileId(r, c), false);
+        if (!tile) {
+            return _background;
+        }
+        return tile->data[cellOffset(r, c)];
+    }
+
+    void setValue(int r, int c, const T& v)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        Tile* tile = findTile(getTileId(r, c), true);
+        tile->data[cellOffset(r, c)] = v;
+        tile->dirty = true;
+    }
+
+    /*Value of the cell containing point (x, y), the background value if it is outside. */
+    T getValueAt(double x, double y) const
+    {
+        int r = get_r(y), c = get_c(x);
+        return isInside(r, c) ? getValue(r, c) : _background;
+    }
+
+    /*Pin tile_id in memory and return its cells, the row stride is TILE_SIZE.
+     * Pinned tiles are not paged out and do not count in the budget until they are unpinned.
+     * Return NULL if the tile is not allocated and allocate is false.
+     * If modify is true, the tile is written to the swap file when it is paged out.
+     */
+    T* pinTile(int tile_id, bool allocate, bool modify)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        typename PinMap::iterator iter = _pinned.find(tile_id);
+        if (iter == _pinned.end()) {
+            Tile* tile = findTile(tile_id, allocate);
+            if (!tile) {
+                return NULL;
+            }
+            PinnedTile& pinned = _pinned[tile_id];
+            pinned.tile = _cache.get(tile_id);
+            pinned.count = 0;
+            _cache.remove(tile_id);
+            iter = _pinned.find(tile_id);
+        }
+        ++iter->second.count;
+        if (modify) {
+            iter->second.tile->dirty = true;
+        }
+        return &iter->second.tile->data[0];
+    }
+
+    /*Unpin a tile pinned by pinTile(), it is put back into the cache when all of the pins are released. */
+    void unpinTile(int tile_id)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        typename PinMap::iterator iter = _pinned.find(tile_id);
+        if (iter == _pinned.end() || --iter->second.count > 0) {
+            return;
+        }
+        SmartPointer<Tile> tile = iter->second.tile;
+        _pinned.erase(iter);
+        _cache.put(tile_id, tile, tileBytes());
+    }
+
+    /*Call func(tile_id, r0, c0, rows, cols, data) for the tiles in parallel, the cell (r0 + i, c0 + j)
+     * is data[i * TILE_SIZE + j]. Tiles are pinned while they are processed, so the memory usage can
+     * exceed the budget by a tile for each thread.
+     * Unallocated tiles are skipped unless allocate_missing is true.
+     * modify is false if func does not write the cells, then clean tiles are not written back.
+     */
+    template <typename Func>
+    void forEachTile(Func func, bool allocate_missing = false, bool modify = true)
+    {
+        std::vector<int> tile_ids;
+        for (int t = 0; t < tileCount(); ++t) {
+            if (allocate_missing || _allocated[t]) {
+                tile_ids.push_back(t);
+            }
+        }
+
+        const int n = tile_ids.size();
+#pragma omp parallel for schedule(dynamic, 1)
+        for (int i = 0; i < n; ++i) {
+            const int t = tile_ids[i];
+            const int r0 = (t / _tile_cn) << LOG2_TILE;
+            const int c0 = (t % _tile_cn) << LOG2_TILE;
+            T* data = pinTile(t, allocate_missing, modify);
+            if (data) {
+                func(t, r0, c0, MINV(int(TILE_SIZE), _rn - r0), MINV(int(TILE_SIZE), _cn - c0), data);
+                unpinTile(t);
+            }
+        }
+    }
+
+    /*Page all of the cached tiles out to the swap file. */
+    void flush()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _cache.flush();
+    }
+
+    /*Release all of the tiles and remove the swap file. */
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _cache.clear();
+        _pinned.clear();
+        _allocated.assign(_allocated.size(), 0);
+        _swap_offsets.assign(_swap_offsets.size(), -1);
+        _swap_end = 0;
+        _swap_error = false;
+        if (_swap_file) {
+            fclose(_swap_file);
+            _swap_file = NULL;
+            if (!_swap_path.empty()) {
+                remove(_swap_path.c_str());
+            }
+        }
+    }
+
+protected:
+    struct Tile
+    {
+        std::vector<T> data;
+        bool dirty;
+    };
+
+    struct PinnedTile
+    {
+        SmartPointer<Tile> tile;
+        int count;
+    };
+
+    typedef std::unordered_map<int, PinnedTile> PinMap;
+
+    static size_t tileBytes()
+    {
+        return sizeof(T) * TILE_SIZE * TILE_SIZE + sizeof(Tile);
+    }
+
+    static int cellOffset(int r, int c)
+    {
+        return ((r & (TILE_SIZE - 1)) << LOG2_TILE) + (c & (TILE_SIZE - 1));
+    }
+
+    void initializeTiles()
+    {
+        _tile_rn = (_rn + TILE_SIZE - 1) >> LOG2_TILE;
+        _tile_cn = (_cn + TILE_SIZE - 1) >> LOG2_TILE;
+        _allocated.assign(tileCount(), 0);
+        _swap_offsets.assign(tileCount(), -1);
+    }
+
+    /*Find a tile in the pinned tiles, the cache or the swap file, the mutex must be locked.
+     * A missing tile is created with the background value if allocate is true.
+     */
+    Tile* findTile(int tile_id, bool allocate) const
+    {
+        typename PinMap::const_iterator iter = _pinned.find(tile_id);
+        if (iter != _pinned.end()) {
+            return iter->second.tile;
+        }
+        SmartPointer<Tile> tile = _cache.get(tile_id);
+        if (tile != NULL) {
+            return tile;
+        }
+        if (!_allocated[tile_id] && !allocate) {
+            return NULL;
+        }
+
+        tile = new Tile();
+        tile->data.assign(size_t(TILE_SIZE) * TILE_SIZE, _background);
+        tile->dirty = !_allocated[tile_id];
+        if (_allocated[tile_id] && !readTile(tile_id, *tile)) {
+            _swap_error = true;
+        }
+        _allocated[tile_id] = 1;
+        _cache.put(tile_id, tile, tileBytes());
+        return tile;
+    }
+
+    bool openSwapFile() const
+    {
+        if (!_swap_file) {
+            _swap_file = _swap_path.empty() ? tmpfile() : fopen(_swap_path.c_str(), "w+b");
+        }
+        return _swap_file != NULL;
+    }
+
+    /*Evict callback of the cache, a tile has a fixed slot in the swap file once it is written. */
+    void writeTile(int tile_id, Tile& tile) const
+    {
+        if (!tile.dirty) {
+            return;
+        }
+        if (!openSwapFile()) {
+            _swap_error = true;
+            return;
+        }
+        if (_swap_offsets[tile_id] < 0) {
+            _swap_offsets[tile_id] = _swap_end;
+            _swap_end += sizeof(T) * TILE_SIZE * TILE_SIZE;
+        }
+        if (file_seek64(_swap_file, _swap_offsets[tile_id]) != 0 ||
+            fwrite(&tile.data[0], sizeof(T), tile.data.size(), _swap_file) != tile.data.size()) {
+            _swap_error = true;
+            return;
+        }
+        tile.dirty = false;
+    }
+
+    bool readTile(int tile_id, Tile& tile) const
+    {
+        if (_swap_offsets[tile_id] < 0) {
+            return true;
+        }
+        return _swap_file && file_seek64(_swap_file, _swap_offsets[tile_id]) == 0 &&
+            fread(&tile.data[0], sizeof(T), tile.data.size(), _swap_file) == tile.data.size();
+    }
+
+private:
+    TiledGrid2D(const TiledGrid2D&);
+    TiledGrid2D& operator=(const TiledGrid2D&);
+
+protected:
+    int _tile_rn;
+    int _tile_cn;
+    T _background;
+
+    /*reading a cell may page tiles in and out, so the tile states are mutable. */
+    mutable std::mutex _mutex;
+    mutable LRUCache<int, Tile> _cache;
+    mutable PinMap _pinned;
+    mutable std::vector<char> _allocated;
+    mutable std::vector<int64> _swap_offsets;
+
+    std::string _swap_path;
+    mutable FILE* _swap_file;
+    mutable uint64 _swap_end;
+    mutable bool _swap_error;
+};
+
+}
+
+#endif
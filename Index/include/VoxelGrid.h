@@ -15,8 +15,11 @@
 #ifndef  MPCDPS_VOXELGRID_H
 #define MPCDPS_VOXELGRID_H
 
-#include <Grid2D.h>
-#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <Grid2DFrame.h>
+#include <SmartArray2D.h>
+#include <PublicFunc.h>
 
 namespace mpcdps {
 
@@ -25,12 +28,17 @@ namespace mpcdps {
        dimension 0:  r, related with y
        dimension 1:  c, related with x
        dimension 2:  h, related with z
+
+       Only the occupied voxels are stored, in a compressed sparse layout:
+       the sorted keys (r * cn + c) * hn + h of the voxels, so the voxels of a column are contiguous,
+       the point ids of voxel i are [offsets[i], offsets[i+1]) of the point ids,
+       and a VoxelType payload for each voxel.
     */
     template<typename VoxelType>
-    class VoxelGrid: public Grid2D<std::unordered_map<int, VoxelType> >
+    class VoxelGrid: public Grid2DFrame
     {
     public:
-        VoxelGrid()
+        VoxelGrid(): _z0(0), _dz(0), _inv_dz(0), _hn(0)
         {
         }
 
@@ -51,12 +59,46 @@ namespace mpcdps {
         {
             _z0 = zmin;
             _dz = dz;
+            _inv_dz = 1.0 / dz;
             _hn = std::ceil(z_len + 0.001) / dz;
         }
 
         int get_h(double z) const
         {
-            return int((z - _z0) / _dz);
+            return floor_int((z - _z0) * _inv_dz);
+        }
+
+        /*Height indices of n points, z at [2], as get_rc() of Grid2DFrame. */
+        template<typename T>
+        void get_h(const T* pts, int n, int stride, const int* ids, int* hs) const
+        {
+            locate(pts, n, stride, ids, 2, _z0, _inv_dz, hs);
+        }
+
+        /*Keys (r * cn + c) * hn + h of n points, invalid for the points out of the grid. */
+        template<typename T>
+        void get_voxel_keys(const T* pts, int n, int stride, const int* ids, uint64* keys,
+            uint64 invalid = ~uint64(0)) const
+        {
+            int i = 0;
+#if defined(__AVX2__)
+            int rs[4], cs[4], hs[4];
+            for (; i + 4 <= n; i += 4) {
+                _mm_storeu_si128((__m128i*)rs, locate4(pts, stride, ids, i, 1, _y0, _inv_dy));
+                _mm_storeu_si128((__m128i*)cs, locate4(pts, stride, ids, i, 0, _x0, _inv_dx));
+                _mm_storeu_si128((__m128i*)hs, locate4(pts, stride, ids, i, 2, _z0, _inv_dz));
+                for (int k = 0; k < 4; ++k) {
+                    keys[i + k] = isValid(rs[k], cs[k], hs[k]) ? getKey(rs[k], cs[k], hs[k]) : invalid;
+                }
+            }
+#endif
+            for (; i < n; ++i) {
+                const T* p = pts + size_t(ids ? ids[i] : i) * stride;
+                const int r = floor_int((double(p[1]) - _y0) * _inv_dy);
+                const int c = floor_int((double(p[0]) - _x0) * _inv_dx);
+                const int h = floor_int((double(p[2]) - _z0) * _inv_dz);
+                keys[i] = isValid(r, c, h) ? getKey(r, c, h) : invalid;
+            }
         }
 
         int heightCount() const
@@ -79,16 +121,145 @@ namespace mpcdps {
             return SKIP(_z0, _dz, h);
         }
 
+        /*Build the voxels of the points in one parallel pass of keys and one radix sort,
+         * the payloads are default constructed. Points out of the grid are skipped.
+         */
+        template<typename T>
+        void build(const SmartArray2D<T, 3>& points, std::vector<int> ptids = std::vector<int>())
+        {
+            clear();
+            if (ptids.empty()) {
+                ptids = make_vector<int>(points.size());
+            }
+
+            const uint64 invalid = ~uint64(0);
+            const int n = ptids.size();
+            std::vector<uint64> keys(n);
+            const int block_size = 4096;
+            const int n_block = (n + block_size - 1) / block_size;
+#pragma omp parallel for
+            for (int b = 0; b < n_block; ++b) {
+                const int begin = b * block_size;
+                get_voxel_keys(points.buffer(), MINV(block_size, n - begin), 3, &ptids[begin], &keys[begin], invalid);
+            }
+            sort_radix_syn(keys, ptids);
+
+            int m = n;
+            while (m > 0 && keys[m - 1] == invalid) {
+                --m;
+            }
+            for (int i = 0; i < m; ++i) {
+                if (i == 0 || keys[i] != keys[i - 1]) {
+                    _keys.push_back(keys[i]);
+                    _offsets.push_back(i);
+                }
+            }
+            _offsets.push_back(m);
+            ptids.resize(m);
+            _ptids.swap(ptids);
+            _voxels.resize(_keys.size());
+        }
+
+        void clear()
+        {
+            _keys.clear();
+            _offsets.clear();
+            _ptids.clear();
+            _voxels.clear();
+        }
+
+        bool isValid(int r, int c, int h) const
+        {
+            return r >= 0 && r < _rn && c >= 0 && c < _cn && h >= 0 && h < _hn;
+        }
+
+        uint64 getKey(int r, int c, int h) const
+        {
+            return (uint64(r) * _cn + c) * _hn + h;
+        }
+
+        VoxelIndex getIndex(uint64 key) const
+        {
+            VoxelIndex idx;
+            idx.h = int(key % _hn);
+            key /= _hn;
+            idx.c = int(key % _cn);
+            idx.r = int(key / _cn);
+            return idx;
+        }
+
+        /*Count of the occupied voxels. */
+        int voxelCount() const
+        {
+            return _keys.size();
+        }
+
+        /*Id of voxel (r, c, h) by binary search, -1 if it is empty. */
+        int find(int r, int c, int h) const
+        {
+            if (!isValid(r, c, h)) {
+                return -1;
+            }
+            const uint64 key = getKey(r, c, h);
+            std::vector<uint64>::const_iterator iter = std::lower_bound(_keys.begin(), _keys.end(), key);
+            return (iter != _keys.end() && *iter == key) ? int(iter - _keys.begin()) : -1;
+        }
+
         bool is_empty(int r, int c, int h) const
         {
-            return (*this)[r][c].count(h) == 0;
+            return find(r, c, h) < 0;
+        }
+
+        /*Voxels of column (r, c) are [begin, end). */
+        void getColumn(int r, int c, int& begin, int& end) const
+        {
+            const uint64 key = getKey(r, c, 0);
+            begin = std::lower_bound(_keys.begin(), _keys.end(), key) - _keys.begin();
+            end = std::lower_bound(_keys.begin() + begin, _keys.end(), key + _hn) - _keys.begin();
+        }
+
+        uint64 getVoxelKey(int i) const
+        {
+            return _keys[i];
+        }
+
+        VoxelIndex getVoxelIndex(int i) const
+        {
+            return getIndex(_keys[i]);
+        }
+
+        VoxelType& getVoxel(int i)
+        {
+            return _voxels[i];
+        }
+
+        const VoxelType& getVoxel(int i) const
+        {
+            return _voxels[i];
+        }
+
+        int pointCount(int i) const
+        {
+            return _offsets[i + 1] - _offsets[i];
+        }
+
+        /*Point ids of voxel i, there are pointCount(i) of them. */
+        const int* pointIds(int i) const
+        {
+            return _ptids.empty() ? NULL : &_ptids[0] + _offsets[i];
         }
 
     protected:
         double _z0;
         double _dz;
+        double _inv_dz;
         int _hn;
+
+        std::vector<uint64> _keys;
+        std::vector<int> _offsets;
+        std::vector<int> _ptids;
+        std::vector<VoxelType> _voxels;
     };
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,113 @@
+/*
+**********************************************************************
+*
+* This file is a part of library MPCDPS(Massive Point Cloud Data Processing System).
+* It is a free program and it is protected by the license GPL-v3.0, you may not use the
+* file except in compliance with the License.
+*
+* Copyright(c) 2013 - 2020 Xu Shengpan, all rights reserved.
+*
+* Email: jack_1227x@163.com
+*
+**********************************************************************
+*/
+
+#ifndef MPCDPS_DEMRASTERIZER_H
+#define MPCDPS_DEMRASTERIZER_H
+
+#include <vector>
+#include <SmartArray2D.h>
+#include <PublicInfo.h>
+#include "Grid2D.h"
+
+namespace mpcdps {
+
+/*Rasterize the heights of points into Grid2D.
+ * Points are binned by the cell keys r * cn + c computed in parallel, grouped by a radix sort of the keys,
+ * then all of the selected reducers are computed for each cell in one parallel pass.
+ * The percentile is exact, by partial sorting the heights of each cell.
+ * Empty cells are set to no data, and can be filled by the nearest cell or IDW of the cells within a distance.
+ */
+template<typename T=double>
+class DEMRasterizer
+{
+public:
+    DEMRasterizer(void);
+    virtual ~DEMRasterizer(void);
+
+    enum Reducer
+    {
+        REDUCE_MIN = 1,
+        REDUCE_MAX = 2,
+        REDUCE_MEAN = 4,
+        REDUCE_COUNT = 8,
+        REDUCE_PERCENTILE = 16
+    };
+
+    enum GapFill
+    {
+        FILL_NONE = 0,
+        FILL_NEAREST = 1,
+        FILL_IDW = 2
+    };
+
+    /*frame is the geometry of the rasters. */
+    void initialize(const SmartArray2D<T, 3>& vtxAry, const Grid2DFrame& frame);
+
+    //default: REDUCE_MIN | REDUCE_MAX | REDUCE_MEAN | REDUCE_COUNT
+    //the count raster is kept with gap fill too, it marks the cells with data.
+    void setReducers(int reducers) { mReducers = reducers; }
+
+    //percentile in [0, 100], default: 50
+    void setPercentile(double percentile) { mPercentile = percentile; }
+
+    //default: -9999
+    void setNoData(float nodata) { mNoData = nodata; }
+
+    /*Fill empty cells by the data cells within max_distance cells, IDW weight is 1 / d^power.
+     * The count raster is not filled. default: FILL_NONE.
+     */
+    void setGapFill(GapFill method, int max_distance, double power = 2)
+    {
+        mGapFill = method;
+        mMaxFillDistance = max_distance;
+        mIDWPower = power;
+    }
+
+    void run();
+    void run(const std::vector<int>& ptIds);
+
+    const Grid2D<float>& getMin() const { return mMin; }
+    const Grid2D<float>& getMax() const { return mMax; }
+    const Grid2D<float>& getMean() const { return mMean; }
+    const Grid2D<int>& getCount() const { return mCount; }
+    const Grid2D<float>& getPercentile() const { return mPercentileGrid; }
+
+    void clear();
+
+private:
+    void reduce(const std::vector<uint64>& keys, const std::vector<int>& ptids);
+    void fillGaps(Grid2D<float>& grid) const;
+    void initializeGrid(Grid2D<float>& grid, bool enabled) const;
+
+protected:
+    SmartArray2D<T, 3> mVtxAry;
+    Grid2DFrame mFrame;
+
+    int mReducers = REDUCE_MIN | REDUCE_MAX | REDUCE_MEAN | REDUCE_COUNT;
+    double mPercentile = 50;
+    float mNoData = -9999;
+    GapFill mGapFill = FILL_NONE;
+    int mMaxFillDistance = 0;
+    double mIDWPower = 2;
+
+    Grid2D<float> mMin;
+    Grid2D<float> mMax;
+    Grid2D<float> mMean;
+    Grid2D<int> mCount;
+    Grid2D<float> mPercentileGrid;
+};
+
+}
+
+#endif
@@ -44,15 +44,11 @@ public:
 
 private:
 	void doWork();
-    uint getLinearId(int r, int c, int h) const
-    {
-        return h * _rn * _cn + r * _cn + c;
-    }
 
 protected:
     SmartArray2D<T, 3> mVtxAry;
 	Box3<T> mBox;
-    VoxelGrid<std::vector<int> > mGrid;
+    VoxelGrid<int> mGrid;  /*payload: label of the connected voxels. */
 	std::vector<int>  mOutilerPoints;
 
 	int   mNumShreshold = 2;
@@ -0,0 +1,119 @@
+/*
+**********************************************************************
+*
+* This file is a part of library MPCDPS(Massive Point Cloud Data Processing System).
+* It is a free program and it is protected by the license GPL-v3.0, you may not use the
+* file except in compliance with the License.
+*
+* Copyright(c) 2013 - 2020 Xu Shengpan, all rights reserved.
+*
+* Email: jack_1227x@163.com
+*
+**********************************************************************
+*/
+
+#ifndef MPCDPS_VOXELDOWNSAMPLEFILTER_H
+#define MPCDPS_VOXELDOWNSAMPLEFILTER_H
+
+#include <vector>
+#include <SmartArray2D.h>
+#include <PublicInfo.h>
+#include "Grid3D.h"
+
+namespace mpcdps {
+
+/*Downsample points by a voxel grid.
+ * Voxel keys are computed in parallel with the packed index of Grid3D, and the points are grouped
+ * by a radix sort of the keys, then each voxel is reduced to one point in parallel.
+ * Voxels are aligned to the min corner of the points, and there are at most 2^21 - 2 voxels on each axis.
+ */
+template<typename T=double>
+class VoxelDownsampleFilter
+{
+public:
+    VoxelDownsampleFilter(void);
+    virtual ~VoxelDownsampleFilter(void);
+
+    enum Mode
+    {
+        CENTROID = 0,   /*centroid of the points of the voxel. */
+        FIRST = 1,      /*the point with the least id of the voxel. */
+        CLOSEST = 2     /*the point closest to the center of the voxel. */
+    };
+
+    void initialize(const SmartArray2D<T, 3>& vtxAry, float voxel_size);
+
+    //default: CENTROID
+    void setMode(Mode mode) { mMode = mode; }
+
+    /*Return false if the points span more than 2^21 - 2 voxels on an axis. */
+    bool run();
+    bool run(const std::vector<int>& ptIds);
+
+    /*Downsampled points, one for each voxel. */
+    SmartArray2D<T, 3> getPoints() const { return mPoints; }
+
+    int voxelCount() const { return int(mOffsets.size()) - 1; }
+
+    /*Voxel of each point, -1 for the points not filtered. */
+    const std::vector<int>& getPointVoxels() const { return mPointVoxels; }
+
+    /*Id of the point kept for each voxel in FIRST and CLOSEST mode. */
+    const std::vector<int>& getRepresentatives() const { return mRepresentatives; }
+
+    /*Point ids of voxel i are [offsets[i], offsets[i+1]) of getVoxelPointIds(). */
+    const std::vector<int>& getVoxelOffsets() const { return mOffsets; }
+    const std::vector<int>& getVoxelPointIds() const { return mPtIds; }
+
+    /*Average of an attribute of dim values for each point, attr[ptid * dim + k].
+     * out has dim values for each voxel.
+     */
+    template<typename A>
+    void averageAttribute(const A* attr, int dim, std::vector<A>& out) const
+    {
+        const int n = voxelCount();
+        out.resize(size_t(n) * dim);
+#pragma omp parallel
+        {
+            std::vector<double> sum(dim);
+#pragma omp for schedule(dynamic, 1024)
+            for (int v = 0; v < n; ++v) {
+                std::fill(sum.begin(), sum.end(), 0.0);
+                for (int i = mOffsets[v]; i < mOffsets[v + 1]; ++i) {
+                    const A* a = attr + size_t(mPtIds[i]) * dim;
+                    for (int k = 0; k < dim; ++k) {
+                        sum[k] += a[k];
+                    }
+                }
+                const double s = 1.0 / (mOffsets[v + 1] - mOffsets[v]);
+                for (int k = 0; k < dim; ++k) {
+                    out[size_t(v) * dim + k] = A(sum[k] * s);
+                }
+            }
+        }
+    }
+
+    void clear();
+
+private:
+    void groupPoints(std::vector<int>& ptids);
+    void reduce();
+
+protected:
+    SmartArray2D<T, 3> mVtxAry;
+    float mVoxelSize = 1;
+    Mode mMode = CENTROID;
+    Grid3D<int> mGrid;
+    double mOrigin[3];
+
+    std::vector<uint64> mKeys;   /*key of each voxel. */
+    std::vector<int> mOffsets;
+    std::vector<int> mPtIds;
+    std::vector<int> mPointVoxels;
+    std::vector<int> mRepresentatives;
+    SmartArray2D<T, 3> mPoints;
+};
+
+}
+
+#endif
@@ -0,0 +1,275 @@
+/*
+**********************************************************************
+*
+* This file is a part of library MPCDPS(Massive Point Cloud Data Processing System).
+* It is a free program and it is protected by the license GPL-v3.0, you may not use the
+* file except in compliance with the License.
+*
+* Copyright(c) 2013 - 2020 Xu Shengpan, all rights reserved.
+*
+* Email: jack_1227x@163.com
+*
+**********************************************************************
+*/
+
+#include "DEMRasterizer.h"
+#include <algorithm>
+#include <cmath>
+#include "PublicFunc.h"
+
+namespace mpcdps {
+
+template<typename T>
+DEMRasterizer<T>::DEMRasterizer(void)
+{
+}
+
+template<typename T>
+DEMRasterizer<T>::~DEMRasterizer(void)
+{
+}
+
+template<typename T>
+void DEMRasterizer<T>::initialize(const SmartArray2D<T, 3>& vtxAry, const Grid2DFrame& frame)
+{
+    mVtxAry = vtxAry;
+    mFrame = frame;
+}
+
+template<typename T>
+void DEMRasterizer<T>::run()
+{
+    run(make_vector<int>(mVtxAry.size()));
+}
+
+template<typename T>
+void DEMRasterizer<T>::run(const std::vector<int>& ptIds)
+{
+    clear();
+    const int rn = mFrame.rowCount();
+    const int cn = mFrame.colCount();
+
+    const uint64 invalid = ~uint64(0);
+    const int n = ptIds.size();
+    std::vector<int> ptids(ptIds);
+    std::vector<uint64> keys(n);
+    const int block_size = 4096;
+    const int n_block = (n + block_size - 1) / block_size;
+#pragma omp parallel for
+    for (int b = 0; b < n_block; ++b) {
+        const int begin = b * block_size;
+        mFrame.get_cell_keys(mVtxAry.buffer(), MINV(block_size, n - begin), 3, &ptids[begin], &keys[begin], invalid);
+    }
+    sort_radix_syn(keys, ptids);
+
+    int m = n;
+    while (m > 0 && keys[m - 1] == invalid) {
+        --m;
+    }
+    keys.resize(m);
+    ptids.resize(m);
+
+    initializeGrid(mMin, (mReducers & REDUCE_MIN) != 0);
+    initializeGrid(mMax, (mReducers & REDUCE_MAX) != 0);
+    initializeGrid(mMean, (mReducers & REDUCE_MEAN) != 0);
+    initializeGrid(mPercentileGrid, (mReducers & REDUCE_PERCENTILE) != 0);
+    static_cast<Grid2DFrame&>(mCount) = mFrame;
+    mCount.SmartArrayReal2D<int>::resize(rn, cn);
+    mCount.reset(0);
+
+    reduce(keys, ptids);
+
+    if (mGapFill != FILL_NONE) {
+        fillGaps(mMin);
+        fillGaps(mMax);
+        fillGaps(mMean);
+        fillGaps(mPercentileGrid);
+    }
+    if (!(mReducers & REDUCE_COUNT) && mGapFill == FILL_NONE) {
+        mCount.clear();
+    }
+}
+
+template<typename T>
+void DEMRasterizer<T>::initializeGrid(Grid2D<float>& grid, bool enabled) const
+{
+    if (!enabled) {
+        grid.clear();
+        return;
+    }
+    static_cast<Grid2DFrame&>(grid) = mFrame;
+    grid.SmartArrayReal2D<float>::resize(mFrame.rowCount(), mFrame.colCount());
+    grid.reset(mNoData);
+}
+
+/*The points of a cell are contiguous in the sorted keys, the cells are found by blocks
+ * and reduced in parallel.
+ */
+template<typename T>
+void DEMRasterizer<T>::reduce(const std::vector<uint64>& keys, const std::vector<int>& ptids)
+{
+    const int n = keys.size();
+    const int n_block = (n < 65536) ? 1 : 256;
+    const int block_size = (n + n_block - 1) / n_block;
+    std::vector<int> block_first(n_block + 1, 0);
+#pragma omp parallel for
+    for (int b = 0; b < n_block; ++b) {
+        int end = MINV(n, (b + 1) * block_size);
+        int count = 0;
+        for (int i = b * block_size; i < end; ++i) {
+            if (i == 0 || keys[i] != keys[i - 1]) {
+                ++count;
+            }
+        }
+        block_first[b + 1] = count;
+    }
+    for (int b = 0; b < n_block; ++b) {
+        block_first[b + 1] += block_first[b];
+    }
+
+    std::vector<int> offsets(block_first[n_block] + 1);
+#pragma omp parallel for
+    for (int b = 0; b < n_block; ++b) {
+        int end = MINV(n, (b + 1) * block_size);
+        int k = block_first[b];
+        for (int i = b * block_size; i < end; ++i) {
+            if (i == 0 || keys[i] != keys[i - 1]) {
+                offsets[k++] = i;
+            }
+        }
+    }
+    offsets.back() = n;
+
+    const int m = int(offsets.size()) - 1;
+    const int cn = mFrame.colCount();
+    const bool do_min = (mReducers & REDUCE_MIN) != 0;
+    const bool do_max = (mReducers & REDUCE_MAX) != 0;
+    const bool do_mean = (mReducers & REDUCE_MEAN) != 0;
+    const bool do_percentile = (mReducers & REDUCE_PERCENTILE) != 0;
+    const double percentile = MINV(MAXV(mPercentile, 0.0), 100.0) / 100.0;
+
+#pragma omp parallel
+    {
+        std::vector<double> heights;
+#pragma omp for schedule(dynamic, 256)
+        for (int k = 0; k < m; ++k) {
+            const int begin = offsets[k];
+            const int end = offsets[k + 1];
+            const int r = int(keys[begin] / cn);
+            const int c = int(keys[begin] % cn);
+
+            double zmin = DBL_MAX, zmax = -DBL_MAX, zsum = 0, z;
+            if (do_percentile) {
+                heights.clear();
+            }
+            for (int i = begin; i < end; ++i) {
+                z = mVtxAry[ptids[i]][2];
+                if (z < zmin) zmin = z;
+                if (z > zmax) zmax = z;
+                zsum += z;
+                if (do_percentile) {
+                    heights.push_back(z);
+                }
+            }
+
+            mCount[r][c] = end - begin;
+            if (do_min) mMin[r][c] = zmin;
+            if (do_max) mMax[r][c] = zmax;
+            if (do_mean) mMean[r][c] = zsum / (end - begin);
+            if (do_percentile) {
+                /*linear interpolation between the two closest ranks. */
+                double pos = percentile * (heights.size() - 1);
+                int rank = int(pos);
+                std::nth_element(heights.begin(), heights.begin() + rank, heights.end());
+                double v = heights[rank];
+                if (pos > rank) {
+                    double v1 = *std::min_element(heights.begin() + rank + 1, heights.end());
+                    v += (pos - rank) * (v1 - v);
+                }
+                mPercentileGrid[r][c] = v;
+            }
+        }
+    }
+}
+
+/*Each empty cell searches the rings of cells around it up to the max distance, rows in parallel.
+ * The values are read from a copy, so filled cells are not used as data.
+ */
+template<typename T>
+void DEMRasterizer<T>::fillGaps(Grid2D<float>& grid) const
+{
+    if (grid.empty()) {
+        return;
+    }
+
+    const int rn = grid.rowCount();
+    const int cn = grid.colCount();
+    const int max_d = mMaxFillDistance;
+    const double max_d2 = double(max_d) * max_d;
+    const SmartArrayReal2D<float> values = grid.block(0, 0, rn, cn);
+
+#pragma omp parallel for schedule(dynamic, 4)
+    for (int r = 0; r < rn; ++r) {
+        for (int c = 0; c < cn; ++c) {
+            if (mCount[r][c] > 0) {
+                continue;
+            }
+
+            double best_d2 = DBL_MAX, wsum = 0, vsum = 0;
+            float best = mNoData;
+            for (int d = 1; d <= max_d; ++d) {
+                /*cells of ring d are no closer than d. */
+                if (mGapFill == FILL_NEAREST && double(d) * d > best_d2) {
+                    break;
+                }
+                for (int r1 = r - d; r1 <= r + d; ++r1) {
+                    if (r1 < 0 || r1 >= rn) {
+                        continue;
+                    }
+                    const bool edge = (r1 == r - d || r1 == r + d);
+                    const int step = edge ? 1 : 2 * d;
+                    for (int c1 = c - d; c1 <= c + d; c1 += step) {
+                        if (c1 < 0 || c1 >= cn || mCount[r1][c1] == 0) {
+                            continue;
+                        }
+                        double d2 = double(r1 - r) * (r1 - r) + double(c1 - c) * (c1 - c);
+                        if (d2 > max_d2) {
+                            continue;
+                        }
+                        if (mGapFill == FILL_NEAREST) {
+                            if (d2 < best_d2) {
+                                best_d2 = d2;
+                                best = values[r1][c1];
+                            }
+                        } else {
+                            double w = 1.0 / std::pow(d2, 0.5 * mIDWPower);
+                            wsum += w;
+                            vsum += w * values[r1][c1];
+                        }
+                    }
+                }
+            }
+
+            if (mGapFill == FILL_NEAREST) {
+                grid[r][c] = best;
+            } else if (wsum > 0) {
+                grid[r][c] = vsum / wsum;
+            }
+        }
+    }
+}
+
+template<typename T>
+void DEMRasterizer<T>::clear()
+{
+    mMin.clear();
+    mMax.clear();
+    mMean.clear();
+    mCount.clear();
+    mPercentileGrid.clear();
+}
+
+template class DEMRasterizer<float>;
+template class DEMRasterizer<double>;
+
+}
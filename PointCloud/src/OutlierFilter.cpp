@@ -50,21 +50,7 @@ template<typename T>
 void OutlierFilter<T>::run(const std::vector<int>& ptIds)
 {
 	mOutilerPoints.clear();
-
-    int r = 0;
-    int c = 0;
-    int h = 0;
-    for (int i = 0; i < ptIds.size(); ++i) {
-        auto vtx = mVtxAry[ptIds[i]];
-        r = mGrid.get_r(vtx[1]);
-        c = mGrid.get_c(vtx[0]);
-        h = mGrid.get_h(vtx[2]);
-        mGrid[r][c][h].push_back(ptIds[i]);
-    }
-
-    _rn = mGrid.rowCount();
-    _cn = mGrid.colCount();
-    _hn = mGrid.heightCount();
+    mGrid.build(mVtxAry, ptIds);
     doWork();
 }
 
@@ -74,102 +60,73 @@ std::vector<int> OutlierFilter<T>::getOutlierPoints() const
 	return mOutilerPoints;
 }
 
-struct Index {
-    int r = 0;
-    int c = 0;
-    int h = 0;
-
-    Index(int r1, int c1, int h1)
-    :r(r1), c(c1), h(h1) {
-
-    }
-
-    Index():r(0), c(0), h(0) {
-
-    }
-};
-
 template<typename T>
 void OutlierFilter<T>::doWork()
 {
 	_rn = mGrid.rowCount();
 	_cn = mGrid.colCount();
 	_hn = mGrid.heightCount();
-    const int n = _rn * _cn * _hn;
+    const int n = mGrid.voxelCount();
 
-    std::vector<Index> outlier_cells;
+    std::vector<int> outlier_cells;
 
-    std::vector<int> labels(n, 0);
     int next_label = 1;
-    for (int r = 0; r < _rn; ++r) {
-        for (int c = 0; c < _cn; ++c) {
-            for (int h = 0; h < _hn; ++h) {
-                int i = getLinearId(r, c, h);
-                if (labels[i]) continue;
-
-                int label = next_label++;
-                std::stack<Index> stk;
-                std::vector<Index> cells;
-
-                stk.push(Index(r, c, h));
-                labels[i] = label;
-                cells.push_back(Index(r, c, h));
-
-                while (!stk.empty()) {
-                    Index idx = stk.top();
-                    stk.pop();
-
-                    for (int r1 = idx.r - 1; r1 <= idx.r + 1; ++r1) {
-                        if (r1 < 0) continue;
-                        if (r1 >= _rn) break;
-
-                        for (int c1 = idx.c - 1; c1 <= idx.c + 1; ++c1) {
-                            if (c1 < 0) continue;
-                            if (c1 >= _cn) break;
-
-                            for (int h1 = idx.h - 1; h1 <= idx.h + 1; ++h1) {
-                                if (h1 < 0) continue;
-                                if (h1 >= _hn) break;
-
-                                if (!mGrid.is_empty(r1, c1, h1)) {
-                                    int i1 = getLinearId(r1, c1, h1);
-                                    if (labels[i1] == 0) {
-                                        stk.push(Index(r1, c1, h1));
-                                        labels[i1] = label;
-                                        cells.push_back(Index(r1, c1, h1));
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
+    for (int i = 0; i < n; ++i) {
+        mGrid.getVoxel(i) = 0;
+    }
 
-                bool tag = false;
-                if (cells.size() <= 2) {
-                    tag = true;
-                } else if (cells.size() < 4){
-                    int n_points = 0;
-                    for (auto idx : cells) {
-                        n_points += mGrid[idx.r][idx.c][idx.h].size();
-                    }
-                    if (n_points < mNumShreshold) {
-                        tag = true;
+    std::stack<int> stk;
+    std::vector<int> cells;
+    for (int i = 0; i < n; ++i) {
+        if (mGrid.getVoxel(i)) continue;
+
+        int label = next_label++;
+        cells.clear();
+
+        stk.push(i);
+        mGrid.getVoxel(i) = label;
+        cells.push_back(i);
+
+        while (!stk.empty()) {
+            VoxelGrid<int>::VoxelIndex idx = mGrid.getVoxelIndex(stk.top());
+            stk.pop();
+
+            for (int r1 = idx.r - 1; r1 <= idx.r + 1; ++r1) {
+                for (int c1 = idx.c - 1; c1 <= idx.c + 1; ++c1) {
+                    for (int h1 = idx.h - 1; h1 <= idx.h + 1; ++h1) {
+                        int i1 = mGrid.find(r1, c1, h1);
+                        if (i1 >= 0 && mGrid.getVoxel(i1) == 0) {
+                            stk.push(i1);
+                            mGrid.getVoxel(i1) = label;
+                            cells.push_back(i1);
+                        }
                     }
                 }
+            }
+        }
 
-                if (tag) {
-                    for (auto idx : cells) {
-                        outlier_cells.push_back(idx);
-                    }
-                }
+        bool tag = false;
+        if (cells.size() <= 2) {
+            tag = true;
+        } else if (cells.size() < 4){
+            int n_points = 0;
+            for (auto cell : cells) {
+                n_points += mGrid.pointCount(cell);
+            }
+            if (n_points < mNumShreshold) {
+                tag = true;
             }
         }
+
+        if (tag) {
+            outlier_cells.insert(outlier_cells.end(), cells.begin(), cells.end());
+        }
     }
-    
+
     mOutilerPoints.clear();
-    for (auto idx : outlier_cells) {
-        const auto& ptids = mGrid[idx.r][idx.c][idx.h];
-        mOutilerPoints.insert(mOutilerPoints.end(), ptids.begin(), ptids.end());
+    for (auto cell : outlier_cells) {
+        const int* ptids = mGrid.pointIds(cell);
+        mOutilerPoints.insert(mOutilerPoints.end(), ptids, ptids + mGrid.pointCount(cell));
     }
     std::sort(mOutilerPoints.begin(), mOutilerPoints.end());
 	
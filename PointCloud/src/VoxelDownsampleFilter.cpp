@@ -0,0 +1,224 @@
+/*
+**********************************************************************
+*
+* This file is a part of library MPCDPS(Massive Point Cloud Data Processing System).
+* It is a free program and it is protected by the license GPL-v3.0, you may not use the
+* file except in compliance with the License.
+*
+* Copyright(c) 2013 - 2020 Xu Shengpan, all rights reserved.
+*
+* Email: jack_1227x@163.com
+*
+**********************************************************************
+*/
+
+#include "VoxelDownsampleFilter.h"
+#include <algorithm>
+#include "BoxGetter.h"
+#include "PublicFunc.h"
+
+namespace mpcdps {
+
+template<typename T>
+VoxelDownsampleFilter<T>::VoxelDownsampleFilter(void)
+{
+}
+
+template<typename T>
+VoxelDownsampleFilter<T>::~VoxelDownsampleFilter(void)
+{
+}
+
+template<typename T>
+void VoxelDownsampleFilter<T>::initialize(const SmartArray2D<T, 3>& vtxAry, float voxel_size)
+{
+    mVtxAry = vtxAry;
+    mVoxelSize = voxel_size;
+    mGrid.setResolution(voxel_size);
+}
+
+template<typename T>
+bool VoxelDownsampleFilter<T>::run()
+{
+    return run(make_vector<int>(mVtxAry.size()));
+}
+
+template<typename T>
+bool VoxelDownsampleFilter<T>::run(const std::vector<int>& ptIds)
+{
+    clear();
+    const int n = ptIds.size();
+    if (n == 0) {
+        mOffsets.push_back(0);
+        return true;
+    }
+
+    const int n_block = (n < 65536) ? 1 : 64;
+    const int block_size = (n + n_block - 1) / n_block;
+    std::vector<BoxGetter> bgs(n_block);
+#pragma omp parallel for
+    for (int b = 0; b < n_block; ++b) {
+        int end = MINV(n, (b + 1) * block_size);
+        for (int i = b * block_size; i < end; ++i) {
+            const T* vtx = mVtxAry[ptIds[i]];
+            bgs[b].add_point(vtx[0], vtx[1], vtx[2]);
+        }
+    }
+    for (int b = 1; b < n_block; ++b) {
+        bgs[0].add_point(bgs[b]._xmin, bgs[b]._ymin, bgs[b]._zmin);
+        bgs[0].add_point(bgs[b]._xmax, bgs[b]._ymax, bgs[b]._zmax);
+    }
+
+    /*indices start from -2^20 + 1, so that 2^21 voxels fit the packed key of Grid3D,
+     * with a voxel on each side for the rounding of the indices.
+     */
+    const double res = mGrid.getResolution();
+    const double bias = double((1 << 20) - 1) * res;
+    const double vmin[3] = { bgs[0]._xmin, bgs[0]._ymin, bgs[0]._zmin };
+    const double vmax[3] = { bgs[0]._xmax, bgs[0]._ymax, bgs[0]._zmax };
+    for (int i = 0; i < 3; ++i) {
+        if ((vmax[i] - vmin[i]) / res >= double(1 << 21) - 3) {
+            return false;
+        }
+    }
+    for (int i = 0; i < 3; ++i) {
+        mOrigin[i] = vmin[i] + bias;
+    }
+    mGrid.setOrigin(mOrigin[0], mOrigin[1], mOrigin[2]);
+
+    std::vector<int> ptids(ptIds);
+    groupPoints(ptids);
+    reduce();
+    return true;
+}
+
+template<typename T>
+void VoxelDownsampleFilter<T>::groupPoints(std::vector<int>& ptids)
+{
+    const int n = ptids.size();
+    std::vector<uint64> keys(n);
+#pragma omp parallel for
+    for (int i = 0; i < n; ++i) {
+        const T* vtx = mVtxAry[ptids[i]];
+        keys[i] = mGrid.getIndexKey(vtx[0], vtx[1], vtx[2]);
+    }
+    sort_radix_syn(keys, ptids);
+
+    /*the first point of each voxel is counted and indexed by blocks. */
+    const int n_block = (n < 65536) ? 1 : 256;
+    const int block_size = (n + n_block - 1) / n_block;
+    std::vector<int> block_first(n_block + 1, 0);
+#pragma omp parallel for
+    for (int b = 0; b < n_block; ++b) {
+        int end = MINV(n, (b + 1) * block_size);
+        int count = 0;
+        for (int i = b * block_size; i < end; ++i) {
+            if (i == 0 || keys[i] != keys[i - 1]) {
+                ++count;
+            }
+        }
+        block_first[b + 1] = count;
+    }
+    for (int b = 0; b < n_block; ++b) {
+        block_first[b + 1] += block_first[b];
+    }
+
+    const int m = block_first[n_block];
+    mKeys.resize(m);
+    mOffsets.resize(m + 1);
+#pragma omp parallel for
+    for (int b = 0; b < n_block; ++b) {
+        int end = MINV(n, (b + 1) * block_size);
+        int v = block_first[b];
+        for (int i = b * block_size; i < end; ++i) {
+            if (i == 0 || keys[i] != keys[i - 1]) {
+                mKeys[v] = keys[i];
+                mOffsets[v] = i;
+                ++v;
+            }
+        }
+    }
+    mOffsets[m] = n;
+    mPtIds.swap(ptids);
+
+    mPointVoxels.assign(mVtxAry.size(), -1);
+#pragma omp parallel for
+    for (int v = 0; v < m; ++v) {
+        for (int i = mOffsets[v]; i < mOffsets[v + 1]; ++i) {
+            mPointVoxels[mPtIds[i]] = v;
+        }
+    }
+}
+
+template<typename T>
+void VoxelDownsampleFilter<T>::reduce()
+{
+    const int m = voxelCount();
+    const double res = mGrid.getResolution();
+    mPoints.resize(m);
+    if (mMode != CENTROID) {
+        mRepresentatives.resize(m);
+    }
+
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (int v = 0; v < m; ++v) {
+        const int begin = mOffsets[v];
+        const int end = mOffsets[v + 1];
+        int id = mPtIds[begin];
+        if (mMode == CENTROID) {
+            double sum[3] = { 0, 0, 0 };
+            for (int i = begin; i < end; ++i) {
+                const T* vtx = mVtxAry[mPtIds[i]];
+                sum[0] += vtx[0];
+                sum[1] += vtx[1];
+                sum[2] += vtx[2];
+            }
+            for (int k = 0; k < 3; ++k) {
+                mPoints[v][k] = T(sum[k] / (end - begin));
+            }
+            continue;
+        }
+
+        if (mMode == FIRST) {
+            for (int i = begin + 1; i < end; ++i) {
+                id = MINV(id, mPtIds[i]);
+            }
+        } else {
+            const Grid3D<int>::Index idx = mGrid.getIndex(mKeys[v]);
+            double center[3];
+            for (int k = 0; k < 3; ++k) {
+                center[k] = mOrigin[k] + (idx[k] + 0.5) * res;
+            }
+            double dmin = DBL_MAX;
+            for (int i = begin; i < end; ++i) {
+                const T* vtx = mVtxAry[mPtIds[i]];
+                double d = Square(vtx[0] - center[0]) + Square(vtx[1] - center[1]) + Square(vtx[2] - center[2]);
+                if (d < dmin) {
+                    dmin = d;
+                    id = mPtIds[i];
+                }
+            }
+        }
+        mRepresentatives[v] = id;
+        const T* vtx = mVtxAry[id];
+        mPoints[v][0] = vtx[0];
+        mPoints[v][1] = vtx[1];
+        mPoints[v][2] = vtx[2];
+    }
+}
+
+template<typename T>
+void VoxelDownsampleFilter<T>::clear()
+{
+    mKeys.clear();
+    mOffsets.clear();
+    mPtIds.clear();
+    mPointVoxels.clear();
+    mRepresentatives.clear();
+    mPoints.clear();
+}
+
+template class VoxelDownsampleFilter<float>;
+template class VoxelDownsampleFilter<double>;
+
+}